@@ -0,0 +1,703 @@
+/*
+ * File:	Instruction.cpp
+ *
+ * Description:	This file contains the member function definitions for
+ *		operands and instructions on the Intel 64-bit processor,
+ *		along with the functions for writing them in AT&T syntax.
+ */
+
+# include "machine.h"
+# include "Instruction.h"
+
+using namespace std;
+
+static string conditions[] = {"e", "ne", "l", "ge", "le", "g"};
+
+
+/*
+ * Function:	invert
+ *
+ * Description:	Return the condition that holds exactly when the given
+ *		condition does not.  The conditions are declared in pairs
+ *		so this is just a matter of flipping the low bit.
+ */
+
+Condition invert(Condition cond)
+{
+    return (Condition) (cond ^ 1);
+}
+
+
+/*
+ * Function:	Operand::Operand (constructor)
+ *
+ * Description:	Initialize an empty operand.
+ */
+
+Operand::Operand()
+    : _kind(NONE), _size(0), _base(nullptr), _index(nullptr), _scale(1),
+      _value(0)
+{
+}
+
+
+/*
+ * Function:	Operand::Operand (constructor)
+ *
+ * Description:	Initialize a register operand of the given size.
+ */
+
+Operand::Operand(Register *reg, unsigned size)
+    : _kind(REG), _size(size), _base(reg), _index(nullptr), _scale(1),
+      _value(0)
+{
+}
+
+
+/*
+ * Function:	Operand::immediate
+ *
+ * Description:	Return an immediate operand with the given value.
+ */
+
+Operand Operand::immediate(long value, unsigned size)
+{
+    Operand op;
+
+    op._kind = IMM;
+    op._size = size;
+    op._value = value;
+    return op;
+}
+
+
+/*
+ * Function:	Operand::immediate
+ *
+ * Description:	Return an immediate operand whose value is the given
+ *		symbol, which will be resolved by the assembler.
+ */
+
+Operand Operand::immediate(const string &symbol, unsigned size)
+{
+    Operand op;
+
+    op._kind = IMM;
+    op._size = size;
+    op._symbol = symbol;
+    return op;
+}
+
+
+/*
+ * Function:	Operand::memory
+ *
+ * Description:	Return a memory operand for the given base register and
+ *		displacement.
+ */
+
+Operand Operand::memory(Register *base, long disp, unsigned size)
+{
+    Operand op;
+
+    op._kind = MEM;
+    op._size = size;
+    op._base = base;
+    op._value = disp;
+    return op;
+}
+
+
+/*
+ * Function:	Operand::memory
+ *
+ * Description:	Return a memory operand for the given base register plus
+ *		the given index register times the scale plus the
+ *		displacement.
+ */
+
+Operand Operand::memory(Register *base, Register *index, unsigned scale,
+	long disp, unsigned size)
+{
+    Operand op = memory(base, disp, size);
+
+    op._index = index;
+    op._scale = scale;
+    return op;
+}
+
+
+/*
+ * Function:	Operand::global
+ *
+ * Description:	Return a memory operand for the given global symbol.
+ */
+
+Operand Operand::global(const string &symbol, unsigned size)
+{
+    Operand op;
+
+    op._kind = MEM;
+    op._size = size;
+    op._symbol = symbol;
+    return op;
+}
+
+
+/*
+ * Function:	Operand::target
+ *
+ * Description:	Return an operand naming a jump or call target.
+ */
+
+Operand Operand::target(const string &name)
+{
+    Operand op;
+
+    op._kind = TARGET;
+    op._symbol = name;
+    return op;
+}
+
+
+/*
+ * Function:	Operand::isReg
+ *
+ * Description:	Return whether this operand is a register, and if a
+ *		register is given, whether it is that register.
+ */
+
+bool Operand::isReg(const Register *reg) const
+{
+    return _kind == REG && (reg == nullptr || _base == reg);
+}
+
+
+/*
+ * Function:	Operand::isImm
+ *
+ * Description:	Return whether this operand is an immediate value.
+ */
+
+bool Operand::isImm() const
+{
+    return _kind == IMM;
+}
+
+
+/*
+ * Function:	Operand::isMem
+ *
+ * Description:	Return whether this operand is a memory reference.
+ */
+
+bool Operand::isMem() const
+{
+    return _kind == MEM;
+}
+
+
+/*
+ * Function:	Operand::isSmall
+ *
+ * Description:	Return whether this operand is an immediate value that
+ *		fits in the 32-bit immediate field that nearly every
+ *		instruction is limited to.
+ */
+
+bool Operand::isSmall() const
+{
+    return _kind == IMM && (!_symbol.empty() || _value == (int) _value);
+}
+
+
+/*
+ * Function:	Operand::operator ==
+ *
+ * Description:	Return whether two operands are the same, including their
+ *		access sizes.
+ */
+
+bool Operand::operator ==(const Operand &rhs) const
+{
+    return _kind == rhs._kind && _size == rhs._size && _base == rhs._base
+	&& _index == rhs._index && _scale == rhs._scale
+	&& _value == rhs._value && _symbol == rhs._symbol;
+}
+
+
+/*
+ * Function:	Operand::operator !=
+ *
+ * Description:	Return whether two operands differ.
+ */
+
+bool Operand::operator !=(const Operand &rhs) const
+{
+    return !operator ==(rhs);
+}
+
+
+/*
+ * Function:	Instruction::Instruction (constructor)
+ *
+ * Description:	Initialize an instruction with no operands.
+ */
+
+Instruction::Instruction(Opcode opcode, unsigned size)
+    : _opcode(opcode), _cond(CC_E), _size(size)
+{
+}
+
+
+/*
+ * Function:	Instruction::Instruction (constructor)
+ *
+ * Description:	Initialize an instruction with a single operand.
+ */
+
+Instruction::Instruction(Opcode opcode, unsigned size, const Operand &op)
+    : _opcode(opcode), _cond(CC_E), _size(size)
+{
+    _operands.push_back(op);
+}
+
+
+/*
+ * Function:	Instruction::Instruction (constructor)
+ *
+ * Description:	Initialize an instruction with a source and destination
+ *		operand, given in AT&T order.
+ */
+
+Instruction::Instruction(Opcode opcode, unsigned size, const Operand &src,
+	const Operand &dst)
+    : _opcode(opcode), _cond(CC_E), _size(size)
+{
+    _operands.push_back(src);
+    _operands.push_back(dst);
+}
+
+
+/*
+ * Function:	Instruction::reads
+ *
+ * Description:	Return whether the value of the given operand is read by
+ *		this instruction.  The registers of a memory reference are
+ *		always read and are not considered here.
+ */
+
+bool Instruction::reads(unsigned i) const
+{
+    unsigned last = _operands.size() - 1;
+
+
+    switch (_opcode) {
+    case MOV:
+    case MOVS:
+    case MOVZ:
+    case MOVDQU:
+    case MOVDQA:
+    case PSHUFD:
+	return i != last;
+
+    case IMUL:
+	return _operands.size() <= 2 || i != last;
+
+    case ADD:
+    case SUB:
+    case NEG:
+    case AND:
+    case SHL:
+    case SAR:
+    case SHR:
+    case CMP:
+    case TEST:
+    case CMOV:
+    case IDIV:
+    case PUSH:
+    case PADD:
+    case PSUB:
+    case PMULUDQ:
+    case PCMPGT:
+    case PXOR:
+    case PSRL:
+    case PUNPCKL:
+	return true;
+
+    default:
+	return false;
+    }
+}
+
+
+/*
+ * Function:	Instruction::writes
+ *
+ * Description:	Return whether the given operand is written by this
+ *		instruction.
+ */
+
+bool Instruction::writes(unsigned i) const
+{
+    unsigned last = _operands.size() - 1;
+
+
+    switch (_opcode) {
+    case MOV:
+    case MOVS:
+    case MOVZ:
+    case LEA:
+    case SET:
+    case CMOV:
+    case POP:
+    case ADD:
+    case SUB:
+    case NEG:
+    case AND:
+    case SHL:
+    case SAR:
+    case SHR:
+    case MOVDQU:
+    case MOVDQA:
+    case PADD:
+    case PSUB:
+    case PMULUDQ:
+    case PCMPGT:
+    case PXOR:
+    case PSRL:
+    case PSHUFD:
+    case PUNPCKL:
+	return i == last;
+
+    case IMUL:
+	return i == last && _operands.size() > 1;
+
+    default:
+	return false;
+    }
+}
+
+
+/*
+ * Function:	Instruction::registers
+ *
+ * Description:	Determine the registers read and written by this
+ *		instruction, both explicitly and implicitly.
+ */
+
+void Instruction::registers(vector<Register *> &uses,
+	vector<Register *> &defs) const
+{
+    uses = _uses;
+    defs = _defs;
+
+    for (unsigned i = 0; i < _operands.size(); i ++) {
+	const Operand &op = _operands[i];
+
+	if (op._kind == Operand::MEM) {
+	    if (op._base != nullptr)
+		uses.push_back(op._base);
+
+	    if (op._index != nullptr)
+		uses.push_back(op._index);
+
+	} else if (op._kind == Operand::REG) {
+	    if (reads(i))
+		uses.push_back(op._base);
+
+	    if (writes(i))
+		defs.push_back(op._base);
+	}
+    }
+
+    if (_opcode == IDIV) {
+	uses.push_back(rax);
+	uses.push_back(rdx);
+	defs.push_back(rax);
+	defs.push_back(rdx);
+
+    } else if (_opcode == IMUL && _operands.size() == 1) {
+	uses.push_back(rax);
+	defs.push_back(rax);
+	defs.push_back(rdx);
+
+    } else if (_opcode == CVT) {
+	uses.push_back(rax);
+	defs.push_back(rdx);
+    }
+}
+
+
+/*
+ * Function:	Instruction::isBranch
+ *
+ * Description:	Return whether this instruction transfers control and
+ *		therefore ends a basic block.
+ */
+
+bool Instruction::isBranch() const
+{
+    return _opcode == JMP || _opcode == JCC || _opcode == RET;
+}
+
+
+/*
+ * Function:	Instruction::isCopy
+ *
+ * Description:	Return whether this instruction simply copies one
+ *		register to another.
+ */
+
+bool Instruction::isCopy() const
+{
+    return _opcode == MOV && _operands[0].isReg() && _operands[1].isReg();
+}
+
+
+/*
+ * Function:	suffix (private)
+ *
+ * Description:	Return the suffix for an opcode based on the given size.
+ */
+
+static string suffix(unsigned size)
+{
+    return size == 1 ? "b" : (size == 4 ? "l" : "q");
+}
+
+
+/*
+ * Function:	lanes (private)
+ *
+ * Description:	Return the suffix for a packed opcode based on the size of
+ *		each lane.
+ */
+
+static string lanes(unsigned size)
+{
+    return size == 4 ? "d" : "q";
+}
+
+
+/*
+ * Function:	operator <<
+ *
+ * Description:	Write an operand to a stream in AT&T syntax.
+ */
+
+ostream &operator <<(ostream &ostr, const Operand &op)
+{
+    switch (op._kind) {
+    case Operand::REG:
+	return ostr << op._base->name(op._size);
+
+    case Operand::IMM:
+	if (!op._symbol.empty())
+	    return ostr << "$" << op._symbol;
+
+	return ostr << "$" << op._value;
+
+    case Operand::MEM:
+	ostr << op._symbol;
+
+	if (op._symbol.empty()) {
+	    if (op._value != 0 || op._base == nullptr)
+		ostr << op._value;
+	} else if (op._value != 0)
+	    ostr << (op._value > 0 ? "+" : "") << op._value;
+
+	if (op._base != nullptr || op._index != nullptr) {
+	    ostr << "(";
+
+	    if (op._base != nullptr)
+		ostr << op._base->name();
+
+	    if (op._index != nullptr)
+		ostr << "," << op._index->name() << "," << op._scale;
+
+	    ostr << ")";
+
+	} else if (!op._symbol.empty())
+	    ostr << global_suffix;
+
+	return ostr;
+
+    case Operand::TARGET:
+	return ostr << op._symbol;
+
+    default:
+	return ostr;
+    }
+}
+
+
+/*
+ * Function:	operator <<
+ *
+ * Description:	Write an instruction to a stream in AT&T syntax.
+ */
+
+ostream &operator <<(ostream &ostr, const Instruction &inst)
+{
+    const vector<Operand> &ops = inst._operands;
+    unsigned log;
+
+
+    switch (inst._opcode) {
+    case LABEL:
+	if (inst._size > 1) {
+	    log = 0;
+
+	    while ((1u << log) < inst._size)
+		log ++;
+
+	    ostr << "\t.p2align\t" << log << endl;
+	}
+
+	return ostr << ops[0] << ":" << endl;
+
+    case MOV:
+	ostr << "\tmov" << suffix(inst._size);
+	break;
+
+    case MOVS:
+	ostr << "\tmovs" << suffix(ops[0]._size) << suffix(ops[1]._size);
+	break;
+
+    case MOVZ:
+	ostr << "\tmovz" << suffix(ops[0]._size) << suffix(ops[1]._size);
+	break;
+
+    case LEA:
+	ostr << "\tlea" << suffix(inst._size);
+	break;
+
+    case ADD:
+	ostr << "\tadd" << suffix(inst._size);
+	break;
+
+    case SUB:
+	ostr << "\tsub" << suffix(inst._size);
+	break;
+
+    case IMUL:
+	ostr << "\timul" << suffix(inst._size);
+	break;
+
+    case IDIV:
+	ostr << "\tidiv" << suffix(inst._size);
+	break;
+
+    case NEG:
+	ostr << "\tneg" << suffix(inst._size);
+	break;
+
+    case AND:
+	ostr << "\tand" << suffix(inst._size);
+	break;
+
+    case SHL:
+	ostr << "\tshl" << suffix(inst._size);
+	break;
+
+    case SAR:
+	ostr << "\tsar" << suffix(inst._size);
+	break;
+
+    case SHR:
+	ostr << "\tshr" << suffix(inst._size);
+	break;
+
+    case CMP:
+	ostr << "\tcmp" << suffix(inst._size);
+	break;
+
+    case TEST:
+	ostr << "\ttest" << suffix(inst._size);
+	break;
+
+    case SET:
+	ostr << "\tset" << conditions[inst._cond];
+	break;
+
+    case CMOV:
+	ostr << "\tcmov" << conditions[inst._cond] << suffix(inst._size);
+	break;
+
+    case CVT:
+	return ostr << (inst._size == 4 ? "\tcltd" : "\tcqto") << endl;
+
+    case PUSH:
+	ostr << "\tpushq";
+	break;
+
+    case POP:
+	ostr << "\tpopq";
+	break;
+
+    case JMP:
+	ostr << "\tjmp";
+	break;
+
+    case JCC:
+	ostr << "\tj" << conditions[inst._cond];
+	break;
+
+    case CALL:
+	ostr << "\tcall";
+	break;
+
+    case RET:
+	if (ops.empty())
+	    return ostr << "\tret" << endl;
+
+	ostr << "\tjmp";
+	break;
+
+    case MOVDQU:
+	ostr << "\tmovdqu";
+	break;
+
+    case MOVDQA:
+	ostr << "\tmovdqa";
+	break;
+
+    case PADD:
+	ostr << "\tpadd" << lanes(inst._size);
+	break;
+
+    case PSUB:
+	ostr << "\tpsub" << lanes(inst._size);
+	break;
+
+    case PMULUDQ:
+	ostr << "\tpmuludq";
+	break;
+
+    case PCMPGT:
+	ostr << "\tpcmpgt" << lanes(inst._size);
+	break;
+
+    case PXOR:
+	ostr << "\tpxor";
+	break;
+
+    case PSRL:
+	ostr << "\tpsrl" << lanes(inst._size);
+	break;
+
+    case PSHUFD:
+	ostr << "\tpshufd";
+	break;
+
+    case PUNPCKL:
+	ostr << "\tpunpckl" << lanes(inst._size) << "q";
+	break;
+    }
+
+    for (unsigned i = 0; i < ops.size(); i ++)
+	ostr << (i == 0 ? "\t" : ", ") << ops[i];
+
+    return ostr << endl;
+}
@@ -0,0 +1,116 @@
+/*
+ * File:	Instruction.h
+ *
+ * Description:	This file contains the class definitions for operands and
+ *		instructions on the Intel 64-bit processor.  Rather than
+ *		writing assembly text as it goes, the code generator builds
+ *		a list of instructions for each function.  The list can
+ *		then be examined and rewritten (most importantly by the
+ *		register allocator) before being written out using AT&T
+ *		syntax.
+ *
+ *		An operand is either a register, an immediate value, a
+ *		memory reference, or the name of a jump or call target.  A
+ *		memory reference has the general form of a symbol plus a
+ *		displacement plus a base register plus a scaled index
+ *		register, any of which may be absent.
+ *
+ *		Besides the operands explicitly written, an instruction may
+ *		implicitly read and write other registers.  Those implied
+ *		by the opcode (e.g., idiv) are known to the instruction
+ *		itself, while those implied by the calling convention
+ *		(e.g., call and ret) are recorded by the code generator.
+ *
+ *		A few instructions need more explanation.  A ret with a
+ *		target is a tail call, which is written as a jump once the
+ *		frame has been torn down, and a label with a size is
+ *		aligned on a boundary of that many bytes.  The packed SSE
+ *		instructions work on the lanes of an SSE register, and for
+ *		them the size of the instruction is the size of a lane.
+ *		Finally, a conditional move only writes its destination if
+ *		its condition holds, so it also reads the destination.
+ */
+
+# ifndef INSTRUCTION_H
+# define INSTRUCTION_H
+# include <string>
+# include <vector>
+# include <ostream>
+# include "Register.h"
+
+enum Opcode {
+    MOV, MOVS, MOVZ, LEA, ADD, SUB, IMUL, IDIV, NEG, AND, SHL, SAR, SHR,
+    CMP, TEST, SET, CMOV, CVT, PUSH, POP, JMP, JCC, CALL, RET, LABEL,
+    MOVDQU, MOVDQA, PADD, PSUB, PMULUDQ, PCMPGT, PXOR, PSRL, PSHUFD, PUNPCKL
+};
+
+enum Condition {
+    CC_E, CC_NE, CC_L, CC_GE, CC_LE, CC_G
+};
+
+Condition invert(Condition cond);
+
+
+class Operand {
+    typedef std::string string;
+
+public:
+    enum Kind { NONE, REG, IMM, MEM, TARGET };
+
+    Kind _kind;
+    unsigned _size;
+    Register *_base, *_index;
+    unsigned _scale;
+    long _value;
+    string _symbol;
+
+    Operand();
+    Operand(Register *reg, unsigned size);
+
+    static Operand immediate(long value, unsigned size);
+    static Operand immediate(const string &symbol, unsigned size);
+    static Operand memory(Register *base, long disp, unsigned size);
+    static Operand memory(Register *base, Register *index, unsigned scale,
+	long disp, unsigned size);
+    static Operand global(const string &symbol, unsigned size);
+    static Operand target(const string &name);
+
+    bool isReg(const Register *reg = nullptr) const;
+    bool isImm() const;
+    bool isMem() const;
+    bool isSmall() const;
+    bool operator ==(const Operand &rhs) const;
+    bool operator !=(const Operand &rhs) const;
+};
+
+
+class Instruction {
+    typedef std::string string;
+
+public:
+    Opcode _opcode;
+    Condition _cond;
+    unsigned _size;
+    std::vector<Operand> _operands;
+    std::vector<Register *> _uses, _defs;
+
+    Instruction(Opcode opcode, unsigned size);
+    Instruction(Opcode opcode, unsigned size, const Operand &op);
+    Instruction(Opcode opcode, unsigned size, const Operand &src,
+	const Operand &dst);
+
+    void registers(std::vector<Register *> &uses,
+	std::vector<Register *> &defs) const;
+
+    bool reads(unsigned i) const;
+    bool writes(unsigned i) const;
+    bool isBranch() const;
+    bool isCopy() const;
+};
+
+typedef std::vector<Instruction> Instructions;
+
+std::ostream &operator <<(std::ostream &ostr, const Operand &op);
+std::ostream &operator <<(std::ostream &ostr, const Instruction &inst);
+
+# endif /* INSTRUCTION_H */
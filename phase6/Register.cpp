@@ -2,7 +2,8 @@
  * File:	Register.cpp
  *
  * Description:	This file contains the member function definitions for
- *		registers on the Intel 64-bit processor.
+ *		registers on the Intel 64-bit processor, along with the
+ *		machine registers themselves.
  */
 
 # include "Tree.h"
@@ -10,19 +11,114 @@
 
 using namespace std;
 
+/* The machine registers are statically allocated so that the pointers to
+   them can be used while initializing other translation units. */
+
+static Register _rax("%rax", "%eax", "%al", 0);
+static Register _rcx("%rcx", "%ecx", "%cl", 1);
+static Register _rdx("%rdx", "%edx", "%dl", 2);
+static Register _rbx("%rbx", "%ebx", "%bl", 3);
+static Register _rsp("%rsp", "%esp", "%spl", 4);
+static Register _rbp("%rbp", "%ebp", "%bpl", 5);
+static Register _rsi("%rsi", "%esi", "%sil", 6);
+static Register _rdi("%rdi", "%edi", "%dil", 7);
+static Register _r8("%r8", "%r8d", "%r8b", 8);
+static Register _r9("%r9", "%r9d", "%r9b", 9);
+static Register _r10("%r10", "%r10d", "%r10b", 10);
+static Register _r11("%r11", "%r11d", "%r11b", 11);
+static Register _r12("%r12", "%r12d", "%r12b", 12);
+static Register _r13("%r13", "%r13d", "%r13b", 13);
+static Register _r14("%r14", "%r14d", "%r14b", 14);
+static Register _r15("%r15", "%r15d", "%r15b", 15);
+static Register _xmm0("%xmm0", "%xmm0", "%xmm0", 16);
+static Register _xmm1("%xmm1", "%xmm1", "%xmm1", 17);
+static Register _xmm2("%xmm2", "%xmm2", "%xmm2", 18);
+static Register _xmm3("%xmm3", "%xmm3", "%xmm3", 19);
+static Register _xmm4("%xmm4", "%xmm4", "%xmm4", 20);
+static Register _xmm5("%xmm5", "%xmm5", "%xmm5", 21);
+static Register _xmm6("%xmm6", "%xmm6", "%xmm6", 22);
+static Register _xmm7("%xmm7", "%xmm7", "%xmm7", 23);
+static Register _xmm8("%xmm8", "%xmm8", "%xmm8", 24);
+static Register _xmm9("%xmm9", "%xmm9", "%xmm9", 25);
+static Register _xmm10("%xmm10", "%xmm10", "%xmm10", 26);
+static Register _xmm11("%xmm11", "%xmm11", "%xmm11", 27);
+static Register _xmm12("%xmm12", "%xmm12", "%xmm12", 28);
+static Register _xmm13("%xmm13", "%xmm13", "%xmm13", 29);
+static Register _xmm14("%xmm14", "%xmm14", "%xmm14", 30);
+static Register _xmm15("%xmm15", "%xmm15", "%xmm15", 31);
+
+Register *rax = &_rax;
+Register *rcx = &_rcx;
+Register *rdx = &_rdx;
+Register *rbx = &_rbx;
+Register *rsp = &_rsp;
+Register *rbp = &_rbp;
+Register *rsi = &_rsi;
+Register *rdi = &_rdi;
+Register *r8 = &_r8;
+Register *r9 = &_r9;
+Register *r10 = &_r10;
+Register *r11 = &_r11;
+Register *r12 = &_r12;
+Register *r13 = &_r13;
+Register *r14 = &_r14;
+Register *r15 = &_r15;
+Register *xmm0 = &_xmm0;
+Register *xmm1 = &_xmm1;
+Register *xmm2 = &_xmm2;
+Register *xmm3 = &_xmm3;
+Register *xmm4 = &_xmm4;
+Register *xmm5 = &_xmm5;
+Register *xmm6 = &_xmm6;
+Register *xmm7 = &_xmm7;
+Register *xmm8 = &_xmm8;
+Register *xmm9 = &_xmm9;
+Register *xmm10 = &_xmm10;
+Register *xmm11 = &_xmm11;
+Register *xmm12 = &_xmm12;
+Register *xmm13 = &_xmm13;
+Register *xmm14 = &_xmm14;
+Register *xmm15 = &_xmm15;
+
+Register *machine_registers[NUM_MACHINE_REGS] = {
+    &_rax, &_rcx, &_rdx, &_rbx, &_rsp, &_rbp, &_rsi, &_rdi,
+    &_r8, &_r9, &_r10, &_r11, &_r12, &_r13, &_r14, &_r15,
+    &_xmm0, &_xmm1, &_xmm2, &_xmm3, &_xmm4, &_xmm5, &_xmm6, &_xmm7,
+    &_xmm8, &_xmm9, &_xmm10, &_xmm11, &_xmm12, &_xmm13, &_xmm14, &_xmm15,
+};
+
 
 /*
  * Function:	Register::Register (constructor)
  *
- * Description:	Initialize this register with its correct operand names.
+ * Description:	Initialize this register with its correct operand names
+ *		and hardware number.
  */
 
-Register::Register(const string &qword, const string &lword, const string &byte)
-    : _qword(qword), _lword(lword), _byte(byte), _node(nullptr)
+Register::Register(const string &qword, const string &lword, const string &byte,
+	unsigned number)
+    : _qword(qword), _lword(lword), _byte(byte), _number(number),
+      _node(nullptr)
 {
 }
 
 
+/*
+ * Function:	Register::Register (constructor)
+ *
+ * Description:	Initialize a virtual register.  Its operand names are only
+ *		ever seen when debugging the register allocator.
+ */
+
+Register::Register(unsigned number)
+    : _number(number), _node(nullptr)
+{
+    _qword = "%v" + to_string(number);
+    _lword = _qword + "d";
+    _byte = _qword + "b";
+}
+
+
 /*
  * Function:	Register::name
  *
@@ -48,6 +144,30 @@ const string &Register::byte() const
 }
 
 
+/*
+ * Function:	Register::number (accessor)
+ *
+ * Description:	Return the number of this register.
+ */
+
+unsigned Register::number() const
+{
+    return _number;
+}
+
+
+/*
+ * Function:	Register::isVirtual
+ *
+ * Description:	Return whether this register is a virtual register.
+ */
+
+bool Register::isVirtual() const
+{
+    return _number >= NUM_MACHINE_REGS;
+}
+
+
 /*
  * Function:	operator <<
  *
@@ -8,6 +8,14 @@
  *		long word (since a word is historically 16-bits), and a
  *		64-bit quad word.  By default, the 64-bit quad word name
  *		will be used.
+ *
+ *		Each register also has a number.  The sixteen general
+ *		purpose registers use their hardware encodings, and the
+ *		sixteen SSE registers, which have just the one name, follow
+ *		them.  These are the machine registers.  Virtual registers
+ *		are numbered after them and are handed out by the code
+ *		generator until the register allocator replaces them with
+ *		machine registers.
  */
 
 # ifndef REGISTER_H
@@ -15,20 +23,34 @@
 # include <string>
 # include <ostream>
 
+# define NUM_MACHINE_REGS 32
+
 class Register {
     typedef std::string string;
     string _qword;
     string _lword;
     string _byte;
+    unsigned _number;
 
 public:
     class Expression *_node;
 
-    Register(const string &qword, const string &lword, const string &byte);
+    Register(const string &qword, const string &lword, const string &byte,
+	unsigned number);
+    Register(unsigned number);
+
     const string &name(unsigned size = 0) const;
     const string &byte() const;
+    unsigned number() const;
+    bool isVirtual() const;
 };
 
 std::ostream &operator <<(std::ostream &ostr, const Register *reg);
 
+extern Register *rax, *rcx, *rdx, *rbx, *rsp, *rbp, *rsi, *rdi;
+extern Register *r8, *r9, *r10, *r11, *r12, *r13, *r14, *r15;
+extern Register *xmm0, *xmm1, *xmm2, *xmm3, *xmm4, *xmm5, *xmm6, *xmm7;
+extern Register *xmm8, *xmm9, *xmm10, *xmm11, *xmm12, *xmm13, *xmm14, *xmm15;
+extern Register *machine_registers[NUM_MACHINE_REGS];
+
 # endif /* REGISTER_H */
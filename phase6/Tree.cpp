@@ -24,6 +24,7 @@
 # include <sstream>
 # include "tokens.h"
 # include "Tree.h"
+# include "profile.h"
 
 using namespace std;
 
@@ -157,6 +158,23 @@ Number::Number(unsigned long value)
 }
 
 
+/*
+ * Function:	Number::Number (constructor)
+ *
+ * Description:	Initialize a number of the given type, such as the result
+ *		of folding a constant expression.
+ */
+
+Number::Number(unsigned long value, const Type &type)
+    : Expression(type)
+{
+    stringstream ss;
+
+    ss << value;
+    _value = ss.str();
+}
+
+
 /*
  * Function:	Number::Number (constructor)
  *
@@ -471,36 +489,44 @@ Scope *Block::declarations() const
 /*
  * Function:	While::While (constructor)
  *
- * Description:	Initialize a while statement.
+ * Description:	Initialize a while statement, which has a counter for
+ *		how often it is reached and one for how often its body is
+ *		executed.
  */
 
 While::While(Expression *expr, Statement *stmt)
     : _expr(expr), _stmt(stmt)
 {
+    _counter = newCounters(2);
 }
 
 
 /*
  * Function:	For::For (constructor)
  *
- * Description:	Initialize a for statement.
+ * Description:	Initialize a for statement, which has counters just as a
+ *		while statement.
  */
 
 For::For(Statement *init, Expression *expr, Statement *incr, Statement *stmt)
     : _init(init), _expr(expr), _incr(incr), _stmt(stmt)
 {
+    _counter = newCounters(2);
 }
 
 
 /*
  * Function:	If::If (constructor)
  *
- * Description:	Initialize an if-then or if-then-else statement.
+ * Description:	Initialize an if-then or if-then-else statement, which has
+ *		a counter for how often it is reached and one for how often
+ *		the then statement is executed.
  */
 
 If::If(Expression *expr, Statement *thenStmt, Statement *elseStmt)
     : _expr(expr), _thenStmt(thenStmt), _elseStmt(elseStmt)
 {
+    _counter = newCounters(2);
 }
 
 
@@ -519,12 +545,14 @@ Simple::Simple(Expression *expr)
 /*
  * Function:	Function::Function (constructor)
  *
- * Description:	Initialize a function object.
+ * Description:	Initialize a function object, which has a counter for how
+ *		often it is called.
  */
 
 Function::Function(const Symbol *id, Block *body)
     : _id(id), _body(body)
 {
+    _counter = newCounters(1);
 }
 
 
@@ -553,6 +581,165 @@ bool Number::isNumber(unsigned long &value) const
 }
 
 
+/*
+ * Function:	Expression::isIdentifier (accessor)
+ *
+ * Description:	Return false since most expressions are not identifiers.
+ */
+
+bool Expression::isIdentifier(const Symbol *&symbol) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Identifier::isIdentifier (accessor)
+ *
+ * Description:	Return true since an identifier is in fact an identifier.
+ */
+
+bool Identifier::isIdentifier(const Symbol *&symbol) const
+{
+    symbol = _symbol;
+    return true;
+}
+
+
+/*
+ * Function:	Expression::isPure (accessor)
+ *
+ * Description:	Return true since most expressions have no side effects.
+ */
+
+bool Expression::isPure() const
+{
+    return true;
+}
+
+
+/*
+ * Function:	Unary::isPure (accessor)
+ *
+ * Description:	Return whether the operand has no side effects.
+ */
+
+bool Unary::isPure() const
+{
+    return _expr->isPure();
+}
+
+
+/*
+ * Function:	Binary::isPure (accessor)
+ *
+ * Description:	Return whether neither operand has side effects.
+ */
+
+bool Binary::isPure() const
+{
+    return _left->isPure() && _right->isPure();
+}
+
+
+/*
+ * Function:	Call::isPure (accessor)
+ *
+ * Description:	Return false since the called function may do anything.
+ */
+
+bool Call::isPure() const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Expression::isSafe (accessor)
+ *
+ * Description:	Return whether the expression may be evaluated even when
+ *		the program would not have evaluated it, since it has no
+ *		side effects and cannot fault.  Most expressions are safe.
+ */
+
+bool Expression::isSafe() const
+{
+    return true;
+}
+
+
+/*
+ * Function:	Unary::isSafe (accessor)
+ *
+ * Description:	Return whether the operand is safe to evaluate.
+ */
+
+bool Unary::isSafe() const
+{
+    return _expr->isSafe();
+}
+
+
+/*
+ * Function:	Binary::isSafe (accessor)
+ *
+ * Description:	Return whether both operands are safe to evaluate.
+ */
+
+bool Binary::isSafe() const
+{
+    return _left->isSafe() && _right->isSafe();
+}
+
+
+/*
+ * Function:	Call::isSafe (accessor)
+ *
+ * Description:	Return false since the called function may do anything.
+ */
+
+bool Call::isSafe() const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Dereference::isSafe (accessor)
+ *
+ * Description:	Return false since the pointer may be invalid.
+ */
+
+bool Dereference::isSafe() const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Divide::isSafe (accessor)
+ *
+ * Description:	Return false since the divisor may be zero.
+ */
+
+bool Divide::isSafe() const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Remainder::isSafe (accessor)
+ *
+ * Description:	Return false since the divisor may be zero.
+ */
+
+bool Remainder::isSafe() const
+{
+    return false;
+}
+
+
 /*
  * Function:	Expression::isDereference (accessor)
  *
@@ -576,3 +763,493 @@ bool Dereference::isDereference(Expression *&pointer) const
     pointer = _expr;
     return true;
 }
+
+
+/*
+ * Function:	Expression::isAdd (accessor)
+ *
+ * Description:	Return false since most expressions are not additions.
+ */
+
+bool Expression::isAdd(Expression *&left, Expression *&right) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Add::isAdd (accessor)
+ *
+ * Description:	Return true since an addition is in fact an addition.
+ */
+
+bool Add::isAdd(Expression *&left, Expression *&right) const
+{
+    left = _left;
+    right = _right;
+    return true;
+}
+
+
+/*
+ * Function:	Expression::isMultiply (accessor)
+ *
+ * Description:	Return false since most expressions are not
+ *		multiplications.
+ */
+
+bool Expression::isMultiply(Expression *&left, Expression *&right) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Multiply::isMultiply (accessor)
+ *
+ * Description:	Return true since a multiplication is in fact a
+ *		multiplication.
+ */
+
+bool Multiply::isMultiply(Expression *&left, Expression *&right) const
+{
+    left = _left;
+    right = _right;
+    return true;
+}
+
+
+/*
+ * Function:	Expression::isLessThan (accessor)
+ *
+ * Description:	Return false since most expressions are not less-than
+ *		comparisons.
+ */
+
+bool Expression::isLessThan(Expression *&left, Expression *&right) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	LessThan::isLessThan (accessor)
+ *
+ * Description:	Return true since a less-than expression is in fact a
+ *		less-than comparison.
+ */
+
+bool LessThan::isLessThan(Expression *&left, Expression *&right) const
+{
+    left = _left;
+    right = _right;
+    return true;
+}
+
+
+/*
+ * Function:	Expression::isLessOrEqual (accessor)
+ *
+ * Description:	Return false since most expressions are not
+ *		less-than-or-equal comparisons.
+ */
+
+bool Expression::isLessOrEqual(Expression *&left, Expression *&right) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	LessOrEqual::isLessOrEqual (accessor)
+ *
+ * Description:	Return true since a less-than-or-equal expression is in
+ *		fact a less-than-or-equal comparison.
+ */
+
+bool LessOrEqual::isLessOrEqual(Expression *&left, Expression *&right) const
+{
+    left = _left;
+    right = _right;
+    return true;
+}
+
+
+/*
+ * Function:	Expression::isSubtract (accessor)
+ *
+ * Description:	Return false since most expressions are not subtractions.
+ */
+
+bool Expression::isSubtract(Expression *&left, Expression *&right) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Subtract::isSubtract (accessor)
+ *
+ * Description:	Return true since a subtraction is in fact a subtraction.
+ */
+
+bool Subtract::isSubtract(Expression *&left, Expression *&right) const
+{
+    left = _left;
+    right = _right;
+    return true;
+}
+
+
+/*
+ * Function:	Expression::isGreaterThan (accessor)
+ *
+ * Description:	Return false since most expressions are not greater-than
+ *		comparisons.
+ */
+
+bool Expression::isGreaterThan(Expression *&left, Expression *&right) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	GreaterThan::isGreaterThan (accessor)
+ *
+ * Description:	Return true since a greater-than expression is in fact a
+ *		greater-than comparison.
+ */
+
+bool GreaterThan::isGreaterThan(Expression *&left, Expression *&right) const
+{
+    left = _left;
+    right = _right;
+    return true;
+}
+
+
+/*
+ * Function:	Expression::isAddress (accessor)
+ *
+ * Description:	Return false since most expressions are not addresses.
+ */
+
+bool Expression::isAddress(Expression *&expr) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Address::isAddress (accessor)
+ *
+ * Description:	Return true since an address expression is in fact an
+ *		address.
+ */
+
+bool Address::isAddress(Expression *&expr) const
+{
+    expr = _expr;
+    return true;
+}
+
+
+/*
+ * Function:	Expression::isCast (accessor)
+ *
+ * Description:	Return false since most expressions are not casts.
+ */
+
+bool Expression::isCast(Expression *&expr) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Cast::isCast (accessor)
+ *
+ * Description:	Return true since a cast is in fact a cast.
+ */
+
+bool Cast::isCast(Expression *&expr) const
+{
+    expr = _expr;
+    return true;
+}
+
+
+/*
+ * Function:	Statement::isAssignment (accessor)
+ *
+ * Description:	Return false since most statements are not assignments.
+ */
+
+bool Statement::isAssignment(Expression *&left, Expression *&right) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Assignment::isAssignment (accessor)
+ *
+ * Description:	Return true since an assignment is in fact an assignment.
+ */
+
+bool Assignment::isAssignment(Expression *&left, Expression *&right) const
+{
+    left = _left;
+    right = _right;
+    return true;
+}
+
+
+/*
+ * Function:	Node::modifies (accessor)
+ *
+ * Description:	Return whether this node may change the value of a local
+ *		variable by taking its address or, if asked, by assigning
+ *		to it.  Most nodes do neither.
+ */
+
+bool Node::modifies(const Symbol *symbol, bool assigns) const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Unary::modifies (accessor)
+ *
+ * Description:	Return whether the operand may change a local variable.
+ */
+
+bool Unary::modifies(const Symbol *symbol, bool assigns) const
+{
+    return _expr->modifies(symbol, assigns);
+}
+
+
+/*
+ * Function:	Binary::modifies (accessor)
+ *
+ * Description:	Return whether either operand may change a local
+ *		variable.
+ */
+
+bool Binary::modifies(const Symbol *symbol, bool assigns) const
+{
+    return _left->modifies(symbol, assigns)
+	|| _right->modifies(symbol, assigns);
+}
+
+
+/*
+ * Function:	Call::modifies (accessor)
+ *
+ * Description:	Return whether any argument may change a local variable.
+ */
+
+bool Call::modifies(const Symbol *symbol, bool assigns) const
+{
+    for (auto arg : _args)
+	if (arg->modifies(symbol, assigns))
+	    return true;
+
+    return false;
+}
+
+
+/*
+ * Function:	Address::modifies (accessor)
+ *
+ * Description:	Return whether we take the address of a local variable,
+ *		after which it may be changed by anything.
+ */
+
+bool Address::modifies(const Symbol *symbol, bool assigns) const
+{
+    const Symbol *id;
+
+    if (_expr->isIdentifier(id) && id == symbol)
+	return true;
+
+    return _expr->modifies(symbol, assigns);
+}
+
+
+/*
+ * Function:	Assignment::modifies (accessor)
+ *
+ * Description:	Return whether this assignment may change a local
+ *		variable.
+ */
+
+bool Assignment::modifies(const Symbol *symbol, bool assigns) const
+{
+    const Symbol *id;
+
+    if (assigns && _left->isIdentifier(id) && id == symbol)
+	return true;
+
+    return _left->modifies(symbol, assigns)
+	|| _right->modifies(symbol, assigns);
+}
+
+
+/*
+ * Function:	Return::modifies (accessor)
+ *
+ * Description:	Return whether the returned expression may change a local
+ *		variable.
+ */
+
+bool Return::modifies(const Symbol *symbol, bool assigns) const
+{
+    return _expr->modifies(symbol, assigns);
+}
+
+
+/*
+ * Function:	Block::modifies (accessor)
+ *
+ * Description:	Return whether any statement may change a local variable.
+ */
+
+bool Block::modifies(const Symbol *symbol, bool assigns) const
+{
+    for (auto stmt : _stmts)
+	if (stmt->modifies(symbol, assigns))
+	    return true;
+
+    return false;
+}
+
+
+/*
+ * Function:	While::modifies (accessor)
+ *
+ * Description:	Return whether this loop may change a local variable.
+ */
+
+bool While::modifies(const Symbol *symbol, bool assigns) const
+{
+    return _expr->modifies(symbol, assigns)
+	|| _stmt->modifies(symbol, assigns);
+}
+
+
+/*
+ * Function:	For::modifies (accessor)
+ *
+ * Description:	Return whether this loop may change a local variable.
+ */
+
+bool For::modifies(const Symbol *symbol, bool assigns) const
+{
+    return _init->modifies(symbol, assigns)
+	|| _expr->modifies(symbol, assigns)
+	|| _incr->modifies(symbol, assigns)
+	|| _stmt->modifies(symbol, assigns);
+}
+
+
+/*
+ * Function:	If::modifies (accessor)
+ *
+ * Description:	Return whether this statement may change a local
+ *		variable.
+ */
+
+bool If::modifies(const Symbol *symbol, bool assigns) const
+{
+    if (_expr->modifies(symbol, assigns)
+	    || _thenStmt->modifies(symbol, assigns))
+	return true;
+
+    return _elseStmt != nullptr && _elseStmt->modifies(symbol, assigns);
+}
+
+
+/*
+ * Function:	Simple::modifies (accessor)
+ *
+ * Description:	Return whether the expression may change a local
+ *		variable.
+ */
+
+bool Simple::modifies(const Symbol *symbol, bool assigns) const
+{
+    return _expr->modifies(symbol, assigns);
+}
+
+
+/*
+ * Function:	Statement::hasLoop (accessor)
+ *
+ * Description:	Return whether this statement contains a loop.  Most
+ *		statements do not.
+ */
+
+bool Statement::hasLoop() const
+{
+    return false;
+}
+
+
+/*
+ * Function:	Block::hasLoop (accessor)
+ *
+ * Description:	Return whether any statement in this block contains a
+ *		loop.
+ */
+
+bool Block::hasLoop() const
+{
+    for (auto stmt : _stmts)
+	if (stmt->hasLoop())
+	    return true;
+
+    return false;
+}
+
+
+/*
+ * Function:	While::hasLoop (accessor)
+ *
+ * Description:	Return whether this statement contains a loop, which it
+ *		is.
+ */
+
+bool While::hasLoop() const
+{
+    return true;
+}
+
+
+/*
+ * Function:	For::hasLoop (accessor)
+ *
+ * Description:	Return whether this statement contains a loop, which it
+ *		is.
+ */
+
+bool For::hasLoop() const
+{
+    return true;
+}
+
+
+/*
+ * Function:	If::hasLoop (accessor)
+ *
+ * Description:	Return whether either branch contains a loop.
+ */
+
+bool If::hasLoop() const
+{
+    return _thenStmt->hasLoop()
+	|| (_elseStmt != nullptr && _elseStmt->hasLoop());
+}
@@ -21,6 +21,7 @@
  *		Tree.cpp - constructors and accessors
  *		allocator.cpp - member functions to do storage allocation
  *		generator.cpp - member functions to do code generation
+ *		lower.cpp - member functions to lower to three-address code
  *		writer.cpp - member functions to write the tree to a stream
  */
 
@@ -33,6 +34,10 @@
 # include "Register.h"
 # include "Label.h"
 
+class Operand;
+class Value;
+class Procedure;
+
 typedef std::vector<class Statement *> Statements;
 typedef std::vector<class Expression *> Expressions;
 
@@ -50,6 +55,7 @@ public:
     virtual void write(ostream &ostr) const = 0;
     virtual void allocate(int &offset) const {}
     virtual void generate() {}
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
 };
 
 
@@ -58,6 +64,11 @@ public:
 class Statement : public Node {
 protected:
     Statement() {}
+
+public:
+    virtual bool isAssignment(Expression *&left, Expression *&right) const;
+    virtual bool hasLoop() const;
+    virtual void lower() = 0;
 };
 
 
@@ -76,10 +87,23 @@ public:
     const Type &type() const;
     bool lvalue() const;
 
-    virtual void operand(ostream &ostr) const;
+    virtual Operand operand() const;
     virtual bool isDereference(Expression *&pointer) const;
+    virtual bool isAdd(Expression *&left, Expression *&right) const;
+    virtual bool isMultiply(Expression *&left, Expression *&right) const;
+    virtual bool isLessThan(Expression *&left, Expression *&right) const;
+    virtual bool isLessOrEqual(Expression *&left, Expression *&right) const;
+    virtual bool isSubtract(Expression *&left, Expression *&right) const;
+    virtual bool isGreaterThan(Expression *&left, Expression *&right) const;
+    virtual bool isAddress(Expression *&expr) const;
+    virtual bool isCast(Expression *&expr) const;
     virtual bool isNumber(unsigned long &value) const;
+    virtual bool isIdentifier(const Symbol *&symbol) const;
+    virtual bool isPure() const;
+    virtual bool isSafe() const;
     virtual void test(const Label &label, bool ifTrue);
+    virtual Value lower() = 0;
+    virtual void branch(unsigned ifTrue, unsigned ifFalse);
 };
 
 
@@ -89,6 +113,11 @@ class Binary : public Expression {
 protected:
     Expression *_left, *_right;
     Binary(Expression *left, Expression *right, const Type &type);
+
+public:
+    virtual bool isPure() const;
+    virtual bool isSafe() const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
 };
 
 
@@ -98,6 +127,11 @@ class Unary : public Expression {
 protected:
     Expression *_expr;
     Unary(Expression *expr, const Type &type);
+
+public:
+    virtual bool isPure() const;
+    virtual bool isSafe() const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
 };
 
 
@@ -110,7 +144,8 @@ public:
     String(const string &value);
     const string &value() const;
     virtual void write(ostream &ostr) const;
-    virtual void operand(ostream &ostr) const;
+    virtual Operand operand() const;
+    virtual Value lower();
 };
 
 
@@ -123,7 +158,9 @@ public:
     Identifier(const Symbol *symbol);
     const Symbol *symbol() const;
     virtual void write(ostream &ostr) const;
-    virtual void operand(ostream &ostr) const;
+    virtual Operand operand() const;
+    virtual bool isIdentifier(const Symbol *&symbol) const;
+    virtual Value lower();
 };
 
 
@@ -134,11 +171,13 @@ class Number : public Expression {
 
 public:
     Number(unsigned long value);
+    Number(unsigned long value, const Type &type);
     Number(const string &value);
     const string &value() const;
     virtual void write(ostream &ostr) const;
-    virtual void operand(ostream &ostr) const;
+    virtual Operand operand() const;
     virtual bool isNumber(unsigned long &value) const;
+    virtual Value lower();
 };
 
 
@@ -151,7 +190,11 @@ class Call : public Expression {
 public:
     Call(const Symbol *id, const Expressions &args, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isPure() const;
+    virtual bool isSafe() const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
     virtual void generate();
+    virtual Value lower();
 };
 
 
@@ -162,6 +205,9 @@ public:
     Not(Expression *expr, const Type &type);
     virtual void write(ostream &ostr) const;
     virtual void generate();
+    virtual void test(const Label &label, bool ifTrue);
+    virtual Value lower();
+    virtual void branch(unsigned ifTrue, unsigned ifFalse);
 };
 
 
@@ -172,6 +218,7 @@ public:
     Negate(Expression *expr, const Type &type);
     virtual void write(ostream &ostr) const;
     virtual void generate();
+    virtual Value lower();
 };
 
 
@@ -182,7 +229,9 @@ public:
     Dereference(Expression *expr, const Type &type);
     virtual void write(ostream &ostr) const;
     virtual bool isDereference(Expression *&pointer) const;
+    virtual bool isSafe() const;
     virtual void generate();
+    virtual Value lower();
 };
 
 
@@ -192,7 +241,10 @@ class Address : public Unary {
 public:
     Address(Expression *expr, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isAddress(Expression *&expr) const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
     virtual void generate();
+    virtual Value lower();
 };
 
 
@@ -202,7 +254,9 @@ class Cast : public Unary {
 public:
     Cast(Expression *expr, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isCast(Expression *&expr) const;
     virtual void generate();
+    virtual Value lower();
 };
 
 
@@ -212,7 +266,9 @@ class Multiply : public Binary {
 public:
     Multiply(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isMultiply(Expression *&left, Expression *&right) const;
     virtual void generate();
+    virtual Value lower();
 };
 
 
@@ -222,7 +278,9 @@ class Divide : public Binary {
 public:
     Divide(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isSafe() const;
     virtual void generate();
+    virtual Value lower();
 };
 
 
@@ -232,7 +290,9 @@ class Remainder : public Binary {
 public:
     Remainder(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isSafe() const;
     virtual void generate();
+    virtual Value lower();
 };
 
 
@@ -242,7 +302,9 @@ class Add : public Binary {
 public:
     Add(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isAdd(Expression *&left, Expression *&right) const;
     virtual void generate();
+    virtual Value lower();
 };
 
 
@@ -252,7 +314,9 @@ class Subtract : public Binary {
 public:
     Subtract(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isSubtract(Expression *&left, Expression *&right) const;
     virtual void generate();
+    virtual Value lower();
 };
 
 
@@ -262,7 +326,11 @@ class LessThan : public Binary {
 public:
     LessThan(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isLessThan(Expression *&left, Expression *&right) const;
     virtual void generate();
+    virtual void test(const Label &label, bool ifTrue);
+    virtual Value lower();
+    virtual void branch(unsigned ifTrue, unsigned ifFalse);
 };
 
 
@@ -272,7 +340,11 @@ class GreaterThan : public Binary {
 public:
     GreaterThan(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isGreaterThan(Expression *&left, Expression *&right) const;
     virtual void generate();
+    virtual void test(const Label &label, bool ifTrue);
+    virtual Value lower();
+    virtual void branch(unsigned ifTrue, unsigned ifFalse);
 };
 
 
@@ -282,7 +354,11 @@ class LessOrEqual : public Binary {
 public:
     LessOrEqual(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
+    virtual bool isLessOrEqual(Expression *&left, Expression *&right) const;
     virtual void generate();
+    virtual void test(const Label &label, bool ifTrue);
+    virtual Value lower();
+    virtual void branch(unsigned ifTrue, unsigned ifFalse);
 };
 
 
@@ -293,6 +369,9 @@ public:
     GreaterOrEqual(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
     virtual void generate();
+    virtual void test(const Label &label, bool ifTrue);
+    virtual Value lower();
+    virtual void branch(unsigned ifTrue, unsigned ifFalse);
 };
 
 
@@ -303,6 +382,9 @@ public:
     Equal(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
     virtual void generate();
+    virtual void test(const Label &label, bool ifTrue);
+    virtual Value lower();
+    virtual void branch(unsigned ifTrue, unsigned ifFalse);
 };
 
 
@@ -313,6 +395,9 @@ public:
     NotEqual(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
     virtual void generate();
+    virtual void test(const Label &label, bool ifTrue);
+    virtual Value lower();
+    virtual void branch(unsigned ifTrue, unsigned ifFalse);
 };
 
 
@@ -323,6 +408,9 @@ public:
     LogicalAnd(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
     virtual void generate();
+    virtual void test(const Label &label, bool ifTrue);
+    virtual Value lower();
+    virtual void branch(unsigned ifTrue, unsigned ifFalse);
 };
 
 
@@ -333,6 +421,9 @@ public:
     LogicalOr(Expression *left, Expression *right, const Type &type);
     virtual void write(ostream &ostr) const;
     virtual void generate();
+    virtual void test(const Label &label, bool ifTrue);
+    virtual Value lower();
+    virtual void branch(unsigned ifTrue, unsigned ifFalse);
 };
 
 
@@ -344,7 +435,10 @@ class Assignment : public Statement {
 public:
     Assignment(Expression *left, Expression *right);
     virtual void write(ostream &ostr) const;
+    virtual bool isAssignment(Expression *&left, Expression *&right) const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
     virtual void generate();
+    virtual void lower();
 };
 
 
@@ -356,7 +450,9 @@ class Return : public Statement {
 public:
     Return(Expression *expr);
     virtual void write(ostream &ostr) const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
     virtual void generate();
+    virtual void lower();
 };
 
 
@@ -371,7 +467,10 @@ public:
     Scope *declarations() const;
     virtual void write(ostream &ostr) const;
     virtual void allocate(int &offset) const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
+    virtual bool hasLoop() const;
     virtual void generate();
+    virtual void lower();
 };
 
 
@@ -380,12 +479,16 @@ public:
 class While : public Statement {
     Expression *_expr;
     Statement *_stmt;
+    unsigned _counter;
 
 public:
     While(Expression *expr, Statement *stmt);
     virtual void write(ostream &ostr) const;
     virtual void allocate(int &offset) const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
+    virtual bool hasLoop() const;
     virtual void generate();
+    virtual void lower();
 };
 
 
@@ -396,12 +499,16 @@ class For : public Statement {
     Expression *_expr;
     Statement *_incr;
     Statement *_stmt;
+    unsigned _counter;
 
 public:
     For(Statement *init, Expression *expr, Statement *incr, Statement *stmt);
     virtual void write(ostream &ostr) const;
     virtual void allocate(int &offset) const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
+    virtual bool hasLoop() const;
     virtual void generate();
+    virtual void lower();
 };
 
 
@@ -410,12 +517,16 @@ public:
 class If : public Statement {
     Expression *_expr;
     Statement *_thenStmt, *_elseStmt;
+    unsigned _counter;
 
 public:
     If(Expression *expr, Statement *thenStmt, Statement *elseStmt);
     virtual void write(ostream &ostr) const;
     virtual void allocate(int &offset) const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
+    virtual bool hasLoop() const;
     virtual void generate();
+    virtual void lower();
 };
 
 
@@ -427,7 +538,9 @@ class Simple : public Statement {
 public:
     Simple(Expression *expr);
     virtual void write(ostream &ostr) const;
+    virtual bool modifies(const Symbol *symbol, bool assigns) const;
     virtual void generate();
+    virtual void lower();
 };
 
 
@@ -436,12 +549,14 @@ public:
 class Function : public Node {
     const Symbol *_id;
     Block *_body;
+    unsigned _counter;
 
 public:
     Function(const Symbol *id, Block *body);
     virtual void write(ostream &ostr) const;
     virtual void allocate(int &offset) const;
     virtual void generate();
+    Procedure *lower();
 };
 
 # endif /* TREE_H */
@@ -65,6 +65,7 @@ public:
     Type deref() const;
 
     unsigned long size() const;
+    unsigned long alignment() const;
 };
 
 std::ostream &operator <<(std::ostream &ostr, const Type &type);
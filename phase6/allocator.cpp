@@ -8,10 +8,13 @@
  *		Extra functionality:
  *		- maintaining minimum offset in nested blocks
  *		- allocation within statements
+ *		- natural alignment of variables, which are placed in order
+ *		  of decreasing alignment to keep the padding small
  */
 
 # include <cassert>
 # include <iostream>
+# include <algorithm>
 # include "checker.h"
 # include "machine.h"
 # include "tokens.h"
@@ -50,6 +53,67 @@ unsigned long Type::size() const
 }
 
 
+/*
+ * Function:	Type::alignment
+ *
+ * Description:	Return the natural alignment of a type in bytes, which is
+ *		the size of a single element.
+ */
+
+unsigned long Type::alignment() const
+{
+    if (_indirection > 0)
+	return SIZEOF_PTR;
+
+    if (_specifier == CHAR)
+	return SIZEOF_CHAR;
+
+    if (_specifier == INT)
+	return SIZEOF_INT;
+
+    if (_specifier == LONG)
+	return SIZEOF_LONG;
+
+    return 1;
+}
+
+
+/*
+ * Function:	arrange (private)
+ *
+ * Description:	Return the given symbols in order of decreasing alignment,
+ *		so that placing them one after another needs little or no
+ *		padding.  Symbols with the same alignment keep their order.
+ */
+
+static Symbols arrange(const Symbols &symbols)
+{
+    Symbols sorted(symbols);
+
+    stable_sort(sorted.begin(), sorted.end(),
+	[](const Symbol *a, const Symbol *b) {
+	    return a->type().alignment() > b->type().alignment();
+	});
+
+    return sorted;
+}
+
+
+/*
+ * Function:	place (private)
+ *
+ * Description:	Return the offset of a variable of the given type placed
+ *		below the given offset at its natural alignment.
+ */
+
+static int place(const Type &type, int offset)
+{
+    int size = type.size(), align = type.alignment();
+
+    return (offset - size) & ~(align - 1);
+}
+
+
 /*
  * Function:	Block::allocate
  *
@@ -58,18 +122,19 @@ unsigned long Type::size() const
  *		then for all symbols declared within any nested block.
  *		Only symbols that have not already been allocated an offset
  *		will be assigned one, since the parameters are already
- *		assigned special offsets.
+ *		assigned special offsets.  Each symbol is naturally
+ *		aligned, and the most strictly aligned ones come first.
  */
 
 void Block::allocate(int &offset) const
 {
     int temp, saved;
-    const Symbols &symbols = _decls->symbols();
+    const Symbols symbols = arrange(_decls->symbols());
 
 
     for (auto symbol : symbols)
 	if (symbol->_offset == 0) {
-	    offset -= symbol->type().size();
+	    offset = place(symbol->type(), offset);
 	    symbol->_offset = offset;
 	}
 
@@ -157,12 +222,16 @@ void If::allocate(int &offset) const
  *		size of two registers (the instruction pointer and the base
  *		pointer), but would be larger if additional callee-saved
  *		registers were used.
+ *
+ *		The parameters passed in registers are saved below the
+ *		base pointer, where they are placed just like locals.
  */
 
 void Function::allocate(int &offset) const
 {
     Parameters *params = _id->type().parameters();
     const Symbols &symbols = _body->declarations()->symbols();
+    Symbols saved;
 
     for (unsigned i = NUM_PARAM_REGS; i < params->size(); i ++) {
 	symbols[i]->_offset = offset;
@@ -172,11 +241,15 @@ void Function::allocate(int &offset) const
     offset = 0;
 
     for (unsigned i = 0; i < NUM_PARAM_REGS; i ++)
-	if (i < params->size()) {
-	    offset -= (*params)[i].promote().size();
-	    symbols[i]->_offset = offset;
-	} else
+	if (i < params->size())
+	    saved.push_back(symbols[i]);
+	else
 	    break;
 
+    for (auto symbol : arrange(saved)) {
+	offset = place(symbol->type().promote(), offset);
+	symbol->_offset = offset;
+    }
+
     _body->allocate(offset);
 }
@@ -11,6 +11,7 @@
  *		- inserting an undeclared symbol with the error type
  *		- scaling the operands and results of pointer arithmetic
  *		- explicit type conversions and promotions
+ *		- folding constant expressions and simple identities
  */
 
 # include <iostream>
@@ -82,7 +83,8 @@ static Type promote(Expression *&expr)
  *
  * Description:	Cast the given expression to the given type by inserting a
  *		cast operation.  As an optimization, an integer can always
- *		be converted to a long integer without an explicit cast.
+ *		be converted to a long integer without an explicit cast,
+ *		and a long integer constant can simply be truncated.
  */
 
 static Expression *cast(Expression *expr, const Type &type)
@@ -90,12 +92,18 @@ static Expression *cast(Expression *expr, const Type &type)
     unsigned long value;
 
 
-    if (expr->isNumber(value))
+    if (expr->isNumber(value)) {
 	if (expr->type() == integer && type == longint) {
 	    delete expr;
 	    return new Number(value);
 	}
 
+	if (expr->type() == longint && type == integer) {
+	    delete expr;
+	    return new Number((int) value, integer);
+	}
+    }
+
     return new Cast(expr, type);
 }
 
@@ -163,10 +171,73 @@ static Expression *scale(Expression *expr, unsigned size)
     }
 
     extend(expr, longint);
+
+    if (size == 1)
+	return expr;
+
     return new Multiply(expr, new Number(size), longint);
 }
 
 
+/*
+ * Function:	fold
+ *
+ * Description:	Replace an expression whose value is known with a number
+ *		of the given type.  The value is truncated to the width of
+ *		the type, just as the machine would compute it.  Any
+ *		operands that were only needed for their values are
+ *		discarded.
+ */
+
+static Expression *
+fold(unsigned long value, const Type &type, Expression *left,
+	Expression *right = nullptr)
+{
+    delete left;
+    delete right;
+
+    if (type == integer)
+	value = (int) value;
+
+    return new Number(value, type);
+}
+
+
+/*
+ * Function:	simplify
+ *
+ * Description:	Replace an expression with one of its operands, discarding
+ *		the other, for an identity such as x + 0.  The result must
+ *		not be an lvalue, so one is wrapped in a cast to its own
+ *		type.
+ */
+
+static Expression *simplify(Expression *expr, Expression *other)
+{
+    delete other;
+
+    if (expr->lvalue())
+	return new Cast(expr, expr->type());
+
+    return expr;
+}
+
+
+/*
+ * Function:	isConstant
+ *
+ * Description:	Return whether an expression is a number with the given
+ *		value.
+ */
+
+static bool isConstant(Expression *expr, long value)
+{
+    unsigned long n;
+
+    return expr->isNumber(n) && (long) n == value;
+}
+
+
 /*
  * Function:	openScope
  *
@@ -398,6 +469,7 @@ Expression *checkNot(Expression *expr)
 {
     const Type &t = promote(expr);
     Type result = error;
+    unsigned long value;
 
 
     if (t != error) {
@@ -407,6 +479,9 @@ Expression *checkNot(Expression *expr)
 	    report(invalid_operand, "!");
     }
 
+    if (result != error && expr->isNumber(value))
+	return fold(!value, result, expr);
+
     return new Not(expr, result);
 }
 
@@ -423,6 +498,7 @@ Expression *checkNegate(Expression *expr)
 {
     const Type &t = promote(expr);
     Type result = error;
+    unsigned long value;
 
 
     if (t != error) {
@@ -432,6 +508,9 @@ Expression *checkNegate(Expression *expr)
 	    report(invalid_operand, "-");
     }
 
+    if (result != error && expr->isNumber(value))
+	return fold(-value, result, expr);
+
     return new Negate(expr, result);
 }
 
@@ -537,12 +616,32 @@ checkMultiplicative(Expression *&left, Expression *&right, const string &op)
 /*
  * Function:	checkMultiply
  *
- * Description:	Check a multiplication expression: left * right.
+ * Description:	Check a multiplication expression: left * right.  An
+ *		operand of zero only makes the product zero if the other
+ *		operand has no side effects to preserve.
  */
 
 Expression *checkMultiply(Expression *left, Expression *right)
 {
     Type t = checkMultiplicative(left, right, "*");
+    unsigned long x, y;
+
+
+    if (t != error) {
+	if (left->isNumber(x) && right->isNumber(y))
+	    return fold(x * y, t, left, right);
+
+	if (isConstant(right, 1))
+	    return simplify(left, right);
+
+	if (isConstant(left, 1))
+	    return simplify(right, left);
+
+	if ((isConstant(right, 0) || isConstant(left, 0))
+		&& left->isPure() && right->isPure())
+	    return fold(0, t, left, right);
+    }
+
     return new Multiply(left, right, t);
 }
 
@@ -556,6 +655,21 @@ Expression *checkMultiply(Expression *left, Expression *right)
 Expression *checkDivide(Expression *left, Expression *right)
 {
     Type t = checkMultiplicative(left, right, "/");
+    unsigned long x, y;
+
+
+    if (t != error) {
+	if (left->isNumber(x) && right->isNumber(y) && y != 0) {
+	    if ((long) y == -1)
+		return fold(-x, t, left, right);
+
+	    return fold((long) x / (long) y, t, left, right);
+	}
+
+	if (isConstant(right, 1))
+	    return simplify(left, right);
+    }
+
     return new Divide(left, right, t);
 }
 
@@ -568,6 +682,21 @@ Expression *checkDivide(Expression *left, Expression *right)
 Expression *checkRemainder(Expression *left, Expression *right)
 {
     Type t = checkMultiplicative(left, right, "%");
+    unsigned long x, y;
+
+
+    if (t != error) {
+	if (left->isNumber(x) && right->isNumber(y) && y != 0) {
+	    if ((long) y == -1)
+		return fold(0, t, left, right);
+
+	    return fold((long) x % (long) y, t, left, right);
+	}
+
+	if ((isConstant(right, 1) || isConstant(right, -1)) && left->isPure())
+	    return fold(0, t, left, right);
+    }
+
     return new Remainder(left, right, t);
 }
 
@@ -587,6 +716,7 @@ Expression *checkAdd(Expression *left, Expression *right)
     Type t1 = left->type();
     Type t2 = right->type();
     Type result = error;
+    unsigned long x, y;
 
 
     if (t1 != error && t2 != error) {
@@ -609,6 +739,17 @@ Expression *checkAdd(Expression *left, Expression *right)
 	    report(invalid_operands, "+");
     }
 
+    if (result != error) {
+	if (left->isNumber(x) && right->isNumber(y))
+	    return fold(x + y, result, left, right);
+
+	if (isConstant(right, 0))
+	    return simplify(left, right);
+
+	if (isConstant(left, 0))
+	    return simplify(right, left);
+    }
+
     return new Add(left, right, result);
 }
 
@@ -631,6 +772,7 @@ Expression *checkSubtract(Expression *left, Expression *right)
     Type t2 = right->type();
     Type result = error;
     Expression *expr;
+    unsigned long x, y;
 
 
     if (t1 != error && t2 != error) {
@@ -657,6 +799,14 @@ Expression *checkSubtract(Expression *left, Expression *right)
 	}
     }
 
+    if (result != error && !(t1.isPointer() && t1 == t2)) {
+	if (left->isNumber(x) && right->isNumber(y))
+	    return fold(x - y, result, left, right);
+
+	if (isConstant(right, 0))
+	    return simplify(left, right);
+    }
+
     expr = new Subtract(left, right, result);
 
     if (t1.isPointer() && t1 == t2)
@@ -704,6 +854,12 @@ checkRelational(Expression *&left, Expression *&right, const string &op)
 Expression *checkLessThan(Expression *left, Expression *right)
 {
     Type t = checkRelational(left, right, "<");
+    unsigned long x, y;
+
+
+    if (t != error && left->isNumber(x) && right->isNumber(y))
+	return fold((long) x < (long) y, t, left, right);
+
     return new LessThan(left, right, t);
 }
 
@@ -717,6 +873,12 @@ Expression *checkLessThan(Expression *left, Expression *right)
 Expression *checkGreaterThan(Expression *left, Expression *right)
 {
     Type t = checkRelational(left, right, ">");
+    unsigned long x, y;
+
+
+    if (t != error && left->isNumber(x) && right->isNumber(y))
+	return fold((long) x > (long) y, t, left, right);
+
     return new GreaterThan(left, right, t);
 }
 
@@ -730,6 +892,12 @@ Expression *checkGreaterThan(Expression *left, Expression *right)
 Expression *checkLessOrEqual(Expression *left, Expression *right)
 {
     Type t = checkRelational(left, right, "<=");
+    unsigned long x, y;
+
+
+    if (t != error && left->isNumber(x) && right->isNumber(y))
+	return fold((long) x <= (long) y, t, left, right);
+
     return new LessOrEqual(left, right, t);
 }
 
@@ -743,6 +911,12 @@ Expression *checkLessOrEqual(Expression *left, Expression *right)
 Expression *checkGreaterOrEqual(Expression *left, Expression *right)
 {
     Type t = checkRelational(left, right, ">=");
+    unsigned long x, y;
+
+
+    if (t != error && left->isNumber(x) && right->isNumber(y))
+	return fold((long) x >= (long) y, t, left, right);
+
     return new GreaterOrEqual(left, right, t);
 }
 
@@ -782,6 +956,12 @@ checkEquality(Expression *&left, Expression *&right, const string &op)
 Expression *checkEqual(Expression *left, Expression *right)
 {
     Type t = checkEquality(left, right, "==");
+    unsigned long x, y;
+
+
+    if (t != error && left->isNumber(x) && right->isNumber(y))
+	return fold((long) x == (long) y, t, left, right);
+
     return new Equal(left, right, t);
 }
 
@@ -795,6 +975,12 @@ Expression *checkEqual(Expression *left, Expression *right)
 Expression *checkNotEqual(Expression *left, Expression *right)
 {
     Type t = checkEquality(left, right, "!=");
+    unsigned long x, y;
+
+
+    if (t != error && left->isNumber(x) && right->isNumber(y))
+	return fold((long) x != (long) y, t, left, right);
+
     return new NotEqual(left, right, t);
 }
 
@@ -829,12 +1015,25 @@ checkLogical(Expression *&left, Expression *&right, const string &op)
 /*
  * Function:	checkLogicalAnd
  *
- * Description:	Check a logical-and expression: left && right.
+ * Description:	Check a logical-and expression: left && right.  If the
+ *		left operand is a constant, then the right operand is
+ *		either never evaluated or determines the result.
  */
 
 Expression *checkLogicalAnd(Expression *left, Expression *right)
 {
     Type t = checkLogical(left, right, "&&");
+    unsigned long x, y;
+
+
+    if (t != error && left->isNumber(x)) {
+	if (x == 0)
+	    return fold(0, t, left, right);
+
+	if (right->isNumber(y))
+	    return fold(y != 0, t, left, right);
+    }
+
     return new LogicalAnd(left, right, t);
 }
 
@@ -842,12 +1041,25 @@ Expression *checkLogicalAnd(Expression *left, Expression *right)
 /*
  * Function:	checkLogicalOr
  *
- * Description:	Check a logical-or expression: left || right.
+ * Description:	Check a logical-or expression: left || right.  If the
+ *		left operand is a constant, then the right operand is
+ *		either never evaluated or determines the result.
  */
 
 Expression *checkLogicalOr(Expression *left, Expression *right)
 {
     Type t = checkLogical(left, right, "||");
+    unsigned long x, y;
+
+
+    if (t != error && left->isNumber(x)) {
+	if (x != 0)
+	    return fold(1, t, left, right);
+
+	if (right->isNumber(y))
+	    return fold(y != 0, t, left, right);
+    }
+
     return new LogicalOr(left, right, t);
 }
 
@@ -0,0 +1,459 @@
+/*
+ * File:	forward.cpp
+ *
+ * Description:	This file contains the public and private function
+ *		definitions for the forwarding of values within basic
+ *		blocks for Simple C.
+ *
+ *		The code generator produces each statement in isolation,
+ *		so a variable kept in memory is loaded again by every
+ *		statement that uses it, even if its value is still sitting
+ *		in a register.  Walking down each block, we remember which
+ *		virtual registers hold the values of which memory
+ *		locations, having been loaded from or stored to them, and a
+ *		load of a location whose value is known becomes a copy.  A
+ *		copy between virtual registers is then propagated to the
+ *		instructions that read its destination, which often leaves
+ *		the copy dead, and dead copies are removed at the end.
+ *
+ *		A memory location is direct if it is a global variable or a
+ *		slot in the frame, and indirect otherwise.  A store to a
+ *		direct location only changes the direct locations that
+ *		overlap it, but may change any indirect one.  A store
+ *		through a pointer or a call may change anything.  Since
+ *		control may arrive from elsewhere, everything is forgotten
+ *		at a label.
+ *
+ *		Long blocks remember many values, so the known values are
+ *		kept in a hash table keyed by location.  The direct
+ *		locations are also grouped by symbol, since frame slots
+ *		have no symbol and globals have no base, and each group is
+ *		ordered by displacement, so a store only examines the
+ *		locations that could overlap it.  Likewise, each register
+ *		lists the locations and copies that depend on it.  These
+ *		indices are not updated when an entry is forgotten for some
+ *		other reason, and so each entry found through them is
+ *		checked again before being forgotten.
+ */
+
+# include <map>
+# include <unordered_map>
+# include "forward.h"
+# include "machine.h"
+
+using namespace std;
+
+struct Hash {
+    size_t operator ()(const Operand &op) const;
+};
+
+typedef multimap<long, Operand> Locations;
+
+static unordered_map<Operand, Operand, Hash> values;
+static map<string, Locations> classes;
+static Locations indirect;
+static map<Register *, vector<Operand>> users;
+static map<Register *, Operand> copies;
+static map<Register *, vector<Register *>> sources;
+
+
+/*
+ * Function:	Hash::operator ()
+ *
+ * Description:	Return a hash value for a memory operand.
+ */
+
+size_t Hash::operator ()(const Operand &op) const
+{
+    size_t h;
+
+
+    h = hash<string>()(op._symbol);
+    h = h * 31 + hash<Register *>()(op._base);
+    h = h * 31 + hash<Register *>()(op._index);
+    h = h * 31 + hash<long>()(op._value);
+    return h * 31 + op._size * 8 + op._scale;
+}
+
+
+/*
+ * Function:	direct (private)
+ *
+ * Description:	Return whether a memory operand is a global variable or a
+ *		slot in the frame, rather than something reached through a
+ *		pointer.  Before allocation, the frame is only addressed
+ *		using the frame pointer.
+ */
+
+static bool direct(const Operand &op)
+{
+    if (op._index != nullptr)
+	return false;
+
+    return op._base == nullptr || op._base == rbp;
+}
+
+
+/*
+ * Function:	overlaps (private)
+ *
+ * Description:	Return whether a store to one memory operand may change
+ *		the value of another.
+ */
+
+static bool overlaps(const Operand &a, const Operand &b)
+{
+    if (!direct(a) || !direct(b))
+	return true;
+
+    if (a._symbol != b._symbol)
+	return false;
+
+    if (a._base != b._base)
+	return true;
+
+    return a._value < b._value + (long) b._size
+	&& b._value < a._value + (long) a._size;
+}
+
+
+/*
+ * Function:	mentions (private)
+ *
+ * Description:	Return whether an operand refers to the given register.
+ */
+
+static bool mentions(const Operand &op, Register *reg)
+{
+    if (op.isReg() || op.isMem())
+	return op._base == reg || op._index == reg;
+
+    return false;
+}
+
+
+/*
+ * Function:	forget (private)
+ *
+ * Description:	Forget the values of all memory locations.  Clearing a
+ *		hash table takes time proportional to its number of
+ *		buckets, so we avoid it when the table is already empty.
+ */
+
+static void forget()
+{
+    if (!values.empty())
+	values.clear();
+
+    classes.clear();
+    indirect.clear();
+    users.clear();
+}
+
+
+/*
+ * Function:	discard (private)
+ *
+ * Description:	Forget the values of the locations in the given range of
+ *		a group that a store to the given memory operand may change.
+ */
+
+static void discard(Locations &group, Locations::iterator it,
+	Locations::iterator last, const Operand &op)
+{
+    while (it != last)
+	if (overlaps(it->second, op)) {
+	    values.erase(it->second);
+	    group.erase(it ++);
+	} else
+	    ++ it;
+}
+
+
+/*
+ * Function:	store (private)
+ *
+ * Description:	Forget the values of the locations that a store to the
+ *		given memory operand may change.  A direct location can
+ *		only overlap another direct location whose displacement is
+ *		less than the width of a vector below its own.
+ */
+
+static void store(const Operand &op)
+{
+    map<string, Locations>::iterator it;
+
+
+    if (!direct(op)) {
+	forget();
+	return;
+    }
+
+    discard(indirect, indirect.begin(), indirect.end(), op);
+    it = classes.find(op._symbol);
+
+    if (it != classes.end()) {
+	Locations &group = it->second;
+
+	discard(group, group.upper_bound(op._value - SIZEOF_VECTOR),
+		group.lower_bound(op._value + (long) op._size), op);
+    }
+}
+
+
+/*
+ * Function:	define (private)
+ *
+ * Description:	Forget everything that depends on the old value of a
+ *		register that has just been written.
+ */
+
+static void define(Register *reg)
+{
+    unordered_map<Operand, Operand, Hash>::iterator vt;
+    map<Register *, vector<Operand>>::iterator ut;
+    map<Register *, vector<Register *>>::iterator st;
+    map<Register *, Operand>::iterator ct;
+
+
+    ut = users.find(reg);
+
+    if (ut != users.end()) {
+	for (auto &loc : ut->second) {
+	    vt = values.find(loc);
+
+	    if (vt != values.end() && (mentions(vt->first, reg)
+		    || mentions(vt->second, reg)))
+		values.erase(vt);
+	}
+
+	users.erase(ut);
+    }
+
+    copies.erase(reg);
+    st = sources.find(reg);
+
+    if (st != sources.end()) {
+	for (auto dst : st->second) {
+	    ct = copies.find(dst);
+
+	    if (ct != copies.end() && ct->second._base == reg)
+		copies.erase(ct);
+	}
+
+	sources.erase(st);
+    }
+}
+
+
+/*
+ * Function:	propagate (private)
+ *
+ * Description:	Replace each register read by an instruction with the
+ *		register that it is a copy of.  A register is only replaced
+ *		if the copy covers all of the bytes being read, and a
+ *		register that is also written is left alone.
+ */
+
+static void propagate(Instruction &inst)
+{
+    map<Register *, Operand>::iterator it;
+
+
+    for (unsigned i = 0; i < inst._operands.size(); i ++) {
+	Operand &op = inst._operands[i];
+
+	if (op.isReg() && inst.reads(i) && !inst.writes(i)) {
+	    it = copies.find(op._base);
+
+	    if (it != copies.end() && op._size <= it->second._size)
+		op._base = it->second._base;
+
+	} else if (op.isMem()) {
+	    it = copies.find(op._base);
+
+	    if (it != copies.end() && it->second._size == SIZEOF_REG)
+		op._base = it->second._base;
+
+	    it = copies.find(op._index);
+
+	    if (it != copies.end() && it->second._size == SIZEOF_REG)
+		op._index = it->second._base;
+	}
+    }
+}
+
+
+/*
+ * Function:	record (private)
+ *
+ * Description:	Record that the given operand holds the value of a memory
+ *		location, and index the location by its group and by the
+ *		registers on which the entry depends.
+ */
+
+static void record(const Operand &loc, const Operand &holder)
+{
+    values[loc] = holder;
+
+    if (direct(loc))
+	classes[loc._symbol].insert(make_pair(loc._value, loc));
+    else
+	indirect.insert(make_pair(loc._value, loc));
+
+    if (loc._base != nullptr)
+	users[loc._base].push_back(loc);
+
+    if (loc._index != nullptr)
+	users[loc._index].push_back(loc);
+
+    if (holder.isReg())
+	users[holder._base].push_back(loc);
+}
+
+
+/*
+ * Function:	remember (private)
+ *
+ * Description:	Record what a move tells us: after a load or a store, the
+ *		register and the memory location hold the same value, and
+ *		after a copy, the two registers do.  Only virtual registers
+ *		are remembered, since machine registers are needed for
+ *		other purposes.
+ */
+
+static void remember(const Instruction &inst)
+{
+    const Operand &src = inst._operands[0], &dst = inst._operands[1];
+
+
+    if (dst.isMem()) {
+	if ((src.isReg() && src._base->isVirtual()) || src.isSmall())
+	    record(dst, src);
+
+    } else if (dst.isReg() && dst._base->isVirtual()) {
+	if (src.isMem() && !mentions(src, dst._base))
+	    record(src, dst);
+	else if (src.isReg() && src._base->isVirtual()
+		&& src._base != dst._base) {
+	    copies[dst._base] = src;
+	    sources[src._base].push_back(dst._base);
+	}
+    }
+}
+
+
+/*
+ * Function:	lookup (private)
+ *
+ * Description:	Return the operand holding the value of a memory location,
+ *		or the location itself if its value is not known.
+ */
+
+static Operand lookup(const Operand &op)
+{
+    unordered_map<Operand, Operand, Hash>::iterator it;
+
+
+    it = values.find(op);
+    return it != values.end() ? it->second : op;
+}
+
+
+/*
+ * Function:	prune (private)
+ *
+ * Description:	Remove the moves to virtual registers that are never read.
+ *		Removing one may leave the moves that compute its source
+ *		dead, and these usually come earlier, so a single backward
+ *		pass removes them as well.
+ */
+
+static void prune(Instructions &code)
+{
+    vector<Register *> uses, defs;
+    map<Register *, unsigned> reads;
+    vector<bool> dead(code.size());
+    unsigned i, j;
+
+
+    for (auto &inst : code) {
+	inst.registers(uses, defs);
+
+	for (auto reg : uses)
+	    reads[reg] ++;
+    }
+
+    for (i = code.size(); i -- > 0; ) {
+	const Instruction &inst = code[i];
+
+	if (inst._opcode == MOV && inst._operands[1].isReg()
+		&& inst._operands[1]._base->isVirtual()
+		&& reads[inst._operands[1]._base] == 0) {
+	    inst.registers(uses, defs);
+	    dead[i] = true;
+
+	    for (auto reg : uses)
+		reads[reg] --;
+	}
+    }
+
+    for (i = j = 0; i < code.size(); i ++)
+	if (!dead[i]) {
+	    if (i != j)
+		code[j] = move(code[i]);
+
+	    j ++;
+	}
+
+    code.erase(code.begin() + j, code.end());
+}
+
+
+/*
+ * Function:	forward
+ *
+ * Description:	Forward the values of memory locations and the sources of
+ *		copies within each block of the given instructions.
+ */
+
+void forward(Instructions &code)
+{
+    vector<Register *> uses, defs;
+
+
+    forget();
+    copies.clear();
+    sources.clear();
+
+    for (auto &inst : code) {
+	if (inst._opcode == LABEL) {
+	    forget();
+	    copies.clear();
+	    sources.clear();
+	    continue;
+	}
+
+	propagate(inst);
+
+	if (inst._opcode == MOV && inst._operands[0].isMem())
+	    inst._operands[0] = lookup(inst._operands[0]);
+
+	for (unsigned i = 0; i < inst._operands.size(); i ++)
+	    if (inst._operands[i].isMem() && inst.writes(i))
+		store(inst._operands[i]);
+
+	if (inst._opcode == CALL || inst._opcode == PUSH)
+	    forget();
+
+	inst.registers(uses, defs);
+
+	for (auto reg : defs)
+	    define(reg);
+
+	if (inst._opcode == MOV)
+	    remember(inst);
+    }
+
+    prune(code);
+}
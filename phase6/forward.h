@@ -0,0 +1,14 @@
+/*
+ * File:	forward.h
+ *
+ * Description:	This file contains the function declarations for the
+ *		forwarding of values within basic blocks for Simple C.
+ */
+
+# ifndef FORWARD_H
+# define FORWARD_H
+# include "Instruction.h"
+
+void forward(Instructions &code);
+
+# endif /* FORWARD_H */
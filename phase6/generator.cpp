@@ -4,124 +4,509 @@
  * Description:	This file contains the public and member function
  *		definitions for the code generator for Simple C.
  *
+ *		Code is generated one function at a time into a list of
+ *		instructions.  Each expression computes its result into a
+ *		fresh virtual register (or leaves it where it already is,
+ *		such as in memory or as an immediate), and machine
+ *		registers are only used where the instruction set or the
+ *		calling convention requires them.  Once the entire function
+ *		has been generated, the register allocator assigns machine
+ *		registers and the instructions are written out.
+ *
  *		Extra functionality:
  *		- putting all the global declarations at the end
+ *		- register allocation using linear scan
+ *		- callee-saved registers for values live across calls
+ *		- peephole optimization before and after allocation
+ *		- strength reduction of multiplication and division
+ *		- optional lowering to a three-address representation
+ *		- SSA-based constant propagation, value numbering, loop-
+ *		  invariant code motion, and dead code elimination of the
+ *		  three-address representation
+ *		- inlining of small functions defined earlier
+ *		- tail calls and tail recursion in the three-address
+ *		  representation
+ *		- leaf functions without a frame, using the red zone
+ *		- scaled-index addressing for array subscripts
+ *		- loop rotation, unrolling of counted loops, and alignment
+ *		  of loop heads
+ *		- vectorization of simple array loops using SSE2
+ *		- instrumentation for profiling, and use of a profile to
+ *		  lay out if statements, unroll loops, and inline calls
+ *		- local variables whose address is never taken are kept
+ *		  in registers
+ *		- conditional moves for if statements that select between
+ *		  two values and for logical expressions
+ *		- forwarding of loaded and stored values and of copies
+ *		  within basic blocks
+ *		- direct output of an ELF object file, or running the
+ *		  program in memory without writing it out at all
  */
 
 # include <vector>
+# include <cstdlib>
+# include <climits>
 # include <cassert>
 # include <iostream>
+# include <sstream>
 # include <map>
+# include <algorithm>
 # include "generator.h"
 # include "machine.h"
+# include "regalloc.h"
+# include "peephole.h"
+# include "forward.h"
+# include "object.h"
+# include "select.h"
+# include "optimize.h"
+# include "inline.h"
+# include "ir.h"
+# include "Instruction.h"
 # include "Tree.h"
 # include "Label.h"
 # include "string.h"
+# include "profile.h"
+
+# define PROFILE_COLD 10
+# define PROFILE_TRIPS 4
+# define PROFILE_HOT 1000
+# define UNROLL_LIMIT 128
 
 using namespace std;
 
 static int offset;
 static string funcname;
 static map<string, Label> strings;
-static string suffix(Expression *expr);
-static ostream &operator <<(ostream &ostr, Expression *expr);
-
-static Register *rax = new Register("%rax", "%eax", "%al");
-static Register *rbx = new Register("%rbx", "%ebx", "%bl");
-static Register *rcx = new Register("%rcx", "%ecx", "%cl");
-static Register *rdx = new Register("%rdx", "%edx", "%dl");
-static Register *rsi = new Register("%rsi", "%esi", "%sil");
-static Register *rdi = new Register("%rdi", "%edi", "%dil");
-static Register *r8 = new Register("%r8", "%r8d", "%r8b");
-static Register *r9 = new Register("%r9", "%r9d", "%r9b");
-static Register *r10 = new Register("%r10", "%r10d", "%r10b");
-static Register *r11 = new Register("%r11", "%r11d", "%r11b");
-static Register *r12 = new Register("%r12", "%r12d", "%r12b");
-static Register *r13 = new Register("%r13", "%r13d", "%r13b");
-static Register *r14 = new Register("%r14", "%r14d", "%r14b");
-static Register *r15 = new Register("%r15", "%r15d", "%r15b");
+static Instructions code;
+static vector<Register *> temporaries;
+static bool naive = false;
+static bool peepholes = true;
+static bool intermediate = false;
+static bool dump = false;
+static bool ssa = true;
+static bool omit = true;
+static bool rotated = true;
+static bool aligned = true;
+static bool vectorized = true;
+static bool promote = true;
+static bool converted = true;
+static bool forwarded = true;
+static bool instrumented = false;
+static bool objects = false;
+static bool running = false;
+static bool profiling = false;
+static string output = "scc.profile";
+static string input;
+static Instructions cold;
+static map<const Symbol *, Register *> variables;
+static unsigned limit = 24;
+static unsigned unroll = 1;
+static Statement *function;
 
 static vector<Register *> parameters = {rdi, rsi, rdx, rcx, r8, r9};
 static vector<Register *> registers = {rax, rdi, rsi, rdx, rcx, r8, r9, r10, r11};
+static vector<Register *> callee_saved = {rbx, r12, r13, r14, r15};
+
+
+/*
+ * Function:	setOption
+ *
+ * Description:	Set a code generation option from the command line.
+ *		Return false if the option is not recognized.  A profile
+ *		to be used is only read once all options are known, since
+ *		its default name depends on them.  The profiler
+ *		of an instrumented program is written as assembly, so
+ *		asking for instrumentation along with an object file or
+ *		running the program is an error.
+ */
+
+bool setOption(const string &option)
+{
+    if (option == "-fregalloc=linear")
+	naive = false;
+    else if (option == "-fregalloc=naive")
+	naive = true;
+    else if (option == "-fpeephole")
+	peepholes = true;
+    else if (option == "-fno-peephole")
+	peepholes = false;
+    else if (option == "-fir")
+	intermediate = true;
+    else if (option == "-fno-ir")
+	intermediate = false;
+    else if (option == "-fdump-ir")
+	intermediate = dump = true;
+    else if (option == "-fssa")
+	intermediate = ssa = true;
+    else if (option == "-fno-ssa")
+	ssa = false;
+    else if (option == "-finline")
+	intermediate = true;
+    else if (option == "-fno-inline")
+	limit = 0;
+    else if (option.compare(0, 15, "-finline-limit=") == 0)
+	limit = strtoul(option.c_str() + 15, NULL, 10);
+    else if (option == "-fomit-frame-pointer")
+	omit = true;
+    else if (option == "-fno-omit-frame-pointer")
+	omit = false;
+    else if (option == "-frotate-loops")
+	rotated = true;
+    else if (option == "-fno-rotate-loops")
+	rotated = false;
+    else if (option == "-falign-loops")
+	aligned = true;
+    else if (option == "-fno-align-loops")
+	aligned = false;
+    else if (option == "-fvectorize")
+	vectorized = true;
+    else if (option == "-fno-vectorize")
+	vectorized = false;
+    else if (option == "-fpromote-locals")
+	promote = true;
+    else if (option == "-fno-promote-locals")
+	promote = false;
+    else if (option == "-fif-conversion")
+	converted = true;
+    else if (option == "-fno-if-conversion")
+	converted = false;
+    else if (option == "-fforward-loads")
+	forwarded = true;
+    else if (option == "-fno-forward-loads")
+	forwarded = false;
+    else if (option == "-fprofile-generate")
+	instrumented = true;
+    else if (option.compare(0, 19, "-fprofile-generate=") == 0) {
+	instrumented = true;
+	output = option.substr(19);
+    } else if (option == "-fprofile-use") {
+	profiling = true;
+	input.clear();
+    } else if (option.compare(0, 14, "-fprofile-use=") == 0) {
+	profiling = true;
+	input = option.substr(14);
+    }
+    else if (option.compare(0, 9, "-funroll=") == 0)
+	unroll = max(strtoul(option.c_str() + 9, NULL, 10), 1UL);
+    else if (option == "-c" || option == "--emit-obj")
+	objects = true;
+    else if (option == "--run")
+	objects = running = true;
+    else
+	return false;
+
+    if (objects && instrumented) {
+	cerr << "scc: cannot instrument without writing assembly" << endl;
+	exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+
+/*
+ * Function:	loadProfile (private)
+ *
+ * Description:	Read the profile to be used, if any, before the first
+ *		function is generated.  Without a file name, the profile is
+ *		read from the file that an instrumented program writes.
+ */
+
+static void loadProfile()
+{
+    if (profiling) {
+	readProfile(input.empty() ? output : input);
+	profiling = false;
+    }
+}
+
+
+/*
+ * Function:	size (private)
+ *
+ * Description:	Return the access size of an expression.  An array is only
+ *		ever used for its address.
+ */
+
+static unsigned size(Expression *expr)
+{
+    if (expr->type().isArray())
+	return SIZEOF_PTR;
+
+    return expr->type().size();
+}
+
+
+/*
+ * Function:	name (private)
+ *
+ * Description:	Return the name of a label as used in an operand.
+ */
+
+static string name(const Label &label)
+{
+    stringstream ss;
+
+    ss << label;
+    return ss.str();
+}
+
+
+/*
+ * Function:	emit (private)
+ *
+ * Description:	Append an instruction to the current function.
+ */
+
+static void emit(const Instruction &inst)
+{
+    code.push_back(inst);
+}
+
+static void emit(Opcode opcode, unsigned size)
+{
+    code.push_back(Instruction(opcode, size));
+}
+
+static void emit(Opcode opcode, unsigned size, const Operand &op)
+{
+    code.push_back(Instruction(opcode, size, op));
+}
+
+static void emit(Opcode opcode, unsigned size, const Operand &src,
+	const Operand &dst)
+{
+    code.push_back(Instruction(opcode, size, src, dst));
+}
+
+
+/*
+ * Function:	emit (private)
+ *
+ * Description:	Append a conditional instruction to the current function.
+ */
 
+static void emit(Opcode opcode, Condition cond, const Operand &op)
+{
+    Instruction inst(opcode, 1, op);
+
+    inst._cond = cond;
+    code.push_back(inst);
+}
+
+static void emit(Opcode opcode, Condition cond, unsigned size,
+	const Operand &src, const Operand &dst)
+{
+    Instruction inst(opcode, size, src, dst);
+
+    inst._cond = cond;
+    code.push_back(inst);
+}
+
+
+/*
+ * Function:	emit (private)
+ *
+ * Description:	Append a label definition to the current function.
+ */
+
+static void emit(const Label &label)
+{
+    emit(LABEL, 0, Operand::target(name(label)));
+}
+
+
+/*
+ * Function:	head (private)
+ *
+ * Description:	Append the definition of the label at the head of a loop,
+ *		which is aligned so that the loop starts on a fresh line of
+ *		the instruction cache unless the loop is known to be cold.
+ */
+
+static void head(const Label &label, bool hot)
+{
+    emit(LABEL, aligned && hot ? LOOP_ALIGNMENT : 0,
+	Operand::target(name(label)));
+}
+
+
+/*
+ * Function:	increment (private)
+ *
+ * Description:	Append an increment of the given counter if the program is
+ *		being instrumented for profiling.
+ */
+
+static void increment(unsigned counter)
+{
+    Operand op = Operand::global(label_prefix "counters", SIZEOF_LONG);
+
+    if (instrumented) {
+	op._value = counter * SIZEOF_LONG;
+	emit(ADD, SIZEOF_LONG, Operand::immediate(1, SIZEOF_LONG), op);
+    }
+}
+
+
+/*
+ * Function:	executed (private)
+ *
+ * Description:	Return whether the given counter was ever incremented
+ *		according to the profile, which is assumed if there is no
+ *		profile.
+ */
+
+static bool executed(unsigned counter)
+{
+    return !isProfiled() || frequency(counter) > 0;
+}
+
+
+/*
+ * Function:	jump (private)
+ *
+ * Description:	Append a jump to the given label, which is conditional
+ *		unless no condition is given.
+ */
+
+static void jump(const Label &label)
+{
+    emit(JMP, 0, Operand::target(name(label)));
+}
+
+static void jump(Condition cond, const Label &label)
+{
+    emit(JCC, cond, Operand::target(name(label)));
+}
 
-/* These will be replaced with functions in the next phase.  They are here
-   as placeholders so that Call::generate() is finished. */
 
+/*
+ * Function:	assign
+ *
+ * Description:	Associate the given expression with the given register,
+ *		breaking any previous associations.
+ */
 
 void assign(Expression *expr, Register *reg)
 {
     if (expr != nullptr) {
-        if (expr->_register != nullptr) {
-            expr->_register->_node = nullptr;
-        }
+	if (expr->_register != nullptr)
+	    expr->_register->_node = nullptr;
 
-        expr->_register = reg;
+	expr->_register = reg;
     }
+
     if (reg != nullptr) {
-        if (reg->_node != nullptr) {
-            reg->_node->_register = nullptr;
-        }
+	if (reg->_node != nullptr)
+	    reg->_node->_register = nullptr;
 
-        reg->_node = expr;
+	reg->_node = expr;
     }
 }
 
-void load(Expression *expr, Register *reg) {
-    if (reg->_node != expr) {
-        if (reg->_node != nullptr) {
-            unsigned size = reg->_node->type().size();
-            offset -= size;
-            reg->_node->_offset = offset;
-            cout << "\tmov" << suffix(reg->_node);
-            cout << reg->name(size) << ", ";
-            cout << offset << "(%rbp)" << endl;
-        }
 
-        if (expr != nullptr) {
-            unsigned size = expr->type().size();
-            cout << "\tmov" << suffix(expr) << expr;
-            cout << ", " << reg->name(size) << endl;
-        }
+/*
+ * Function:	getreg
+ *
+ * Description:	Return a new virtual register.  There is always another
+ *		one, since the allocator will sort them out later.
+ */
 
-        assign(expr, reg);
-    }
+Register *getreg()
+{
+    Register *reg = new Register(NUM_MACHINE_REGS + temporaries.size());
+
+    temporaries.push_back(reg);
+    return reg;
 }
 
-Register *getreg()
+
+/*
+ * Function:	promoted (private)
+ *
+ * Description:	Return the virtual register that holds a local variable or
+ *		parameter for the whole function, or null if it must live
+ *		in memory instead.  A scalar whose address is never taken
+ *		can only be reached by name, so nothing else can see it
+ *		change.  The answer is remembered, so that the function is
+ *		only searched once for each variable.  With naive
+ *		allocation, the register would only be spilled to a second
+ *		slot beside the variable's own, so it stays in memory.
+ */
+
+static Register *promoted(const Symbol *symbol)
 {
-    for (auto reg : registers) {
-        if (reg->_node == nullptr) {
-            return reg;
-        }
-    }
+    map<const Symbol *, Register *>::iterator it;
+    Register *reg;
+
+
+    it = variables.find(symbol);
+
+    if (it != variables.end())
+	return it->second;
+
+    reg = nullptr;
+
+    if (promote && !naive && symbol->_offset != 0
+	    && !symbol->type().isArray())
+	if (!function->modifies(symbol, false))
+	    reg = getreg();
+
+    variables[symbol] = reg;
+    return reg;
+}
+
+
+/*
+ * Function:	location (private)
+ *
+ * Description:	Return the operand for an expression, which is its
+ *		register if it has one.
+ */
+
+static Operand location(Expression *expr)
+{
+    if (expr->_register != nullptr)
+	return Operand(expr->_register, size(expr));
 
-    abort();
+    return expr->operand();
 }
 
 
 /*
- * Function:	suffix (private)
+ * Function:	load
  *
- * Description:	Return the suffix for an opcode based on the given size.
+ * Description:	Load an expression into the given register.
  */
 
-static string suffix(unsigned long size)
+void load(Expression *expr, Register *reg)
 {
-    return size == 1 ? "b\t" : (size == 4 ? "l\t" : "q\t");
+    if (expr->_register != reg) {
+	emit(MOV, size(expr), location(expr), Operand(reg, size(expr)));
+	assign(expr, reg);
+    }
 }
 
 
 /*
- * Function:	suffix (private)
+ * Function:	source (private)
  *
- * Description:	Return the suffix for an opcode based on the size of the
- *		given expression.
+ * Description:	Return the operand for an expression that is to be used as
+ *		a source operand.  Only 32-bit immediates may be used, so
+ *		any larger values are first loaded into a register.
  */
 
-static string suffix(Expression *expr)
+static Operand source(Expression *expr)
 {
-    return suffix(expr->type().size());
+    Operand op = location(expr);
+
+    if (op.isImm() && !op.isSmall()) {
+	load(expr, getreg());
+	op = location(expr);
+    }
+
+    return op;
 }
 
 
@@ -142,70 +527,138 @@ static int align(int offset)
 
 
 /*
- * Function:	operator << (private)
+ * Function:	leaf (private)
  *
- * Description:	Convenience function for writing the operand of an
- *		expression using the output stream operator.
+ * Description:	Return whether the current function is a leaf that can do
+ *		without a frame pointer, since it calls nothing and never
+ *		uses the stack pointer itself.
  */
 
-static ostream &operator <<(ostream &ostr, Expression *expr)
+static bool leaf()
 {
-    if (expr->_register != nullptr)
-	return ostr << expr->_register;
+    vector<Register *> uses, defs;
+
+    for (auto &inst : code) {
+	if (inst._opcode == CALL || inst._opcode == PUSH || inst._opcode == POP)
+	    return false;
+
+	inst.registers(uses, defs);
+
+	if (find(uses.begin(), uses.end(), rsp) != uses.end())
+	    return false;
+
+	if (find(defs.begin(), defs.end(), rsp) != defs.end())
+	    return false;
+    }
 
-    expr->operand(ostr);
-    return ostr;
+    return true;
+}
+
+
+/*
+ * Function:	unframe (private)
+ *
+ * Description:	Rewrite every reference to the frame of the current
+ *		function to use the stack pointer instead, after it has
+ *		been lowered by the given amount.  The frame pointer would
+ *		have been just below the return address.
+ */
+
+static void unframe(int adjust)
+{
+    for (auto &inst : code)
+	for (auto &op : inst._operands)
+	    if (op._kind == Operand::MEM && op._base == rbp) {
+		op._base = rsp;
+		op._value += adjust - SIZEOF_REG;
+	    }
+}
+
+
+/*
+ * Function:	written (private)
+ *
+ * Description:	Return whether the given register is written anywhere in
+ *		the current function.
+ */
+
+static bool written(Register *reg)
+{
+    vector<Register *> uses, defs;
+
+    for (auto &inst : code) {
+	inst.registers(uses, defs);
+
+	if (find(defs.begin(), defs.end(), reg) != defs.end())
+	    return true;
+    }
+
+    return false;
 }
 
 
 /*
  * Function:	Expression::operand
  *
- * Description:	Write an expression as an operand to the specified stream.
+ * Description:	Return an expression as an operand.
  */
 
-void Expression::operand(ostream &ostr) const
+Operand Expression::operand() const
 {
-    //assert(_offset != 0);
-    ostr << _offset << "(%rbp)";
+    return Operand::memory(rbp, _offset, _type.size());
 }
 
 
 /*
  * Function:	Identifier::operand
  *
- * Description:	Write an identifier as an operand to the specified stream.
+ * Description:	Return an identifier as an operand, which is its register
+ *		if it is a local variable kept in one.
  */
 
-void Identifier::operand(ostream &ostr) const
+Operand Identifier::operand() const
 {
+    unsigned size = _type.isArray() ? SIZEOF_PTR : _type.size();
+    Register *reg;
+
+
     if (_symbol->_offset == 0)
-	ostr << global_prefix << _symbol->name() << global_suffix;
-    else
-	ostr << _symbol->_offset << "(%rbp)";
+	return Operand::global(global_prefix + _symbol->name(), size);
+
+    reg = promoted(_symbol);
+
+    if (reg != nullptr)
+	return Operand(reg, size);
+
+    return Operand::memory(rbp, _symbol->_offset, size);
 }
 
 
 /*
  * Function:	Number::operand
  *
- * Description:	Write a number as an operand to the specified stream.
+ * Description:	Return a number as an operand.
  */
 
-void Number::operand(ostream &ostr) const
+Operand Number::operand() const
 {
-    ostr << "$" << _value;
+    return Operand::immediate(strtoul(_value.c_str(), NULL, 0), _type.size());
 }
 
-void String::operand(ostream &ostr) const { 
-    if(strings.find(_value) == strings.end()) {
-        Label label;
-        strings.insert(pair<string, Label>(_value, label));
-        ostr << label;
-    } else {
-        ostr << strings.find(_value)->second;
-    }
-    
+
+/*
+ * Function:	String::operand
+ *
+ * Description:	Return a string literal as an operand, which is the label
+ *		of its contents.  Identical strings share a label.
+ */
+
+Operand String::operand() const
+{
+    if (strings.find(_value) == strings.end())
+	strings.insert(pair<string, Label>(_value, Label()));
+
+    return Operand::global(name(strings.find(_value)->second), SIZEOF_PTR);
 }
 
 
@@ -223,14 +676,22 @@ void String::operand(ostream &ostr) const {
  *
  *		    if (args.size() > 6 && args.size() % 2 != 0)
  *			subq $8, %rsp
+ *
+ *		The call itself reads the argument registers and destroys
+ *		all the caller-saved registers.  The register allocator
+ *		takes care of keeping anything live across the call out of
+ *		them, recomputing constants rather than saving them, and
+ *		computes each argument straight into its parameter register
+ *		when it can.
  */
 
 void Call::generate()
 {
     unsigned numBytes;
+    Instruction call(CALL, 0, Operand::target(global_prefix + _id->name()));
 
 
-    /* Generate code for the arguments first. */ 
+    /* Generate code for the arguments first. */
 
     numBytes = 0;
 
@@ -244,7 +705,8 @@ void Call::generate()
 	numBytes = align((_args.size() - NUM_PARAM_REGS) * SIZEOF_PARAM);
 
 	if (numBytes > 0)
-	    cout << "\tsubq\t$" << numBytes << ", %rsp" << endl;
+	    emit(SUB, SIZEOF_REG, Operand::immediate(numBytes, SIZEOF_REG),
+		Operand(rsp, SIZEOF_REG));
     }
 
 
@@ -253,11 +715,24 @@ void Call::generate()
     for (int i = _args.size() - 1; i >= 0; i --) {
 	if (i >= NUM_PARAM_REGS) {
 	    numBytes += SIZEOF_PARAM;
-	    load(_args[i], rax);
-	    cout << "\tpushq\t%rax" << endl;
 
-	} else
-	    load(_args[i], parameters[i]);
+	    if (_args[i]->_register == nullptr && !source(_args[i]).isImm())
+		load(_args[i], getreg());
+
+	    if (_args[i]->_register != nullptr)
+		emit(PUSH, SIZEOF_PARAM, Operand(_args[i]->_register, SIZEOF_PARAM));
+	    else
+		emit(PUSH, SIZEOF_PARAM, location(_args[i]));
+
+	} else {
+	    if (size(_args[i]) == SIZEOF_CHAR)
+		emit(MOVS, SIZEOF_INT, location(_args[i]),
+		    Operand(parameters[i], SIZEOF_INT));
+	    else
+		load(_args[i], parameters[i]);
+
+	    call._uses.push_back(parameters[i]);
+	}
 
 	assign(_args[i], nullptr);
     }
@@ -268,18 +743,23 @@ void Call::generate()
        vector registers to %eax if the function being called takes a
        variable number of arguments.  But, it never hurts. */
 
-    for (auto reg : registers)
-	load(nullptr, reg);
-
-    if (_id->type().parameters() == nullptr)
-	cout << "\tmovl\t$0, %eax" << endl;
+    if (_id->type().parameters() == nullptr) {
+	emit(MOV, SIZEOF_INT, Operand::immediate(0, SIZEOF_INT),
+	    Operand(rax, SIZEOF_INT));
+	call._uses.push_back(rax);
+    }
 
-    cout << "\tcall\t" << global_prefix << _id->name() << endl;
+    call._defs = registers;
+    emit(call);
 
     if (numBytes > 0)
-	cout << "\taddq\t$" << numBytes << ", %rsp" << endl;
+	emit(ADD, SIZEOF_REG, Operand::immediate(numBytes, SIZEOF_REG),
+	    Operand(rsp, SIZEOF_REG));
 
-    assign(this, rax);
+    if (_type.size() > 0) {
+	assign(this, getreg());
+	emit(MOV, size(this), Operand(rax, size(this)), location(this));
+    }
 }
 
 
@@ -292,11 +772,8 @@ void Call::generate()
 
 void Block::generate()
 {
-    for (auto stmt : _stmts) {
+    for (auto stmt : _stmts)
 	stmt->generate();
-
-	
-    }
 }
 
 
@@ -314,12 +791,43 @@ void Simple::generate()
 }
 
 
+/*
+ * Function:	budget (private)
+ *
+ * Description:	Return the largest size of a function with the given
+ *		counter that is kept for inlining.  With a profile, a
+ *		function that was never called is not inlined, and one
+ *		that was called often may be larger than usual.
+ */
+
+static unsigned budget(unsigned counter)
+{
+    if (!isProfiled())
+	return limit;
+
+    if (frequency(counter) == 0)
+	return 0;
+
+    if (frequency(counter) >= PROFILE_HOT)
+	return 2 * limit;
+
+    return limit;
+}
+
+
 /*
  * Function:	Function::generate
  *
  * Description:	Generate code for this function, which entails allocating
- *		space for local variables, then emitting our prologue, the
- *		body of the function, and the epilogue.
+ *		space for local variables, generating the body of the
+ *		function, allocating registers, and then writing out our
+ *		prologue, the body, and the epilogue.
+ *
+ *		The caller-saved registers are listed first in the pool so
+ *		that short-lived values prefer them.  A value live across a
+ *		call cannot use them and ends up in a callee-saved register
+ *		instead, which we save in the prologue and restore in the
+ *		epilogue only if the function actually writes it.
  */
 
 void Function::generate()
@@ -328,6 +836,19 @@ void Function::generate()
     unsigned size;
     Parameters *params;
     Symbols symbols;
+    Instruction ret(RET, 0);
+    vector<Register *> pool;
+    Instructions saves, restores, body, prologue, epilogue;
+    Procedure *proc;
+    Register *reg;
+    Operand slot;
+    bool frameless;
+    int adjust;
+
+
+    /* Read the profile, if any, now that all options are known. */
+
+    loadProfile();
 
 
     /* Assign offsets to the parameters and local variables. */
@@ -336,547 +857,2369 @@ void Function::generate()
     offset = param_offset;
     allocate(offset);
 
+    funcname = _id->name();
+    function = _body;
+    code.clear();
+    cold.clear();
+    variables.clear();
 
-    /* Generate our prologue. */
 
-    funcname = _id->name();
-    cout << global_prefix << funcname << ":" << endl;
-    cout << "\tpushq\t%rbp" << endl;
-    cout << "\tmovq\t%rsp, %rbp" << endl;
-    cout << "\tmovl\t$" << funcname << ".size, %eax" << endl;
-    cout << "\tsubq\t%rax, %rsp" << endl;
+    /* Generate the body of this function, either directly from the tree or
+       by first lowering it to three-address code, into which any calls to
+       small functions defined earlier are inlined.  This function is then
+       kept for inlining into later ones if it is small enough.  The
+       counters of an instrumented program belong to the tree, so it is
+       always generated directly. */
+
+    if (intermediate && !instrumented) {
+	proc = lower();
+	inlineCalls(proc, offset);
+	proc->_offset = offset;
 
+	if (ssa)
+	    optimize(proc);
 
-    /* Spill any parameters. */
+	if (dump)
+	    cerr << *proc;
 
-    params = _id->type().parameters();
-    symbols = _body->declarations()->symbols();
+	select(proc, code, registers);
 
-    for (unsigned i = 0; i < NUM_PARAM_REGS; i ++)
-	if (i < params->size()) {
+	if (!remember(proc, budget(_counter)))
+	    delete proc;
+
+    } else {
+	params = _id->type().parameters();
+	symbols = _body->declarations()->symbols();
+
+	for (unsigned i = 0; i < params->size(); i ++) {
 	    size = symbols[i]->type().size();
-	    cout << "\tmov" << suffix(size) << parameters[i]->name(size);
-	    cout << ", " << symbols[i]->_offset << "(%rbp)" << endl;
-	} else
-	    break;
+	    slot = Operand::memory(rbp, symbols[i]->_offset, size);
+	    reg = promoted(symbols[i]);
+
+	    if (i < NUM_PARAM_REGS)
+		emit(MOV, size, Operand(parameters[i], size),
+		    reg != nullptr ? Operand(reg, size) : slot);
+	    else if (reg != nullptr)
+		emit(MOV, size, slot, Operand(reg, size));
+	}
 
+	increment(_counter);
+	_body->generate();
+	emit(LABEL, 0, Operand::target(global_prefix + funcname + ".exit"));
 
-    /* Generate the body of this function. */
+	if (Type(_id->type().specifier(), _id->type().indirection()).size() > 0)
+	    ret._uses.push_back(rax);
 
-    _body->generate();
+	emit(ret);
+	code.insert(code.end(), cold.begin(), cold.end());
+    }
 
 
-    /* Generate our epilogue. */
+    /* Replace the virtual registers with real ones. */
 
-    cout << endl << global_prefix << funcname << ".exit:" << endl;
-    cout << "\tmovq\t%rbp, %rsp" << endl;
-    cout << "\tpopq\t%rbp" << endl;
-    cout << "\tret" << endl << endl;
+    if (forwarded)
+	forward(code);
 
-    offset -= align(offset - param_offset);
-    cout << "\t.set\t" << funcname << ".size, " << -offset << endl;
-    cout << "\t.globl\t" << global_prefix << funcname << endl << endl;
-}
+    if (peepholes)
+	peephole(code);
 
+    pool = registers;
+    pool.insert(pool.end(), callee_saved.begin(), callee_saved.end());
+    allocateRegisters(code, pool, offset, naive);
 
-/*
- * Function:	generateGlobals
- *
- * Description:	Generate code for any global variable declarations.
- */
+    for (auto reg : temporaries)
+	delete reg;
 
-void generateGlobals(Scope *scope)
-{
-    const Symbols &symbols = scope->symbols();
+    temporaries.clear();
 
-    for (auto symbol : symbols)
-	if (!symbol->type().isFunction()) {
-	    cout << "\t.comm\t" << global_prefix << symbol->name() << ", ";
-	    cout << symbol->type().size() << endl;
+
+    /* Save and restore any callee-saved registers that we used. */
+
+    for (auto reg : callee_saved)
+	if (written(reg)) {
+	    offset = (offset - SIZEOF_REG) & ~(SIZEOF_REG - 1);
+	    slot = Operand::memory(rbp, offset, SIZEOF_REG);
+
+	    saves.push_back(Instruction(MOV, SIZEOF_REG,
+		Operand(reg, SIZEOF_REG), slot));
+	    restores.push_back(Instruction(MOV, SIZEOF_REG, slot,
+		Operand(reg, SIZEOF_REG)));
 	}
 
-    cout << "\t.data" << endl;
-    for(map<string, Label>::iterator it=strings.begin(); it != strings.end(); ++it) {
-        cout << it->second << ":" << "\t.asciz\t\"" << escapeString(it->first) << "\"" << endl;
+    body = saves;
+
+    for (auto &inst : code) {
+	if (inst._opcode == RET)
+	    body.insert(body.end(), restores.begin(), restores.end());
+
+	body.push_back(inst);
     }
-}
+
+    code = body;
+
+    if (peepholes)
+	peephole(code);
+
+
+    /* Generate our prologue, the body, and our epilogue, and either write
+       them out or encode them.  A leaf function has no frame pointer, and
+       its frame lies in the red zone below the stack pointer if it fits,
+       so the stack pointer is not even moved. */
+
+    offset -= align(offset - param_offset);
+    frameless = omit && leaf();
+    adjust = -offset;
+
+    if (frameless && adjust + SIZEOF_REG <= RED_ZONE)
+	adjust = 0;
+
+    if (frameless)
+	unframe(adjust);
+    else {
+	prologue.push_back(Instruction(PUSH, SIZEOF_REG,
+	    Operand(rbp, SIZEOF_REG)));
+	prologue.push_back(Instruction(MOV, SIZEOF_REG,
+	    Operand(rsp, SIZEOF_REG), Operand(rbp, SIZEOF_REG)));
+	epilogue.push_back(Instruction(MOV, SIZEOF_REG,
+	    Operand(rbp, SIZEOF_REG), Operand(rsp, SIZEOF_REG)));
+	epilogue.push_back(Instruction(POP, SIZEOF_REG,
+	    Operand(rbp, SIZEOF_REG)));
+    }
+
+    if (adjust > 0) {
+	prologue.push_back(Instruction(SUB, SIZEOF_REG,
+	    Operand::immediate(adjust, SIZEOF_REG), Operand(rsp, SIZEOF_REG)));
+
+	if (frameless)
+	    epilogue.push_back(Instruction(ADD, SIZEOF_REG,
+		Operand::immediate(adjust, SIZEOF_REG),
+		Operand(rsp, SIZEOF_REG)));
+    }
+
+    body = prologue;
+
+    for (auto &inst : code) {
+	if (inst._opcode == RET)
+	    body.insert(body.end(), epilogue.begin(), epilogue.end());
+
+	body.push_back(inst);
+    }
+
+    if (objects) {
+	assemble(global_prefix + funcname, body);
+	return;
+    }
+
+    cout << global_prefix << funcname << ":" << endl;
+
+    for (auto &inst : body)
+	cout << inst << (inst._opcode == RET ? "\n" : "");
+
+    cout << "\t.globl\t" << global_prefix << funcname << endl << endl;
+}
+
+
+/*
+ * Function:	generateProfiler (private)
+ *
+ * Description:	Generate the counters of an instrumented program, along
+ *		with a function to write them to the profile, which is
+ *		registered to be called at exit by a constructor.
+ */
+
+static void generateProfiler()
+{
+    const string counters = label_prefix "counters";
+    const string writer = label_prefix "profile";
+    const string file = writer + ".file", format = writer + ".format";
+
+
+    cout << "\t.lcomm\t" << counters << ", ";
+    cout << numCounters() * SIZEOF_LONG << endl;
+
+    cout << writer << ":" << endl;
+    cout << "\tpushq\t%rbx" << endl;
+    cout << "\tpushq\t%r12" << endl;
+    cout << "\tsubq\t$8, %rsp" << endl;
+    cout << "\tleaq\t" << file << global_suffix << ", %rdi" << endl;
+    cout << "\tleaq\t" << writer << ".mode" << global_suffix << ", %rsi";
+    cout << endl << "\tcall\t" << global_prefix << "fopen" << endl;
+    cout << "\tmovq\t%rax, %rbx" << endl;
+    cout << "\tcmpq\t$0, %rbx" << endl;
+    cout << "\tje\t" << writer << ".exit" << endl;
+
+    cout << "\tmovq\t%rbx, %rdi" << endl;
+    cout << "\tleaq\t" << format << global_suffix << ", %rsi" << endl;
+    cout << "\tmovq\t$" << numCounters() << ", %rdx" << endl;
+    cout << "\tmovl\t$0, %eax" << endl;
+    cout << "\tcall\t" << global_prefix << "fprintf" << endl;
+    cout << "\tmovq\t$0, %r12" << endl;
+
+    cout << writer << ".loop:" << endl;
+    cout << "\tcmpq\t$" << numCounters() << ", %r12" << endl;
+    cout << "\tjge\t" << writer << ".close" << endl;
+    cout << "\tmovq\t%rbx, %rdi" << endl;
+    cout << "\tleaq\t" << format << global_suffix << ", %rsi" << endl;
+    cout << "\tleaq\t" << counters << global_suffix << ", %rdx" << endl;
+    cout << "\tmovq\t(%rdx,%r12,8), %rdx" << endl;
+    cout << "\tmovl\t$0, %eax" << endl;
+    cout << "\tcall\t" << global_prefix << "fprintf" << endl;
+    cout << "\taddq\t$1, %r12" << endl;
+    cout << "\tjmp\t" << writer << ".loop" << endl;
+
+    cout << writer << ".close:" << endl;
+    cout << "\tmovq\t%rbx, %rdi" << endl;
+    cout << "\tcall\t" << global_prefix << "fclose" << endl;
+    cout << writer << ".exit:" << endl;
+    cout << "\taddq\t$8, %rsp" << endl;
+    cout << "\tpopq\t%r12" << endl;
+    cout << "\tpopq\t%rbx" << endl;
+    cout << "\tret" << endl << endl;
+
+    cout << writer << ".init:" << endl;
+    cout << "\tleaq\t" << writer << global_suffix << ", %rdi" << endl;
+    cout << "\tjmp\t" << global_prefix << "atexit" << endl << endl;
+
+    cout << init_section << endl;
+    cout << "\t.p2align\t3" << endl;
+    cout << "\t.quad\t" << writer << ".init" << endl;
+
+    cout << "\t.data" << endl;
+    cout << file << ":\t.asciz\t\"" << escapeString(output) << "\"" << endl;
+    cout << writer << ".mode:\t.asciz\t\"w\"" << endl;
+    cout << format << ":\t.asciz\t\"%lu\\n\"" << endl;
+    cout << "\t.text" << endl;
+}
+
+
+/*
+ * Function:	generateGlobals
+ *
+ * Description:	Generate code for any global variable declarations, and
+ *		for the profiler of an instrumented program.  When writing
+ *		an object file, the globals and string literals go in it
+ *		along with the functions already encoded, unless the
+ *		program is to be run immediately instead.
+ */
+
+void generateGlobals(Scope *scope)
+{
+    const Symbols &symbols = scope->symbols();
+
+    if (instrumented)
+	generateProfiler();
+
+    loadProfile();
+    checkProfile();
+
+    if (objects) {
+	for (auto symbol : symbols)
+	    if (!symbol->type().isFunction())
+		defineCommon(global_prefix + symbol->name(),
+		    symbol->type().size());
+
+	for (auto &entry : strings)
+	    defineString(name(entry.second), entry.first);
+
+	if (running)
+	    exit(runObject());
+
+	writeObject(cout);
+	return;
+    }
+
+    for (auto symbol : symbols)
+	if (!symbol->type().isFunction()) {
+	    cout << "\t.comm\t" << global_prefix << symbol->name() << ", ";
+	    cout << symbol->type().size() << endl;
+	}
+
+    cout << "\t.data" << endl;
+
+    for (auto &entry : strings) {
+	cout << entry.second << ":\t.asciz\t\"";
+	cout << escapeString(entry.first) << "\"" << endl;
+    }
+}
+
+
+/*
+ * Function:	indirect (private)
+ *
+ * Description:	Generate code for a pointer and return the memory operand
+ *		to which it points.  A pointer plus a constant or plus an
+ *		index scaled by 1, 2, 4, or 8, which is what subscripting
+ *		an array becomes, uses the addressing modes of the machine
+ *		instead of computing the address.  The base and index
+ *		expressions are left holding the registers in the operand,
+ *		unless they are variables already kept in registers.
+ */
+
+static Operand indirect(Expression *pointer, unsigned bytes,
+	Expression *&base, Expression *&index)
+{
+    Expression *left, *right, *factor;
+    unsigned long value;
+    unsigned scale;
+    long disp;
+
+
+    base = pointer;
+    index = nullptr;
+    scale = 1;
+    disp = 0;
+
+    if (pointer->isAdd(left, right) && left->type().isPointer()) {
+	if (right->isNumber(value)
+		&& Operand::immediate(value, SIZEOF_PTR).isSmall()) {
+	    base = left;
+	    disp = value;
+
+	} else if (size(right) == SIZEOF_PTR) {
+	    base = left;
+	    index = right;
+
+	    if (right->isMultiply(left, factor) && factor->isNumber(value)
+		    && (value == 2 || value == 4 || value == 8)) {
+		index = left;
+		scale = value;
+	    }
+	}
+    }
+
+    base->generate();
+
+    if (index != nullptr)
+	index->generate();
+
+    if (base->_register == nullptr && !location(base).isReg())
+	load(base, getreg());
+
+    if (index == nullptr)
+	return Operand::memory(location(base)._base, disp, bytes);
+
+    if (index->_register == nullptr && !location(index).isReg())
+	load(index, getreg());
+
+    return Operand::memory(location(base)._base, location(index)._base, scale,
+	0, bytes);
+}
+
+
+/*
+ * Function:	fold (private)
+ *
+ * Description:	Generate code for an expression used as the source operand
+ *		of an instruction that accepts memory.  A dereference is
+ *		not loaded into a register but is returned as a memory
+ *		reference, so that the load is folded into the instruction.
+ *		The registers of the operand are held by the returned base
+ *		and index expressions until they are released.
+ */
+
+static Operand fold(Expression *expr, Expression *&base, Expression *&index)
+{
+    Expression *pointer;
+
+
+    if (expr->isDereference(pointer))
+	return indirect(pointer, size(expr), base, index);
+
+    base = expr;
+    index = nullptr;
+
+    expr->generate();
+    return source(expr);
+}
+
+
+/*
+ * Function:	release (private)
+ *
+ * Description:	Release the registers held by the base and index
+ *		expressions of an operand.
+ */
+
+static void release(Expression *base, Expression *index)
+{
+    assign(base, nullptr);
+
+    if (index != nullptr)
+	assign(index, nullptr);
+}
+
+
+/*
+ * Function:	same (private)
+ *
+ * Description:	Return whether two expressions are known to compute the
+ *		same value, and if they are lvalues, to designate the same
+ *		object.  Only pure expressions built from variables,
+ *		constants, dereferences, addresses, casts, and additions
+ *		and multiplications are recognized.
+ */
+
+static bool same(Expression *a, Expression *b)
+{
+    Expression *left1, *right1, *left2, *right2;
+    const Symbol *symbol1, *symbol2;
+    unsigned long value1, value2;
+
+
+    if (size(a) != size(b))
+	return false;
+
+    if (a->isIdentifier(symbol1))
+	return b->isIdentifier(symbol2) && symbol1 == symbol2;
+
+    if (a->isNumber(value1))
+	return b->isNumber(value2) && value1 == value2;
+
+    if (a->isDereference(left1))
+	return b->isDereference(left2) && same(left1, left2);
+
+    if (a->isCast(left1))
+	return b->isCast(left2) && same(left1, left2);
+
+    if (a->isAddress(left1))
+	return b->isAddress(left2) && same(left1, left2);
+
+    if (a->isAdd(left1, right1))
+	return b->isAdd(left2, right2)
+	    && same(left1, left2) && same(right1, right2);
+
+    if (a->isMultiply(left1, right1))
+	return b->isMultiply(left2, right2)
+	    && same(left1, left2) && same(right1, right2);
+
+    return false;
+}
+
+
+/*
+ * Function:	update (private)
+ *
+ * Description:	Generate code for an assignment that adds to or subtracts
+ *		from its own left-hand side, such as x = x + y, as a single
+ *		instruction that updates the variable or memory in place.
+ *		Return false, having generated nothing, if the assignment
+ *		is not of this form.
+ */
+
+static bool update(Expression *left, Expression *right)
+{
+    Expression *pointer, *base, *index, *operand, *value;
+    Operand target;
+    Opcode opcode;
+
+
+    if (right->isAdd(operand, value))
+	opcode = ADD;
+    else if (right->isSubtract(operand, value))
+	opcode = SUB;
+    else
+	return false;
+
+    if (!same(left, operand) || !value->isPure())
+	return false;
+
+    value->generate();
+
+    if (!location(value).isReg() && !location(value).isSmall())
+	load(value, getreg());
+
+    if (left->isDereference(pointer)) {
+	target = indirect(pointer, size(left), base, index);
+	release(base, index);
+    } else
+	target = location(left);
+
+    emit(opcode, size(left), location(value), target);
+    assign(value, nullptr);
+    return true;
+}
+
+
+/*
+ * Function:	Assignment::generate
+ *
+ * Description:	Generate code for an assignment statement.  The right-hand
+ *		side must be in a register unless it is a small immediate,
+ *		since the left-hand side is always in memory.
+ */
+
+void Assignment::generate()
+{
+    Expression *pointer, *base, *index;
+    Operand target;
+
+
+    if (update(_left, _right))
+	return;
+
+    _right->generate();
+
+    if (_left->isDereference(pointer))
+	target = indirect(pointer, size(_right), base, index);
+    else
+	target = location(_left);
+
+    if (_right->_register == nullptr && !location(_right).isSmall())
+	load(_right, getreg());
+
+    emit(MOV, size(_right), location(_right), target);
+
+    assign(_right, nullptr);
+    assign(_left, nullptr);
+
+    if (_left->isDereference(pointer)) {
+	assign(base, nullptr);
+
+	if (index != nullptr)
+	    assign(index, nullptr);
+    }
+}
+
+
+/*
+ * Function:	Expression::test
+ *
+ * Description:	Generate code to branch to the given label if the value of
+ *		this expression is nonzero (or zero if ifTrue is false).
+ */
+
+void Expression::test(const Label &label, bool ifTrue)
+{
+    generate();
+
+    if (_register == nullptr && location(this).isImm())
+	load(this, getreg());
+
+    emit(CMP, size(this), Operand::immediate(0, size(this)), location(this));
+    jump(ifTrue ? CC_NE : CC_E, label);
+
+    assign(this, nullptr);
+}
+
+
+/*
+ * Function:	arithmetic (private)
+ *
+ * Description:	Generate code for a two-address arithmetic instruction.
+ *		The left operand must be in a register, which becomes the
+ *		result.  The right operand may be folded from memory.
+ */
+
+static void arithmetic(Expression *result, Expression *left,
+	Expression *right, Opcode opcode)
+{
+    Expression *base, *index;
+    Operand op;
+
+
+    left->generate();
+    op = fold(right, base, index);
+
+    if (left->_register == nullptr)
+	load(left, getreg());
+
+    emit(opcode, size(left), op, location(left));
+
+    release(base, index);
+    assign(result, left->_register);
+}
+
+
+/*
+ * Function:	combine (private)
+ *
+ * Description:	Generate code for an addition using lea, which adds a base
+ *		register, an index register scaled by 1, 2, 4, or 8, and a
+ *		displacement into a new register without changing any of
+ *		them.  This is done when the right operand is scaled, and
+ *		when the left operand is a variable kept in a register,
+ *		which would otherwise first have to be copied.  Return
+ *		false, having generated nothing, if neither is the case.
+ */
+
+static bool combine(Expression *result, Expression *left, Expression *right)
+{
+    Expression *index, *factor;
+    const Symbol *symbol;
+    unsigned long value;
+    unsigned bytes, scale;
+    Register *reg;
+    long disp;
+
+
+    bytes = size(result);
+    index = nullptr;
+    scale = 1;
+    disp = 0;
+
+    if (size(left) != bytes || size(right) != bytes)
+	return false;
+
+    if (right->isMultiply(index, factor) && factor->isNumber(value)
+	    && (value == 2 || value == 4 || value == 8))
+	scale = value;
+    else if (left->isIdentifier(symbol) && location(left).isReg()) {
+	if (right->isNumber(value)
+		&& Operand::immediate(value, bytes).isSmall())
+	    disp = value;
+	else
+	    index = right;
+    } else
+	return false;
+
+    left->generate();
+
+    if (left->_register == nullptr && !location(left).isReg())
+	load(left, getreg());
+
+    reg = getreg();
+
+    if (index != nullptr) {
+	index->generate();
+
+	if (index->_register == nullptr && !location(index).isReg())
+	    load(index, getreg());
+
+	emit(LEA, bytes, Operand::memory(location(left)._base,
+	    location(index)._base, scale, disp, bytes), Operand(reg, bytes));
+	assign(index, nullptr);
+
+    } else
+	emit(LEA, bytes, Operand::memory(location(left)._base, disp, bytes),
+	    Operand(reg, bytes));
+
+    assign(left, nullptr);
+    assign(result, reg);
+    return true;
+}
+
+
+/*
+ * Function:	Add::generate
+ *
+ * Description:	Generate code for an addition expression, using lea when
+ *		it saves an instruction.
+ */
+
+void Add::generate()
+{
+    if (combine(this, _left, _right) || combine(this, _right, _left))
+	return;
+
+    arithmetic(this, _left, _right, ADD);
+}
+
+
+/*
+ * Function:	Subtract::generate
+ *
+ * Description:	Generate code for a subtraction expression.
+ */
+
+void Subtract::generate()
+{
+    arithmetic(this, _left, _right, SUB);
+}
+
+
+/*
+ * Function:	immediate (private)
+ *
+ * Description:	Return an immediate operand for the given value, first
+ *		loading it into a register if it does not fit in 32 bits.
+ */
+
+static Operand immediate(long value, unsigned bytes)
+{
+    Operand op = Operand::immediate(value, bytes);
+
+    if (!op.isSmall()) {
+	op = Operand(getreg(), bytes);
+	emit(MOV, bytes, Operand::immediate(value, bytes), op);
+    }
+
+    return op;
+}
+
+
+/*
+ * Function:	scalable
+ *
+ * Description:	Return whether a constant is of the form 2^k, 3*2^k, 5*2^k,
+ *		or 9*2^k, so that multiplication by it can use lea and shl
+ *		instead of imul.  Most of these come from scaling array
+ *		indices.
+ */
+
+bool scalable(long value)
+{
+    if (value <= 1)
+	return false;
+
+    while (value % 2 == 0)
+	value /= 2;
+
+    return value == 1 || value == 3 || value == 5 || value == 9;
+}
+
+
+/*
+ * Function:	scale
+ *
+ * Description:	Generate code to multiply the value in the given register
+ *		in place by a scalable constant.
+ */
+
+void scale(Register *reg, long value, unsigned bytes)
+{
+    unsigned shift = 0;
+
+
+    while (value % 2 == 0) {
+	value /= 2;
+	shift ++;
+    }
+
+    if (value > 1)
+	emit(LEA, bytes, Operand::memory(reg, reg, value - 1, 0, bytes),
+	    Operand(reg, bytes));
+
+    if (shift > 0)
+	emit(SHL, bytes, Operand::immediate(shift, 1), Operand(reg, bytes));
+}
+
+
+/*
+ * Function:	scale (private)
+ *
+ * Description:	Generate code for a multiplication of an expression by a
+ *		constant using lea and shl, if possible.
+ */
+
+static bool scale(Expression *result, Expression *expr, long value)
+{
+    if (!scalable(value))
+	return false;
+
+    expr->generate();
+
+    if (expr->_register == nullptr)
+	load(expr, getreg());
+
+    scale(expr->_register, value, size(expr));
+    assign(result, expr->_register);
+    return true;
+}
+
+
+/*
+ * Function:	multiply (private)
+ *
+ * Description:	Generate code for a multiplication of an expression by a
+ *		constant using the three-operand form of imul, which reads
+ *		the expression from a register or memory and writes the
+ *		product to a new register.
+ */
+
+static bool multiply(Expression *result, Expression *expr, long value)
+{
+    Expression *base, *index;
+    unsigned long constant;
+    unsigned bytes;
+    Operand op;
+
+
+    bytes = size(result);
+
+    if (expr->isNumber(constant) || size(expr) != bytes)
+	return false;
+
+    if (!Operand::immediate(value, bytes).isSmall())
+	return false;
+
+    op = fold(expr, base, index);
+    assign(result, getreg());
+
+    emit(IMUL, bytes, Operand::immediate(value, bytes), op);
+    code.back()._operands.push_back(location(result));
+
+    release(base, index);
+    return true;
+}
+
+
+/*
+ * Function:	Multiply::generate
+ *
+ * Description:	Generate code for a multiplication expression.
+ */
+
+void Multiply::generate()
+{
+    unsigned long value;
+
+    if (_right->isNumber(value) && scale(this, _left, value))
+	return;
+
+    if (_left->isNumber(value) && scale(this, _right, value))
+	return;
+
+    if (_right->isNumber(value) && multiply(this, _left, value))
+	return;
+
+    if (_left->isNumber(value) && multiply(this, _right, value))
+	return;
+
+    arithmetic(this, _left, _right, IMUL);
+}
+
+
+/*
+ * Function:	magic (private)
+ *
+ * Description:	Compute the magic number and shift amount for signed
+ *		division by the given constant, which is neither zero nor
+ *		a power of two, using the algorithm in Warren's "Hacker's
+ *		Delight" (section 10-4).  The arithmetic is done modulo 2^N
+ *		for an N-bit division.
+ */
+
+static void magic(long d, unsigned bits, long &multiplier, unsigned &shift)
+{
+    unsigned long mask, two, ad, anc, t, q1, r1, q2, r2, delta;
+    unsigned p;
+
+
+    mask = bits == 64 ? ~0UL : (1UL << bits) - 1;
+    two = 1UL << (bits - 1);
+
+    ad = (d < 0 ? -(unsigned long) d : d) & mask;
+    t = two + (((unsigned long) d & mask) >> (bits - 1));
+    anc = t - 1 - t % ad;
+    p = bits - 1;
+    q1 = two / anc;
+    r1 = two - q1 * anc;
+    q2 = two / ad;
+    r2 = two - q2 * ad;
+
+    do {
+	p ++;
+	q1 = (2 * q1) & mask;
+	r1 = (2 * r1) & mask;
+
+	if (r1 >= anc) {
+	    q1 = (q1 + 1) & mask;
+	    r1 = (r1 - anc) & mask;
+	}
+
+	q2 = (2 * q2) & mask;
+	r2 = (2 * r2) & mask;
+
+	if (r2 >= ad) {
+	    q2 = (q2 + 1) & mask;
+	    r2 = (r2 - ad) & mask;
+	}
+
+	delta = (ad - r2) & mask;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    multiplier = (q2 + 1) & mask;
+
+    if (d < 0)
+	multiplier = -multiplier & mask;
+
+    if (bits == 32)
+	multiplier = (int) multiplier;
+
+    shift = p - bits;
+}
+
+
+/*
+ * Function:	quotient (private)
+ *
+ * Description:	Generate code to divide the value in the given register by
+ *		a constant that is not a power of two, and return the
+ *		register holding the quotient.  The high half of the
+ *		product of the dividend and the magic number, after the
+ *		appropriate corrections, is shifted right and then rounded
+ *		toward zero by adding one if it is negative.
+ */
+
+static Register *quotient(Register *n, long d, unsigned bytes)
+{
+    unsigned bits = bytes * 8, shift;
+    Register *q, *sign;
+    long m;
+
+
+    magic(d, bits, m, shift);
+
+    emit(MOV, bytes, Operand::immediate(m, bytes), Operand(rax, bytes));
+    emit(IMUL, bytes, Operand(n, bytes));
+
+    q = getreg();
+    emit(MOV, bytes, Operand(rdx, bytes), Operand(q, bytes));
+
+    if (d > 0 && m < 0)
+	emit(ADD, bytes, Operand(n, bytes), Operand(q, bytes));
+    else if (d < 0 && m > 0)
+	emit(SUB, bytes, Operand(n, bytes), Operand(q, bytes));
+
+    if (shift > 0)
+	emit(SAR, bytes, Operand::immediate(shift, 1), Operand(q, bytes));
+
+    sign = getreg();
+    emit(MOV, bytes, Operand(q, bytes), Operand(sign, bytes));
+    emit(SHR, bytes, Operand::immediate(bits - 1, 1), Operand(sign, bytes));
+    emit(ADD, bytes, Operand(sign, bytes), Operand(q, bytes));
+
+    return q;
+}
+
+
+/*
+ * Function:	reciprocal
+ *
+ * Description:	Generate code for a division or remainder of the value in
+ *		the given register by a nonzero constant without using
+ *		idiv, and return the register holding the result.
+ *		Division by a power of two is a shift after adding 2^k-1 to
+ *		a negative dividend so that it rounds toward zero, and the
+ *		remainder is what is left after clearing the low bits of
+ *		the same sum.  Any other divisor uses a magic
+ *		multiplication.  The remainder is always the dividend minus
+ *		the rounded-off multiple of the divisor, which is computed
+ *		in place.
+ */
+
+Register *reciprocal(Register *n, long d, unsigned bytes, bool remainder)
+{
+    unsigned bits = bytes * 8, k;
+    unsigned long ad = d < 0 ? -(unsigned long) d : d;
+    Register *q;
+
+
+    if (ad == 1) {
+	if (remainder)
+	    emit(MOV, bytes, Operand::immediate(0, bytes), Operand(n, bytes));
+	else if (d < 0)
+	    emit(NEG, bytes, Operand(n, bytes));
+
+	return n;
+    }
+
+    if ((ad & (ad - 1)) == 0) {
+	for (k = 0; (1UL << k) != ad; k ++)
+	    ;
+
+	q = getreg();
+	emit(MOV, bytes, Operand(n, bytes), Operand(q, bytes));
+	emit(SAR, bytes, Operand::immediate(bits - 1, 1), Operand(q, bytes));
+	emit(SHR, bytes, Operand::immediate(bits - k, 1), Operand(q, bytes));
+	emit(ADD, bytes, Operand(n, bytes), Operand(q, bytes));
+
+	if (remainder)
+	    emit(AND, bytes, immediate(-ad, bytes), Operand(q, bytes));
+	else {
+	    emit(SAR, bytes, Operand::immediate(k, 1), Operand(q, bytes));
+
+	    if (d < 0)
+		emit(NEG, bytes, Operand(q, bytes));
+	}
+
+    } else {
+	q = quotient(n, d, bytes);
+
+	if (remainder)
+	    emit(IMUL, bytes, immediate(d, bytes), Operand(q, bytes));
+    }
+
+    if (remainder) {
+	emit(SUB, bytes, Operand(q, bytes), Operand(n, bytes));
+	return n;
+    }
+
+    return q;
+}
+
+
+/*
+ * Function:	reciprocal (private)
+ *
+ * Description:	Generate code for a division or remainder expression whose
+ *		divisor is a nonzero constant.
+ */
+
+static void reciprocal(Expression *result, Expression *left, long d,
+	bool remainder)
+{
+    Register *reg;
+
+    left->generate();
+
+    if (left->_register == nullptr)
+	load(left, getreg());
+
+    reg = reciprocal(left->_register, d, size(left), remainder);
+
+    if (reg != left->_register)
+	assign(left, nullptr);
+
+    assign(result, reg);
+}
+
+
+/*
+ * Function:	divide (private)
+ *
+ * Description:	Generate code for a division or remainder expression.  The
+ *		dividend must be in %rax and is sign extended into %rdx, and
+ *		the quotient and remainder are left in %rax and %rdx.  The
+ *		divisor cannot be an immediate, but a constant divisor
+ *		never needs idiv at all.
+ */
+
+static void divide(Expression *result, Expression *left, Expression *right,
+	Register *reg)
+{
+    unsigned bytes = size(left);
+    unsigned long value;
+
+
+    if (right->isNumber(value) && value != 0 && value != 1UL << 63) {
+	reciprocal(result, left, value, reg == rdx);
+	return;
+    }
+
+    left->generate();
+    right->generate();
+
+    if (right->_register == nullptr && location(right).isImm())
+	load(right, getreg());
+
+    emit(MOV, bytes, location(left), Operand(rax, bytes));
+    emit(CVT, bytes);
+    emit(IDIV, bytes, location(right));
+
+    assign(left, nullptr);
+    assign(right, nullptr);
+
+    assign(result, getreg());
+    emit(MOV, bytes, Operand(reg, bytes), location(result));
+}
+
+
+/*
+ * Function:	Divide::generate
+ *
+ * Description:	Generate code for a division expression.
+ */
+
+void Divide::generate()
+{
+    divide(this, _left, _right, rax);
+}
+
+
+/*
+ * Function:	Remainder::generate
+ *
+ * Description:	Generate code for a remainder expression.
+ */
+
+void Remainder::generate()
+{
+    divide(this, _left, _right, rdx);
+}
+
+
+/*
+ * Function:	compare (private)
+ *
+ * Description:	Generate code to compare the operands of a relational or
+ *		equality expression, setting the condition codes.  Either
+ *		operand may be folded from memory, the left one only if
+ *		the right one is a small constant.
+ */
+
+static void compare(Expression *left, Expression *right)
+{
+    Expression *base, *index;
+    unsigned long value;
+    Operand op;
+
+
+    if (right->isNumber(value)
+	    && Operand::immediate(value, size(left)).isSmall()) {
+	op = fold(left, base, index);
+
+	if (op.isImm()) {
+	    load(left, getreg());
+	    op = location(left);
+	}
+
+	emit(CMP, size(left), Operand::immediate(value, size(left)), op);
+	release(base, index);
+	return;
+    }
+
+    left->generate();
+    op = fold(right, base, index);
+
+    if (left->_register == nullptr && !location(left).isReg())
+	load(left, getreg());
+
+    emit(CMP, size(left), op, location(left));
+
+    release(base, index);
+    assign(left, nullptr);
+}
+
+
+/*
+ * Function:	compare (private)
+ *
+ * Description:	Generate code for a relational or equality expression,
+ *		which produces either zero or one.
+ */
+
+static void compare(Expression *result, Expression *left, Expression *right,
+	Condition cond)
+{
+    compare(left, right);
+
+    assign(result, getreg());
+    emit(SET, cond, Operand(result->_register, 1));
+    emit(MOVZ, SIZEOF_INT, Operand(result->_register, 1), location(result));
+}
+
+
+/*
+ * Function:	compare (private)
+ *
+ * Description:	Generate code for a relational or equality expression that
+ *		is only used to branch, which needs no result at all.
+ */
+
+static void compare(Expression *left, Expression *right, Condition cond,
+	const Label &label, bool ifTrue)
+{
+    compare(left, right);
+    jump(ifTrue ? cond : invert(cond), label);
+}
+
+
+/*
+ * Function:	LessThan::generate
+ *
+ * Description:	Generate code for a less-than expression.
+ */
+
+void LessThan::generate()
+{
+    compare(this, _left, _right, CC_L);
+}
+
+
+/*
+ * Function:	LessThan::test
+ *
+ * Description:	Generate code to branch on a less-than expression.
+ */
+
+void LessThan::test(const Label &label, bool ifTrue)
+{
+    compare(_left, _right, CC_L, label, ifTrue);
+}
+
+
+/*
+ * Function:	LessOrEqual::generate
+ *
+ * Description:	Generate code for a less-than-or-equal expression.
+ */
+
+void LessOrEqual::generate()
+{
+    compare(this, _left, _right, CC_LE);
+}
+
+
+/*
+ * Function:	LessOrEqual::test
+ *
+ * Description:	Generate code to branch on a less-than-or-equal expression.
+ */
+
+void LessOrEqual::test(const Label &label, bool ifTrue)
+{
+    compare(_left, _right, CC_LE, label, ifTrue);
+}
+
+
+/*
+ * Function:	GreaterThan::generate
+ *
+ * Description:	Generate code for a greater-than expression.
+ */
+
+void GreaterThan::generate()
+{
+    compare(this, _left, _right, CC_G);
+}
+
+
+/*
+ * Function:	GreaterThan::test
+ *
+ * Description:	Generate code to branch on a greater-than expression.
+ */
+
+void GreaterThan::test(const Label &label, bool ifTrue)
+{
+    compare(_left, _right, CC_G, label, ifTrue);
+}
+
+
+/*
+ * Function:	GreaterOrEqual::generate
+ *
+ * Description:	Generate code for a greater-than-or-equal expression.
+ */
+
+void GreaterOrEqual::generate()
+{
+    compare(this, _left, _right, CC_GE);
+}
+
+
+/*
+ * Function:	GreaterOrEqual::test
+ *
+ * Description:	Generate code to branch on a greater-than-or-equal expression.
+ */
+
+void GreaterOrEqual::test(const Label &label, bool ifTrue)
+{
+    compare(_left, _right, CC_GE, label, ifTrue);
+}
+
+
+/*
+ * Function:	Equal::generate
+ *
+ * Description:	Generate code for an equality expression.
+ */
+
+void Equal::generate()
+{
+    compare(this, _left, _right, CC_E);
+}
+
+
+/*
+ * Function:	Equal::test
+ *
+ * Description:	Generate code to branch on a equality expression.
+ */
+
+void Equal::test(const Label &label, bool ifTrue)
+{
+    compare(_left, _right, CC_E, label, ifTrue);
+}
+
+
+/*
+ * Function:	NotEqual::generate
+ *
+ * Description:	Generate code for an inequality expression.
+ */
+
+void NotEqual::generate()
+{
+    compare(this, _left, _right, CC_NE);
+}
+
+
+/*
+ * Function:	NotEqual::test
+ *
+ * Description:	Generate code to branch on a inequality expression.
+ */
+
+void NotEqual::test(const Label &label, bool ifTrue)
+{
+    compare(_left, _right, CC_NE, label, ifTrue);
+}
+
+
+/*
+ * Function:	Not::generate
+ *
+ * Description:	Generate code for a logical negation expression.
+ */
+
+void Not::generate()
+{
+    _expr->generate();
+
+    if (_expr->_register == nullptr)
+	load(_expr, getreg());
+
+    emit(CMP, size(_expr), Operand::immediate(0, size(_expr)), location(_expr));
+    assign(_expr, nullptr);
+
+    assign(this, getreg());
+    emit(SET, CC_E, Operand(_register, 1));
+    emit(MOVZ, SIZEOF_INT, Operand(_register, 1), location(this));
+}
+
+
+/*
+ * Function:	Not::test
+ *
+ * Description:	Generate code to branch on a logical negation expression,
+ *		which is just branching on the operand the other way.
+ */
+
+void Not::test(const Label &label, bool ifTrue)
+{
+    _expr->test(label, !ifTrue);
+}
+
+
+/*
+ * Function:	Negate::generate
+ *
+ * Description:	Generate code for an arithmetic negation expression.
+ */
+
+void Negate::generate()
+{
+    _expr->generate();
+
+    if (_expr->_register == nullptr)
+	load(_expr, getreg());
+
+    emit(NEG, size(_expr), location(_expr));
+    assign(this, _expr->_register);
+}
+
+
+/*
+ * Function:	While::generate
+ *
+ * Description:	Generate code for a while statement.  A rotated loop has
+ *		its test at the bottom, where it branches back to the top,
+ *		and a copy of the test in front to skip the loop entirely.
+ */
+
+void While::generate()
+{
+    Label loop, exit;
+
+    increment(_counter);
+
+    if (rotated) {
+	_expr->test(exit, false);
+	head(loop, executed(_counter + 1));
+
+	increment(_counter + 1);
+	_stmt->generate();
+	_expr->test(loop, true);
+
+    } else {
+	head(loop, executed(_counter + 1));
+
+	_expr->test(exit, false);
+	increment(_counter + 1);
+	_stmt->generate();
+
+	jump(loop);
+    }
+
+    emit(exit);
+}
+
+
+/*
+ * Function:	counted (private)
+ *
+ * Description:	Return whether a for statement counts a local integer
+ *		variable upward from one constant to another by a constant
+ *		step, and if so, the number of times the loop is executed.
+ *		The variable must not be assigned by the body of the loop
+ *		nor have its address taken anywhere in the function.
+ */
+
+static bool counted(Statement *init, Expression *expr, Statement *incr,
+	Statement *stmt, unsigned long &trips)
+{
+    Expression *left, *right, *sum;
+    const Symbol *symbol, *id;
+    unsigned long first, last, step;
+    bool inclusive;
+
+
+    if (!init->isAssignment(left, right) || !right->isNumber(first))
+	return false;
+
+    if (!left->isIdentifier(symbol) || symbol->_offset == 0)
+	return false;
+
+    if (symbol->type().size() < SIZEOF_INT || symbol->type().isPointer())
+	return false;
+
+    if (expr->isLessThan(left, right))
+	inclusive = false;
+    else if (expr->isLessOrEqual(left, right))
+	inclusive = true;
+    else
+	return false;
+
+    if (!left->isIdentifier(id) || id != symbol || !right->isNumber(last))
+	return false;
+
+    if (!incr->isAssignment(left, sum) || !left->isIdentifier(id))
+	return false;
+
+    if (id != symbol || !sum->isAdd(left, right) || !right->isNumber(step))
+	return false;
+
+    if (!left->isIdentifier(id) || id != symbol)
+	return false;
+
+    if (first > INT_MAX / 2 || last > INT_MAX / 2 || step > INT_MAX / 2)
+	return false;
+
+    if (step == 0 || stmt->modifies(symbol, true))
+	return false;
+
+    if (function->modifies(symbol, false))
+	return false;
+
+    if (inclusive)
+	last ++;
+
+    trips = first < last ? (last - first + step - 1) / step : 0;
+    return true;
+}
+
+
+/*
+ * Function:	subscript (private)
+ *
+ * Description:	Return whether an expression is an element of an array of
+ *		integers indexed by the given variable, and if so, the
+ *		expression for the start of the array.  The start must be
+ *		an array or a local pointer whose address is never taken,
+ *		so that it cannot change while the loop runs.
+ */
+
+static bool subscript(Expression *expr, const Symbol *counter,
+	Expression *&base)
+{
+    Expression *pointer, *scaled, *index, *factor, *array;
+    const Symbol *symbol;
+    unsigned long value;
+
+
+    if (!expr->type().isNumeric() || expr->type().size() < SIZEOF_INT)
+	return false;
+
+    if (!expr->isDereference(pointer) || !pointer->isAdd(base, scaled))
+	return false;
+
+    if (!scaled->isMultiply(index, factor) || !factor->isNumber(value))
+	return false;
+
+    if (value != expr->type().size())
+	return false;
+
+    if (index->isCast(array))
+	index = array;
+
+    if (!index->isIdentifier(symbol) || symbol != counter)
+	return false;
+
+    if (base->isAddress(array))
+	return array->isIdentifier(symbol);
+
+    if (!base->isIdentifier(symbol) || symbol->_offset == 0)
+	return false;
+
+    return !function->modifies(symbol, false);
+}
 
 
 /*
- * Function:	Assignment::generate
- *
- * Description:	Generate code for an assignment statement.
+ * Function:	overlap (private)
  *
- *		NOT FINISHED: Only works if the right-hand side is an
- *		integer literal and the left-hand side is an integer
- *		scalar.
+ * Description:	Generate code to branch to the given label if the source
+ *		array starts less than one vector before the target array.
+ *		Only then would a scalar loop read an element that it
+ *		wrote in an earlier iteration of the same vector.  Two
+ *		different arrays never overlap, and an array never
+ *		overlaps itself.
  */
 
-void Assignment::generate()
+static void overlap(Expression *target, Expression *source,
+	const Label &label)
 {
-    //assert(dynamic_cast<Identifier *>(_left));
-    Expression *pointer;
+    Expression *first, *second;
+    const Symbol *symbol, *other;
+    Register *reg;
+    Label skip;
 
-    _right->generate();
 
-    if(_left->isDereference(pointer)) {
-        pointer->generate();
+    if (target->isAddress(first) && source->isAddress(second))
+	if (first->isIdentifier(symbol) && second->isIdentifier(other))
+	    return;
 
-        if(pointer->_register == nullptr) {
-            load(pointer, getreg());
-        }
-        if(_right->_register == nullptr) {
-            load(_right, getreg());
-        }
+    reg = getreg();
+    emit(MOV, SIZEOF_PTR, location(target), Operand(reg, SIZEOF_PTR));
+    emit(SUB, SIZEOF_PTR, location(source), Operand(reg, SIZEOF_PTR));
+    emit(CMP, SIZEOF_PTR, Operand::immediate(0, SIZEOF_PTR),
+	Operand(reg, SIZEOF_PTR));
+    jump(CC_LE, skip);
 
-        cout << "\tmov" << suffix(_right) << _right;
-        cout << ", " << "(" << pointer << ")" << endl;
+    emit(CMP, SIZEOF_PTR, Operand::immediate(SIZEOF_VECTOR, SIZEOF_PTR),
+	Operand(reg, SIZEOF_PTR));
+    jump(CC_L, label);
+    emit(skip);
+}
 
-        assign(_right, nullptr);
-        assign(pointer, nullptr);
 
-    } else {
-        if(_right->_register == nullptr) {
-            load(_right, getreg());
-        }
-        
-        cout << "\tmov" << suffix(_right) << _right;
-        cout << ", " << _left << endl;
-        
-        assign(_right, nullptr);
-        assign(_left, nullptr);
-    }
-    
-}
+/*
+ * Function:	vectorize (private)
+ *
+ * Description:	Generate a vectorized loop for a for statement of the form
+ *		for (i = 0; i < n; i = i + 1) a[i] = b[i] op c[i], where
+ *		the arrays hold ints or longs and op is addition,
+ *		subtraction, or, for ints only, multiplication or a
+ *		less-than or greater-than comparison, none of which SSE2
+ *		has for longs.  The counter must be a local variable whose
+ *		address is never taken, and the bound a constant or such a
+ *		variable.  The vectorized loop does as many whole vectors
+ *		as it can and then leaves the counter at the first element
+ *		not yet done, so that the original loop finishes up any
+ *		remaining elements.  Return false if the loop is not of
+ *		this form and so nothing was generated.
+ */
 
-void Add::generate()
+static bool vectorize(Statement *init, Expression *expr, Statement *incr,
+	Statement *stmt)
 {
-    _left->generate();
-    _right->generate();
-    if (_left->_register == nullptr) {
-        load(_left, getreg());
-    }
-    cout << "\tadd" << suffix(_left);
-    cout << _right << ", " << _left << endl;
-    assign(_right, nullptr);
-    assign(this, _left->_register);
-}
+    Expression *counter, *left, *right, *bound, *sum, *target, *value;
+    Expression *bases[3];
+    const Symbol *symbol, *id;
+    unsigned long number;
+    unsigned bytes, lanes;
+    Register *index, *limit, *result;
+    Operand operands[3];
+    Opcode opcode;
+    Label loop, exit;
 
-void Subtract::generate()
-{
-    _left->generate();
-    _right->generate();
-    if (_left->_register == nullptr) {
-        load(_left, getreg());
-    }
-    cout << "\tsub" << suffix(_left);
-    cout << _right << ", " << _left << endl;
-    assign(_right, nullptr);
-    assign(this, _left->_register);
-}
 
-void Multiply::generate()
-{
-    _left->generate();
-    _right->generate();
-    if (_left->_register == nullptr) {
-        load(_left, getreg());
-    }
-    cout << "\timul" << suffix(_left);
-    cout << _right << ", " << _left << endl;
-    assign(_right, nullptr);
-    assign(this, _left->_register);
-}
+    if (!init->isAssignment(counter, right) || !right->isNumber(number))
+	return false;
 
-void Divide::generate()
-{
-    _left->generate();
-    _right->generate();
+    if (!counter->isIdentifier(symbol) || symbol->_offset == 0 || number != 0)
+	return false;
 
-    if (_left->_register == nullptr) {
-        load(_left, rax);
-    }
+    if (!symbol->type().isNumeric() || symbol->type().size() < SIZEOF_INT)
+	return false;
 
-    load(nullptr, rdx);
+    if (!expr->isLessThan(left, bound) || !left->isIdentifier(id))
+	return false;
 
-    if (_right->_register == nullptr) {
-        load(_right, rcx);
-    }
+    if (id != symbol || bound->type() != symbol->type())
+	return false;
 
-    if(_left->type().size() == 4) {
-        cout << "\tcltd" << endl;
-    } else {
-        cout << "\tcqto" << endl;
-    }
+    if (bound->isIdentifier(id))
+	if (id == symbol || id->_offset == 0 || function->modifies(id, false))
+	    return false;
 
-    cout << "\tidiv" << suffix(_right);
-    cout << _right << endl;
+    if (!bound->isIdentifier(id) && !bound->isNumber(number))
+	return false;
 
-    assign(_right, nullptr);
-    assign(_left, nullptr);
+    if (!incr->isAssignment(left, sum) || !left->isIdentifier(id))
+	return false;
 
-    assign(this, rax);
-}
+    if (id != symbol || !sum->isAdd(left, right) || !left->isIdentifier(id))
+	return false;
 
-void Remainder::generate()
-{
-    _left->generate();
-    _right->generate();
+    if (id != symbol || !right->isNumber(number) || number != 1)
+	return false;
 
-    if (_left->_register == nullptr) {
-        load(_left, rax);
-    }
+    if (function->modifies(symbol, false))
+	return false;
 
-    load(nullptr, rdx);
+    if (!stmt->isAssignment(target, value))
+	return false;
 
-    if (_right->_register == nullptr) {
-        load(_right, rcx);
-    }
+    if (!subscript(target, symbol, bases[0]))
+	return false;
 
-    if(_left->type().size() == 4) {
-        cout << "\tcltd" << endl;
-    } else {
-        cout << "\tcqto" << endl;
-    }
+    bytes = target->type().size();
+    lanes = SIZEOF_VECTOR / bytes;
 
-    cout << "\tidiv" << suffix(_right);
-    cout << _right << endl;
+    if (value->isAdd(left, right))
+	opcode = PADD;
+    else if (value->isSubtract(left, right))
+	opcode = PSUB;
+    else if (value->isMultiply(left, right) && bytes == SIZEOF_INT)
+	opcode = PMULUDQ;
+    else if (value->isGreaterThan(left, right) && bytes == SIZEOF_INT)
+	opcode = PCMPGT;
+    else if (value->isLessThan(right, left) && bytes == SIZEOF_INT)
+	opcode = PCMPGT;
+    else
+	return false;
 
-    assign(_right, nullptr);
-    assign(_left, nullptr);
+    if (left->type() != target->type() || right->type() != target->type())
+	return false;
 
-    assign(this, rdx);
-}
+    if (!subscript(left, symbol, bases[1]))
+	return false;
 
-void LessThan::generate() {
-    _left->generate();
-    _right->generate();
+    if (!subscript(right, symbol, bases[2]))
+	return false;
 
-    if (_left->_register == nullptr) {
-        load(_left, getreg());
-    }
 
-    cout << "\tcmp" << suffix(_left);
-    cout << _right << ", " << _left << endl;
+    /* Compute the start of each array and the number of elements. */
 
-    assign(_right, nullptr);
-    assign(_left, nullptr);
+    for (unsigned i = 0; i < 3; i ++) {
+	bases[i]->generate();
 
-    assign(this, getreg());
+	if (bases[i]->_register == nullptr)
+	    load(bases[i], getreg());
+    }
 
-    string byteRegister = getreg()->byte();
-    cout << "\tsetl\t" << byteRegister << endl;
+    limit = getreg();
 
-    cout << "\tmovzbl\t" << byteRegister << ", " << this << endl; 
+    if (bound->isNumber(number))
+	emit(MOV, SIZEOF_LONG, Operand::immediate(number, SIZEOF_LONG),
+	    Operand(limit, SIZEOF_LONG));
+    else if (bound->type().size() < SIZEOF_LONG)
+	emit(MOVS, SIZEOF_LONG, location(bound), Operand(limit, SIZEOF_LONG));
+    else
+	emit(MOV, SIZEOF_LONG, location(bound), Operand(limit, SIZEOF_LONG));
+
+    overlap(bases[0], bases[1], exit);
+    overlap(bases[0], bases[2], exit);
+
+
+    /* Run the loop while there is still a whole vector left. */
+
+    index = getreg();
+    emit(MOV, SIZEOF_LONG, Operand::immediate(0, SIZEOF_LONG),
+	Operand(index, SIZEOF_LONG));
+    emit(SUB, SIZEOF_LONG, Operand::immediate(lanes - 1, SIZEOF_LONG),
+	Operand(limit, SIZEOF_LONG));
+    emit(CMP, SIZEOF_LONG, Operand(limit, SIZEOF_LONG),
+	Operand(index, SIZEOF_LONG));
+    jump(CC_GE, exit);
+
+    for (unsigned i = 0; i < 3; i ++)
+	operands[i] = Operand::memory(bases[i]->_register, index, bytes, 0,
+	    SIZEOF_VECTOR);
+
+    head(loop, true);
+    emit(MOVDQU, SIZEOF_VECTOR, operands[1], Operand(xmm0, SIZEOF_VECTOR));
+    emit(MOVDQU, SIZEOF_VECTOR, operands[2], Operand(xmm1, SIZEOF_VECTOR));
+    result = xmm0;
+
+    if (opcode == PMULUDQ) {
+	emit(MOVDQA, SIZEOF_VECTOR, Operand(xmm0, SIZEOF_VECTOR),
+	    Operand(xmm2, SIZEOF_VECTOR));
+	emit(PMULUDQ, SIZEOF_LONG, Operand(xmm1, SIZEOF_VECTOR),
+	    Operand(xmm0, SIZEOF_VECTOR));
+	emit(PSRL, SIZEOF_LONG, Operand::immediate(32, 1),
+	    Operand(xmm2, SIZEOF_VECTOR));
+	emit(PSRL, SIZEOF_LONG, Operand::immediate(32, 1),
+	    Operand(xmm1, SIZEOF_VECTOR));
+	emit(PMULUDQ, SIZEOF_LONG, Operand(xmm1, SIZEOF_VECTOR),
+	    Operand(xmm2, SIZEOF_VECTOR));
+
+	emit(PSHUFD, bytes, Operand::immediate(8, 1),
+	    Operand(xmm0, SIZEOF_VECTOR));
+	code.back()._operands.push_back(Operand(xmm0, SIZEOF_VECTOR));
+	emit(PSHUFD, bytes, Operand::immediate(8, 1),
+	    Operand(xmm2, SIZEOF_VECTOR));
+	code.back()._operands.push_back(Operand(xmm2, SIZEOF_VECTOR));
+
+	emit(PUNPCKL, bytes, Operand(xmm2, SIZEOF_VECTOR),
+	    Operand(xmm0, SIZEOF_VECTOR));
+
+    } else if (opcode == PCMPGT) {
+	emit(PCMPGT, bytes, Operand(xmm1, SIZEOF_VECTOR),
+	    Operand(xmm0, SIZEOF_VECTOR));
+	emit(PXOR, bytes, Operand(xmm1, SIZEOF_VECTOR),
+	    Operand(xmm1, SIZEOF_VECTOR));
+	emit(PSUB, bytes, Operand(xmm0, SIZEOF_VECTOR),
+	    Operand(xmm1, SIZEOF_VECTOR));
+	result = xmm1;
+
+    } else
+	emit(opcode, bytes, Operand(xmm1, SIZEOF_VECTOR),
+	    Operand(xmm0, SIZEOF_VECTOR));
+
+    emit(MOVDQU, SIZEOF_VECTOR, Operand(result, SIZEOF_VECTOR), operands[0]);
+    emit(ADD, SIZEOF_LONG, Operand::immediate(lanes, SIZEOF_LONG),
+	Operand(index, SIZEOF_LONG));
+    emit(CMP, SIZEOF_LONG, Operand(limit, SIZEOF_LONG),
+	Operand(index, SIZEOF_LONG));
+    jump(CC_L, loop);
+
+    emit(MOV, size(counter), Operand(index, size(counter)),
+	location(counter));
+    emit(exit);
+
+    for (unsigned i = 0; i < 3; i ++)
+	assign(bases[i], nullptr);
+
+    return true;
 }
 
-void LessOrEqual::generate() {
-    _left->generate();
-    _right->generate();
-
-    if (_left->_register == nullptr) {
-        load(_left, getreg());
-    }
 
-    cout << "\tcmp" << suffix(_left);
-    cout << _right << ", " << _left << endl;
+/*
+ * Function:	measure (private)
+ *
+ * Description:	Return the number of instructions in one iteration of a
+ *		loop, which is found by generating it and then throwing the
+ *		code away.
+ */
 
-    assign(_right, nullptr);
-    assign(_left, nullptr);
+static unsigned measure(Statement *stmt, Statement *incr)
+{
+    unsigned start, rest, count;
 
-    assign(this, getreg());
 
-    string byteRegister = getreg()->byte();
+    start = code.size();
+    rest = cold.size();
 
-    cout << "\tsetle\t" << byteRegister << endl;
+    stmt->generate();
+    incr->generate();
 
-    cout << "\tmovzbl\t" << byteRegister << ", " << this << endl; 
+    count = code.size() - start + cold.size() - rest;
+    code.erase(code.begin() + start, code.end());
+    cold.erase(cold.begin() + rest, cold.end());
+    return count;
 }
 
-void GreaterThan::generate() {
-    _left->generate();
-    _right->generate();
 
-    if (_left->_register == nullptr) {
-        load(_left, getreg());
-    }
+/*
+ * Function:	unrolling (private)
+ *
+ * Description:	Return how many times to unroll a counted loop with the
+ *		given counters and body, which is the number given on the
+ *		command line unless there is a profile.  Then a loop whose
+ *		body was never executed is not unrolled at all, and a loop
+ *		that went around several times each time it was reached is
+ *		unrolled at least that many times.  Either way, a loop
+ *		containing another loop is never unrolled, since the
+ *		copies would multiply with each level of nesting, and the
+ *		unrolled body is kept within a limited number of
+ *		instructions.
+ */
 
-    cout << "\tcmp" << suffix(_left);
-    cout << _right << ", " << _left << endl;
+static unsigned unrolling(unsigned counter, Statement *stmt, Statement *incr)
+{
+    unsigned long reached, iterations;
+    unsigned factor;
 
-    assign(_right, nullptr);
-    assign(_left, nullptr);
 
-    assign(this, getreg());
+    factor = unroll;
 
-    string byteRegister = getreg()->byte();
+    if (isProfiled()) {
+	reached = frequency(counter);
+	iterations = frequency(counter + 1);
 
-    cout << "\tsetg\t" << byteRegister << endl;
+	if (iterations == 0)
+	    return 1;
 
-    cout << "\tmovzbl\t" << byteRegister << ", " << this << endl; 
+	if (iterations >= PROFILE_TRIPS * reached)
+	    factor = max(factor, (unsigned) PROFILE_TRIPS);
+    }
+
+    if (factor == 1 || stmt->hasLoop())
+	return 1;
+
+    return min(factor, max(UNROLL_LIMIT / max(measure(stmt, incr), 1u), 1u));
 }
 
-void GreaterOrEqual::generate() {
-    _left->generate();
-    _right->generate();
 
-    if (_left->_register == nullptr) {
-        load(_left, getreg());
-    }
+/*
+ * Function:	For::generate
+ *
+ * Description:	Generate code for a for statement.  A loop that runs a
+ *		known number of times needs no test in front, and its body
+ *		may be unrolled: the leftover iterations are done first by
+ *		a loop of their own, which just counts down in a register,
+ *		so that the unrolled loop only tests after each group.
+ *		Any other loop is rotated just as a while statement.  A
+ *		simple loop over arrays is first vectorized, in which case
+ *		the loop that follows only handles the remaining elements.
+ *		An instrumented loop is not vectorized, so that each
+ *		iteration is counted.
+ */
 
-    cout << "\tcmp" << suffix(_left);
-    cout << _right << ", " << _left << endl;
+void For::generate()
+{
+    Label loop, rest, exit;
+    unsigned long trips, left;
+    bool packed, known, hot;
+    unsigned factor;
+    Register *reg;
 
-    assign(_right, nullptr);
-    assign(_left, nullptr);
 
-    assign(this, getreg());
+    _init->generate();
+    increment(_counter);
 
-    string byteRegister = getreg()->byte();
+    packed = vectorized && !instrumented
+	&& vectorize(_init, _expr, _incr, _stmt);
 
-    cout << "\tsetge\t" << byteRegister << endl;
+    known = !packed && counted(_init, _expr, _incr, _stmt, trips);
+    factor = known ? unrolling(_counter, _stmt, _incr) : 1;
+    hot = executed(_counter + 1);
 
-    cout << "\tmovzbl\t" << byteRegister << ", " << this << endl; 
-}
+    if (known && (rotated || factor > 1)) {
+	left = trips % factor;
 
-void Equal::generate() {
-    _left->generate();
-    _right->generate();
+	if (left > 1) {
+	    reg = getreg();
+	    emit(MOV, SIZEOF_INT, Operand::immediate(left, SIZEOF_INT),
+		Operand(reg, SIZEOF_INT));
+	    emit(rest);
+	}
 
-    if (_left->_register == nullptr) {
-        load(_left, getreg());
-    }
+	if (left > 0) {
+	    increment(_counter + 1);
+	    _stmt->generate();
+	    _incr->generate();
+	}
+
+	if (left > 1) {
+	    emit(SUB, SIZEOF_INT, Operand::immediate(1, SIZEOF_INT),
+		Operand(reg, SIZEOF_INT));
+	    jump(CC_NE, rest);
+	}
 
-    cout << "\tcmp" << suffix(_left);
-    cout << _right << ", " << _left << endl;
+	if (trips >= factor) {
+	    head(loop, hot);
 
-    assign(_right, nullptr);
-    assign(_left, nullptr);
+	    for (unsigned i = 0; i < factor; i ++) {
+		increment(_counter + 1);
+		_stmt->generate();
+		_incr->generate();
+	    }
 
-    assign(this, getreg());
+	    _expr->test(loop, true);
+	}
 
-    string byteRegister = getreg()->byte();
+    } else if (rotated) {
+	_expr->test(exit, false);
+	head(loop, hot);
 
-    cout << "\tsete\t" << byteRegister << endl;
+	increment(_counter + 1);
+	_stmt->generate();
+	_incr->generate();
+	_expr->test(loop, true);
+	emit(exit);
 
-    cout << "\tmovzbl\t" << byteRegister << ", " << this << endl; 
-}
+    } else {
+	head(loop, hot);
 
-void NotEqual::generate() {
-    _left->generate();
-    _right->generate();
+	_expr->test(exit, false);
+	increment(_counter + 1);
+	_stmt->generate();
+	_incr->generate();
 
-    if (_left->_register == nullptr) {
-        load(_left, getreg());
+	jump(loop);
+	emit(exit);
     }
+}
 
-    cout << "\tcmp" << suffix(_left);
-    cout << _right << ", " << _left << endl;
 
-    assign(_right, nullptr);
-    assign(_left, nullptr);
+/*
+ * Function:	flags (private)
+ *
+ * Description:	Generate code to branch on an expression.  If the code
+ *		only sets the condition codes for the one branch at its
+ *		end, then the code is moved to the given list without the
+ *		branch, whose condition is returned, so that the caller may
+ *		use the condition codes without branching.  Otherwise, the
+ *		code is left in place and false is returned.
+ */
 
-    assign(this, getreg());
+static bool flags(Expression *expr, const Label &label, bool ifTrue,
+	Instructions &tested, Condition &cond)
+{
+    unsigned start;
 
-    string byteRegister = getreg()->byte();
 
-    cout << "\tsetne\t" << byteRegister << endl;
+    start = code.size();
+    expr->test(label, ifTrue);
 
-    cout << "\tmovzbl\t" << byteRegister << ", " << this << endl; 
+    if (code.size() == start || code.back()._opcode != JCC)
+	return false;
+
+    for (unsigned i = start; i < code.size() - 1; i ++)
+	if (code[i].isBranch() || code[i]._opcode == LABEL)
+	    return false;
+
+    cond = code.back()._cond;
+    code.pop_back();
+
+    tested.assign(code.begin() + start, code.end());
+    code.erase(code.begin() + start, code.end());
+    return true;
 }
 
-void Not::generate() {
-    _expr->generate();
 
-    if (_expr->_register == nullptr) {
-        load(_expr, getreg());
-    }
+/*
+ * Function:	convert (private)
+ *
+ * Description:	Generate code for an if statement whose then and else
+ *		statements both assign a safe value to the same scalar
+ *		variable, using a conditional move rather than branches so
+ *		that a data-dependent condition is never mispredicted.
+ *		Both values are computed, the else value is put in a
+ *		register, and the then value replaces it if the condition
+ *		holds.  The condition is tested only after both values
+ *		are computed, so it must not have side effects that could
+ *		change them.  Return false, having generated nothing, if
+ *		the statement is not of this form.
+ */
 
-    cout << "\tcmp" << suffix(_expr);
-    cout << "$0, " << _expr << endl;
+static bool convert(Expression *expr, Statement *thenStmt,
+	Statement *elseStmt)
+{
+    Expression *left, *right, *thenValue, *elseValue;
+    const Symbol *symbol, *other;
+    Instructions tested;
+    Label skip, exit;
+    Condition cond;
+    unsigned bytes;
 
-    assign(_expr, nullptr);
 
-    assign(this, getreg());
-    
-    string byteRegister = getreg()->byte();
+    if (!converted || instrumented || elseStmt == nullptr)
+	return false;
 
-    cout << "\tsete\t" << byteRegister << endl;
+    if (!thenStmt->isAssignment(left, thenValue) || !left->isIdentifier(symbol))
+	return false;
 
-    cout << "\tmovzbl\t" << byteRegister << ", " << this << endl;
-}
+    if (!elseStmt->isAssignment(right, elseValue)
+	    || !right->isIdentifier(other) || other != symbol)
+	return false;
 
-void Negate:: generate() {
-    _expr->generate();
+    bytes = size(left);
+
+    if (bytes != SIZEOF_INT && bytes != SIZEOF_LONG)
+	return false;
+
+    if (size(thenValue) != bytes || size(elseValue) != bytes)
+	return false;
 
-    if (_expr->_register == nullptr) {
-        load(_expr, getreg());
+    if (!thenValue->isSafe() || !elseValue->isSafe() || !expr->isPure())
+	return false;
+
+    if (!flags(expr, skip, false, tested, cond)) {
+	thenStmt->generate();
+	jump(exit);
+	emit(skip);
+	elseStmt->generate();
+	emit(exit);
+	return true;
     }
 
-    cout << "\tneg" << suffix(_expr);
-    cout << _expr << endl;
+    thenValue->generate();
 
-    
-    assign(this, _expr->_register);
-}
+    if (thenValue->_register == nullptr && location(thenValue).isImm())
+	load(thenValue, getreg());
 
-void Expression::test(const Label &label, bool ifTrue)
-{
-    generate();
+    elseValue->generate();
 
-    if (_register == nullptr) {
-        load(this, getreg());
-    }
+    if (elseValue->_register == nullptr)
+	load(elseValue, getreg());
 
-    cout << "\tcmp" << suffix(this) << "$0, " << this << endl;
-    cout << (ifTrue ? "\tjne\t" : "\tje\t") << label << endl;
+    code.insert(code.end(), tested.begin(), tested.end());
 
-    assign(this, nullptr);
+    emit(CMOV, invert(cond), bytes, location(thenValue),
+	location(elseValue));
+    emit(MOV, bytes, location(elseValue), location(left));
+
+    assign(thenValue, nullptr);
+    assign(elseValue, nullptr);
+    return true;
 }
 
-void While::generate()
+
+/*
+ * Function:	If::generate
+ *
+ * Description:	Generate code for an if-then or if-then-else statement.
+ *		Normally, the then statement falls through from the test.
+ *		If the profile shows that the else statement is more often
+ *		executed, then it falls through instead.  If there is no
+ *		else statement and the then statement is rarely executed,
+ *		then it is moved out of the way to the end of the function,
+ *		from where it jumps back.  An if statement that just
+ *		selects a value is done with a conditional move instead,
+ *		unless the profile shows that the branch is predictable.
+ */
+
+void If::generate()
 {
-    Label loop, exit;
+    Label skip, exit;
+    unsigned long reached, taken;
+    Instructions hot;
+    bool biased;
 
-    cout << loop << ":" << endl;
 
-    _expr->test(exit, false);
-    _stmt->generate();
+    increment(_counter);
+    reached = frequency(_counter);
+    taken = frequency(_counter + 1);
 
-    cout << "\tjmp\t" << loop << endl;
-    cout << exit << ":" << endl;
-}
+    biased = isProfiled() && (PROFILE_COLD * taken < reached
+	|| PROFILE_COLD * (reached - taken) < reached);
 
-void For::generate() {
-    Label loop, exit;
+    if (!biased && convert(_expr, _thenStmt, _elseStmt))
+	return;
 
-    _init->generate();
+    if (isProfiled() && _elseStmt != nullptr && 2 * taken < reached) {
+	_expr->test(skip, true);
+	_elseStmt->generate();
+	jump(exit);
 
-    cout << loop << ":" << endl;
+	emit(skip);
+	increment(_counter + 1);
+	_thenStmt->generate();
+	emit(exit);
 
-    _expr->test(exit, false);
-    _stmt->generate();
-    _incr->generate();
+    } else if (isProfiled() && _elseStmt == nullptr
+	    && PROFILE_COLD * taken < reached) {
+	_expr->test(skip, true);
+	emit(exit);
+	hot.swap(code);
 
-    cout << "\tjmp\t" << loop << endl;
-    cout << exit << ":" << endl;
-}
+	emit(skip);
+	increment(_counter + 1);
+	_thenStmt->generate();
+	jump(exit);
 
-void If::generate() {
-    Label skip, exit;
-    
-    if(_elseStmt != nullptr) {
-        _expr->test(skip, false);
-        _thenStmt->generate();
-        cout << "\tjmp\t" << exit << endl;
-
-        cout << skip << ":" << endl;
-        _elseStmt->generate();
-        cout << exit << ":" << endl;
-    } else {
-        _expr->test(skip, false);
-        _thenStmt->generate();
+	cold.insert(cold.end(), code.begin(), code.end());
+	code.swap(hot);
 
-        cout << skip << ":" << endl;
+    } else {
+	_expr->test(skip, false);
+	increment(_counter + 1);
+	_thenStmt->generate();
+
+	if (_elseStmt != nullptr) {
+	    jump(exit);
+	    emit(skip);
+	    _elseStmt->generate();
+	    emit(exit);
+	} else
+	    emit(skip);
     }
 }
 
-void Address::generate() {
+
+/*
+ * Function:	Address::generate
+ *
+ * Description:	Generate code for an address expression.  The address of
+ *		a dereference is just the pointer itself.
+ */
+
+void Address::generate()
+{
     Expression *pointer;
 
-    if(_expr->isDereference(pointer)) {
-        pointer->generate();
+    if (_expr->isDereference(pointer)) {
+	pointer->generate();
 
-        if(pointer->_register == nullptr) {
-            load(pointer, getreg());
-        }
+	if (pointer->_register == nullptr)
+	    load(pointer, getreg());
 
-        assign(this, pointer->_register);
+	assign(this, pointer->_register);
     } else {
-        assign(this, getreg());
-
-        cout << "\tleaq\t" << _expr << ", " << this << endl;
+	assign(this, getreg());
+	emit(LEA, SIZEOF_PTR, location(_expr), location(this));
     }
 }
 
-void Dereference::generate() {
-    _expr->generate();
 
-    if(_expr->_register == nullptr) {
-        load(_expr, getreg());
-    }
+/*
+ * Function:	Dereference::generate
+ *
+ * Description:	Generate code for a dereference expression.
+ */
 
-    cout << "\tmov" << suffix(_expr);
+void Dereference::generate()
+{
+    Expression *base, *index;
+    Register *reg;
+    Operand op;
 
-    cout << "(" << _expr << "), " << _expr <<  endl;
 
-    assign(this, _expr->_register);
+    op = indirect(_expr, size(this), base, index);
+    reg = base->_register != nullptr ? base->_register : getreg();
+    emit(MOV, size(this), op, Operand(reg, size(this)));
+
+    if (index != nullptr)
+	assign(index, nullptr);
+
+    assign(this, reg);
 }
 
-void Return::generate() {
-    _expr->generate();
 
-    load(_expr, rax);
+/*
+ * Function:	Return::generate
+ *
+ * Description:	Generate code for a return statement, which leaves the
+ *		value in %rax and jumps to the epilogue.
+ */
+
+void Return::generate()
+{
+    _expr->generate();
 
-    cout << "\tjmp\t" << funcname << ".exit" << endl;
+    emit(MOV, size(_expr), source(_expr), Operand(rax, size(_expr)));
+    emit(JMP, 0, Operand::target(global_prefix + funcname + ".exit"));
 
     assign(_expr, nullptr);
 }
 
-void Cast::generate() {
-    Register *reg;
+
+/*
+ * Function:	Cast::generate
+ *
+ * Description:	Generate code for a cast expression.  A narrowing cast is
+ *		just a matter of using the smaller register name.  A
+ *		widening cast of a dereference sign extends straight from
+ *		memory.
+ */
+
+void Cast::generate()
+{
+    Expression *pointer, *base, *index;
     unsigned source, target;
+    Operand op;
+
+
+    source = size(_expr);
+    target = size(this);
+
+    if (source < target && _expr->isDereference(pointer)) {
+	op = indirect(pointer, source, base, index);
+	assign(this, getreg());
+	emit(MOVS, target, op, location(this));
+	release(base, index);
+	return;
+    }
 
-    source = _expr->type().size();
-    target = _type.size();
     _expr->generate();
 
-    if(source >= target) {
-        load(_expr, getreg());
-        assign(this, _expr->_register);
+    if (source >= target) {
+	if (_expr->_register == nullptr)
+	    load(_expr, getreg());
+
+	assign(this, _expr->_register);
+
+    } else if (location(_expr).isImm()) {
+	assign(this, getreg());
+	emit(MOV, target, Operand::immediate(location(_expr)._value, target),
+	    location(this));
+
+    } else {
+	assign(this, getreg());
+	emit(MOVS, target, location(_expr), location(this));
+    }
+}
+
+
+/*
+ * Function:	logical (private)
+ *
+ * Description:	Generate code for a logical expression without branching
+ *		on the right operand, which must be safe to evaluate even
+ *		when the left operand alone decides the result.  Since the
+ *		right operand is then evaluated regardless, neither operand
+ *		may have side effects.  The left operand is evaluated
+ *		first, and if it only sets the condition codes, whether it
+ *		decides the result is saved in a register.  The right
+ *		operand is then computed as zero or one, which a
+ *		conditional move replaces with the decided value if the
+ *		left operand decides the result.  An operand that needs
+ *		branches of its own just branches to the decided value.
+ *		Return false, having generated nothing, if the operands
+ *		are not of this form.
+ */
+
+static bool logical(Expression *result, Expression *left, Expression *right,
+	bool decides)
+{
+    Instructions tested;
+    Register *reg, *value;
+    Label label, exit;
+    bool branched;
+    Condition cond;
+
+
+    if (!converted || !left->isPure() || !right->isPure() || !right->isSafe())
+	return false;
+
+    reg = nullptr;
+    branched = !flags(left, label, decides, tested, cond);
+
+    if (!branched) {
+	code.insert(code.end(), tested.begin(), tested.end());
+	reg = getreg();
+	emit(SET, cond, Operand(reg, 1));
+    }
+
+    if (flags(right, label, decides, tested, cond)) {
+	code.insert(code.end(), tested.begin(), tested.end());
+	assign(result, getreg());
+
+	emit(SET, decides ? cond : invert(cond), Operand(result->_register, 1));
+	emit(MOVZ, SIZEOF_INT, Operand(result->_register, 1), location(result));
+
     } else {
-        reg = getreg();
-        assign(this, reg);
-        if(source == 1 && target == 4) {
-            cout << "\tmovsbl\t" << _expr << ", " << reg << endl;
-        } else if(source == 1 && target == 8) {
-            cout << "\tmovsbq\t" << _expr << ", " << reg << endl;
-        } else {
-            cout << "\tmovslq\t" << _expr << ", " << reg << endl;
-        }
-        
+	branched = true;
+	assign(result, getreg());
+	emit(MOV, SIZEOF_INT, Operand::immediate(!decides, SIZEOF_INT),
+	    location(result));
+    }
+
+    if (branched) {
+	jump(exit);
+	emit(label);
+	emit(MOV, SIZEOF_INT, Operand::immediate(decides, SIZEOF_INT),
+	    location(result));
+	emit(exit);
+    }
+
+    if (reg != nullptr) {
+	value = getreg();
+	emit(MOV, SIZEOF_INT, Operand::immediate(decides, SIZEOF_INT),
+	    Operand(value, SIZEOF_INT));
+	emit(TEST, 1, Operand(reg, 1), Operand(reg, 1));
+	emit(CMOV, CC_NE, SIZEOF_INT, Operand(value, SIZEOF_INT),
+	    location(result));
     }
+
+    return true;
 }
 
-void LogicalAnd::generate() {
-    Label success, failure;
 
-    _left->test(success, false);
-    _right->test(success, false);
+/*
+ * Function:	LogicalAnd::generate
+ *
+ * Description:	Generate code for a logical-and expression.
+ */
+
+void LogicalAnd::generate()
+{
+    Label failure, exit;
+
+    if (logical(this, _left, _right, false))
+	return;
+
+    _left->test(failure, false);
+    _right->test(failure, false);
 
     assign(this, getreg());
 
-    cout << "\tmovl\t" << "$1, " << this << endl;
-    cout << "\tjmp\t" << failure << endl;
+    emit(MOV, SIZEOF_INT, Operand::immediate(1, SIZEOF_INT), location(this));
+    jump(exit);
+
+    emit(failure);
+    emit(MOV, SIZEOF_INT, Operand::immediate(0, SIZEOF_INT), location(this));
+    emit(exit);
+}
+
+
+/*
+ * Function:	LogicalAnd::test
+ *
+ * Description:	Generate code to branch on a logical-and expression.  If
+ *		we are branching when it is false, then either operand
+ *		being false takes us straight to the label.  Otherwise, the
+ *		left operand being false skips the test of the right.
+ */
+
+void LogicalAnd::test(const Label &label, bool ifTrue)
+{
+    Label skip;
 
-    cout << success << ":" << endl;
-    cout << "\tmovl\t" << "$0, " << this << endl;
-    cout << failure << ":" << endl;
+    if (ifTrue) {
+	_left->test(skip, false);
+	_right->test(label, true);
+	emit(skip);
+    } else {
+	_left->test(label, false);
+	_right->test(label, false);
+    }
 }
 
-void LogicalOr::generate() {
-    Label success, failure;
+
+/*
+ * Function:	LogicalOr::generate
+ *
+ * Description:	Generate code for a logical-or expression.
+ */
+
+void LogicalOr::generate()
+{
+    Label success, exit;
+
+    if (logical(this, _left, _right, true))
+	return;
 
     _left->test(success, true);
     _right->test(success, true);
 
-    
     assign(this, getreg());
 
-    cout << "\tmovl\t" << "$0, " << this << endl;
-    cout << "\tjmp\t" << failure << endl;
+    emit(MOV, SIZEOF_INT, Operand::immediate(0, SIZEOF_INT), location(this));
+    jump(exit);
+
+    emit(success);
+    emit(MOV, SIZEOF_INT, Operand::immediate(1, SIZEOF_INT), location(this));
+    emit(exit);
+}
+
+
+/*
+ * Function:	LogicalOr::test
+ *
+ * Description:	Generate code to branch on a logical-or expression.  If we
+ *		are branching when it is true, then either operand being
+ *		true takes us straight to the label.  Otherwise, the left
+ *		operand being true skips the test of the right.
+ */
+
+void LogicalOr::test(const Label &label, bool ifTrue)
+{
+    Label skip;
 
-    cout << success << ":" << endl;
-    cout << "\tmovl\t" << "$1, " << this << endl;
-    cout << failure << ":" << endl;
-}
\ No newline at end of file
+    if (ifTrue) {
+	_left->test(label, true);
+	_right->test(label, true);
+    } else {
+	_left->test(skip, true);
+	_right->test(label, false);
+	emit(skip);
+    }
+}
@@ -8,8 +8,16 @@
 
 # ifndef GENERATOR_H
 # define GENERATOR_H
+# include <string>
 # include "Scope.h"
+# include "Register.h"
 
+bool setOption(const std::string &option);
 void generateGlobals(Scope *scope);
+Register *getreg();
+
+bool scalable(long value);
+void scale(Register *reg, long value, unsigned bytes);
+Register *reciprocal(Register *n, long d, unsigned bytes, bool remainder);
 
 # endif /* GENERATOR_H */
@@ -0,0 +1,220 @@
+/*
+ * File:	inline.cpp
+ *
+ * Description:	This file contains the public and private function
+ *		definitions for the function inliner for Simple C.
+ *
+ *		Once a procedure has been optimized, it is remembered if it
+ *		is small enough and does not call itself.  A later call to
+ *		it with its arguments all passed in registers is replaced
+ *		by a copy of its blocks.  The parameters become copies of
+ *		the arguments, and each return becomes a copy into the
+ *		result of the call followed by a jump to the rest of the
+ *		calling block.  The local variables of the copy are given
+ *		their own space in the frame of the caller.
+ *
+ *		Since a remembered procedure already has any of its own
+ *		calls inlined, and a procedure that ends up calling itself
+ *		is never remembered, inlining always terminates.
+ */
+
+# include <map>
+# include "inline.h"
+# include "machine.h"
+
+using namespace std;
+
+static map<string, Procedure *> procedures;
+
+
+/*
+ * Function:	remember
+ *
+ * Description:	Remember a procedure for inlining if it has no more than
+ *		the given number of quads and does not call itself, and
+ *		return whether it was remembered.
+ */
+
+bool remember(Procedure *proc, unsigned limit)
+{
+    unsigned count = 0;
+
+    for (auto &block : proc->_blocks)
+	for (auto &quad : block._quads) {
+	    if (quad._op == Q_CALL && quad._name == proc->_name)
+		return false;
+
+	    count ++;
+	}
+
+    if (count > limit)
+	return false;
+
+    procedures[proc->_name] = proc;
+    return true;
+}
+
+
+/*
+ * Function:	convert (private)
+ *
+ * Description:	Return a quad copying a value into a temporary, extending
+ *		or truncating it if the sizes differ.
+ */
+
+static Quad convert(const Value &dst, const Value &value)
+{
+    if (value.isTemp() && value._size != dst._size)
+	return Quad(Q_EXT, dst, value);
+
+    return Quad(Q_COPY, dst, value);
+}
+
+
+/*
+ * Function:	size (private)
+ *
+ * Description:	Return the size with which a procedure uses a temporary,
+ *		or zero if it never does.
+ */
+
+static unsigned size(const Procedure *proc, unsigned temp)
+{
+    for (auto &block : proc->_blocks)
+	for (auto &quad : block._quads)
+	    for (auto &arg : quad._args)
+		if (arg.isTemp() && arg._temp == temp)
+		    return arg._size;
+
+    return 0;
+}
+
+
+/*
+ * Function:	expand (private)
+ *
+ * Description:	Replace the call at the given position of a block with a
+ *		copy of the called procedure.  The quads following the
+ *		call are moved to a new block, whose index is returned.
+ */
+
+static unsigned expand(Procedure *proc, unsigned block, unsigned position,
+	const Procedure *callee, int &offset)
+{
+    unsigned temps, blocks, rest;
+    vector<Quad> &quads = proc->_blocks[block]._quads;
+    Quad call = quads[position], jump(Q_JUMP);
+    vector<Quad> after(quads.begin() + position + 1, quads.end());
+    int base;
+
+
+    quads.erase(quads.begin() + position, quads.end());
+
+    temps = proc->_temps;
+    proc->_temps += callee->_temps;
+
+    base = offset & ~(SIZEOF_REG - 1);
+    offset = base + callee->_offset;
+
+
+    /* Copy the arguments into the parameters and enter the copy. */
+
+    for (unsigned i = 0; i < callee->_params.size(); i ++) {
+	unsigned bytes = size(callee, callee->_params[i]);
+
+	if (bytes > 0)
+	    quads.push_back(convert(Value::temp(temps + callee->_params[i],
+		bytes), call._args[i]));
+    }
+
+    blocks = proc->_blocks.size();
+    jump._targets[0] = blocks;
+    proc->_blocks[block]._quads.push_back(jump);
+
+
+    /* Copy the blocks, renaming the temporaries and blocks and moving
+       the local variables into our frame. */
+
+    rest = blocks + callee->_blocks.size();
+
+    for (auto &source : callee->_blocks) {
+	unsigned copy = proc->newBlock();
+
+	for (auto quad : source._quads) {
+	    if (quad._dst.isTemp())
+		quad._dst._temp += temps;
+
+	    for (auto &arg : quad._args)
+		if (arg.isTemp())
+		    arg._temp += temps;
+		else if (arg._kind == Value::FRAME)
+		    quad._disp += base;
+
+	    for (unsigned i = 0; i < quad.successors(); i ++)
+		quad._targets[i] += blocks;
+
+	    if (quad._op == Q_RETURN) {
+		if (call._dst.isTemp())
+		    proc->_blocks[copy]._quads.push_back(convert(call._dst,
+			quad._args.empty() ? Value::constant(0, call._dst._size)
+			    : quad._args[0]));
+
+		quad = Quad(Q_JUMP);
+		quad._targets[0] = rest;
+	    }
+
+	    proc->_blocks[copy]._quads.push_back(quad);
+	}
+    }
+
+    proc->newBlock();
+    proc->_blocks[rest]._quads = after;
+    return rest;
+}
+
+
+/*
+ * Function:	inlineCalls
+ *
+ * Description:	Inline the calls in a procedure to any remembered
+ *		procedures, extending the frame downward from the given
+ *		offset as needed.  The rest of a block after an inlined
+ *		call may contain more calls, but the copied blocks never
+ *		need to be examined.
+ */
+
+void inlineCalls(Procedure *proc, int &offset)
+{
+    vector<unsigned> work;
+    map<string, Procedure *>::iterator it;
+    unsigned block;
+
+
+    for (unsigned i = 0; i < proc->_blocks.size(); i ++)
+	work.push_back(i);
+
+    while (!work.empty()) {
+	block = work.back();
+	work.pop_back();
+
+	for (unsigned i = 0; i < proc->_blocks[block]._quads.size(); i ++) {
+	    const Quad &quad = proc->_blocks[block]._quads[i];
+
+	    if (quad._op != Q_CALL)
+		continue;
+
+	    it = procedures.find(quad._name);
+
+	    if (it == procedures.end() || it->first == proc->_name)
+		continue;
+
+	    if (quad._args.size() != it->second->_params.size())
+		continue;
+
+	    work.push_back(expand(proc, block, i, it->second, offset));
+	    break;
+	}
+    }
+
+    proc->link();
+}
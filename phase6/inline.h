@@ -0,0 +1,15 @@
+/*
+ * File:	inline.h
+ *
+ * Description:	This file contains the function declarations for the
+ *		function inliner for Simple C.
+ */
+
+# ifndef INLINE_H
+# define INLINE_H
+# include "ir.h"
+
+bool remember(Procedure *proc, unsigned limit);
+void inlineCalls(Procedure *proc, int &offset);
+
+# endif /* INLINE_H */
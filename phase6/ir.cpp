@@ -0,0 +1,580 @@
+/*
+ * File:	ir.cpp
+ *
+ * Description:	This file contains the member function definitions for
+ *		the three-address intermediate representation for Simple
+ *		C, along with the functions for writing it out, which is
+ *		useful for seeing what the optimizer is doing.
+ */
+
+# include <algorithm>
+# include "ir.h"
+
+using namespace std;
+
+static string conditions[] = {"==", "!=", "<", ">=", "<=", ">"};
+
+static string names[] = {
+    "copy", "load", "store", "addr", "add", "sub", "mul", "div", "rem",
+    "neg", "set", "ext", "call", "jump", "branch", "return", "phi"
+};
+
+
+/*
+ * Function:	Value::Value (constructor)
+ *
+ * Description:	Initialize an empty value.
+ */
+
+Value::Value()
+    : _kind(NONE), _size(0), _temp(0), _value(0)
+{
+}
+
+
+/*
+ * Function:	Value::temp
+ *
+ * Description:	Return the value of the given temporary.
+ */
+
+Value Value::temp(unsigned temp, unsigned size)
+{
+    Value value;
+
+    value._kind = TEMP;
+    value._size = size;
+    value._temp = temp;
+    return value;
+}
+
+
+/*
+ * Function:	Value::constant
+ *
+ * Description:	Return a constant value.
+ */
+
+Value Value::constant(long n, unsigned size)
+{
+    Value value;
+
+    value._kind = CONST;
+    value._size = size;
+    value._value = n;
+    return value;
+}
+
+
+/*
+ * Function:	Value::frame
+ *
+ * Description:	Return the value of the frame pointer.
+ */
+
+Value Value::frame()
+{
+    Value value;
+
+    value._kind = FRAME;
+    value._size = 8;
+    return value;
+}
+
+
+/*
+ * Function:	Value::global
+ *
+ * Description:	Return the address of the given global symbol.
+ */
+
+Value Value::global(const string &symbol)
+{
+    Value value;
+
+    value._kind = GLOBAL;
+    value._size = 8;
+    value._symbol = symbol;
+    return value;
+}
+
+
+/*
+ * Function:	Value::isTemp
+ *
+ * Description:	Return whether this value is a temporary.
+ */
+
+bool Value::isTemp() const
+{
+    return _kind == TEMP;
+}
+
+
+/*
+ * Function:	Value::isConst
+ *
+ * Description:	Return whether this value is a constant.
+ */
+
+bool Value::isConst() const
+{
+    return _kind == CONST;
+}
+
+
+/*
+ * Function:	Value::operator ==
+ *
+ * Description:	Return whether two values are the same, ignoring their
+ *		sizes.
+ */
+
+bool Value::operator ==(const Value &rhs) const
+{
+    return _kind == rhs._kind && _temp == rhs._temp && _value == rhs._value
+	&& _symbol == rhs._symbol;
+}
+
+
+/*
+ * Function:	Value::operator !=
+ *
+ * Description:	Return whether two values differ.
+ */
+
+bool Value::operator !=(const Value &rhs) const
+{
+    return !operator ==(rhs);
+}
+
+
+/*
+ * Function:	Quad::Quad (constructor)
+ *
+ * Description:	Initialize a quad with the given operator and, optionally,
+ *		its result and arguments.
+ */
+
+Quad::Quad(QuadOp op)
+    : _op(op), _cond(CC_E), _disp(0), _variadic(false), _targets{0, 0}
+{
+}
+
+Quad::Quad(QuadOp op, const Value &dst)
+    : Quad(op)
+{
+    _dst = dst;
+}
+
+Quad::Quad(QuadOp op, const Value &dst, const Value &arg)
+    : Quad(op, dst)
+{
+    _args.push_back(arg);
+}
+
+Quad::Quad(QuadOp op, const Value &dst, const Value &left, const Value &right)
+    : Quad(op, dst)
+{
+    _args.push_back(left);
+    _args.push_back(right);
+}
+
+
+/*
+ * Function:	Quad::isTerminator
+ *
+ * Description:	Return whether this quad ends a basic block.
+ */
+
+bool Quad::isTerminator() const
+{
+    return _op == Q_JUMP || _op == Q_BRANCH || _op == Q_RETURN;
+}
+
+
+/*
+ * Function:	Quad::hasSideEffects
+ *
+ * Description:	Return whether this quad does anything besides computing
+ *		its result.  A division may trap, so it is kept as well.
+ */
+
+bool Quad::hasSideEffects() const
+{
+    return _op == Q_STORE || _op == Q_CALL || _op == Q_DIV || _op == Q_REM
+	|| isTerminator();
+}
+
+
+/*
+ * Function:	Quad::isTailCall
+ *
+ * Description:	Return whether this quad is a call whose result, if any,
+ *		is immediately returned by the next quad.
+ */
+
+bool Quad::isTailCall(const Quad &next) const
+{
+    if (_op != Q_CALL || next._op != Q_RETURN)
+	return false;
+
+    if (next._args.empty())
+	return true;
+
+    return next._args[0] == _dst && next._args[0]._size == _dst._size;
+}
+
+
+/*
+ * Function:	Quad::successors
+ *
+ * Description:	Return the number of blocks to which this quad may
+ *		transfer control.
+ */
+
+unsigned Quad::successors() const
+{
+    return _op == Q_BRANCH ? 2 : (_op == Q_JUMP ? 1 : 0);
+}
+
+
+/*
+ * Function:	Procedure::Procedure (constructor)
+ *
+ * Description:	Initialize a procedure with just an entry block.
+ */
+
+Procedure::Procedure(const string &name)
+    : _name(name), _temps(0), _returns(false), _offset(0)
+{
+    newBlock();
+}
+
+
+/*
+ * Function:	Procedure::newTemp
+ *
+ * Description:	Return a new temporary of the given size.
+ */
+
+Value Procedure::newTemp(unsigned size)
+{
+    return Value::temp(_temps ++, size);
+}
+
+
+/*
+ * Function:	Procedure::newBlock
+ *
+ * Description:	Add a new empty basic block and return its index.
+ */
+
+unsigned Procedure::newBlock()
+{
+    _blocks.push_back(BasicBlock());
+    return _blocks.size() - 1;
+}
+
+
+/*
+ * Function:	Procedure::link
+ *
+ * Description:	Compute the successors and predecessors of each block from
+ *		the quads that end them.
+ */
+
+void Procedure::link()
+{
+    for (auto &block : _blocks) {
+	block._succs.clear();
+	block._preds.clear();
+    }
+
+    for (unsigned i = 0; i < _blocks.size(); i ++) {
+	const Quad &last = _blocks[i]._quads.back();
+
+	for (unsigned j = 0; j < last.successors(); j ++) {
+	    _blocks[i]._succs.push_back(last._targets[j]);
+	    _blocks[last._targets[j]]._preds.push_back(i);
+	}
+    }
+}
+
+
+/*
+ * Function:	Procedure::compact
+ *
+ * Description:	Remove any blocks that cannot be reached from the entry,
+ *		renumbering the remaining ones in their original order, and
+ *		then relink the procedure.  A phi loses the arguments for
+ *		any edges that no longer exist.
+ */
+
+void Procedure::compact()
+{
+    vector<int> number(_blocks.size(), -1);
+    vector<unsigned> work(1, 0);
+    vector<BasicBlock> blocks;
+    unsigned block, source;
+
+
+    number[0] = 0;
+
+    while (!work.empty()) {
+	block = work.back();
+	work.pop_back();
+
+	const Quad &last = _blocks[block]._quads.back();
+
+	for (unsigned i = 0; i < last.successors(); i ++)
+	    if (number[last._targets[i]] < 0) {
+		number[last._targets[i]] = 0;
+		work.push_back(last._targets[i]);
+	    }
+    }
+
+    for (unsigned i = 0; i < _blocks.size(); i ++)
+	if (number[i] >= 0) {
+	    number[i] = blocks.size();
+	    blocks.push_back(_blocks[i]);
+	}
+
+    _blocks = blocks;
+
+    for (auto &block : _blocks) {
+	Quad &last = block._quads.back();
+
+	for (unsigned i = 0; i < last.successors(); i ++)
+	    last._targets[i] = number[last._targets[i]];
+    }
+
+    link();
+
+    for (auto &block : _blocks)
+	for (auto &quad : block._quads) {
+	    if (quad._op != Q_PHI)
+		break;
+
+	    for (unsigned i = quad._sources.size(); i -- > 0; ) {
+		source = quad._sources[i];
+
+		if (number[source] < 0 || find(block._preds.begin(),
+		    block._preds.end(), number[source]) == block._preds.end()) {
+		    quad._sources.erase(quad._sources.begin() + i);
+		    quad._args.erase(quad._args.begin() + i);
+		} else
+		    quad._sources[i] = number[source];
+	    }
+	}
+}
+
+
+/*
+ * Function:	Procedure::order
+ *
+ * Description:	Compute the blocks reachable from the entry in reverse
+ *		postorder, so that each block comes before its successors
+ *		except along the back edges of loops.
+ */
+
+void Procedure::order(vector<unsigned> &blocks) const
+{
+    vector<bool> visited(_blocks.size(), false);
+    vector<pair<unsigned, unsigned>> stack;
+    unsigned block, next;
+
+
+    blocks.clear();
+    stack.push_back(make_pair(0, 0));
+    visited[0] = true;
+
+    while (!stack.empty()) {
+	block = stack.back().first;
+
+	if (stack.back().second < _blocks[block]._succs.size()) {
+	    next = _blocks[block]._succs[stack.back().second ++];
+
+	    if (!visited[next]) {
+		visited[next] = true;
+		stack.push_back(make_pair(next, 0));
+	    }
+
+	} else {
+	    blocks.push_back(block);
+	    stack.pop_back();
+	}
+    }
+
+    reverse(blocks.begin(), blocks.end());
+}
+
+
+/*
+ * Function:	Procedure::dominators
+ *
+ * Description:	Compute the immediate dominator of each block using the
+ *		iterative algorithm of Cooper, Harvey, and Kennedy.  The
+ *		entry is its own immediate dominator.  Every block must be
+ *		reachable, which Procedure::compact ensures.
+ */
+
+void Procedure::dominators(vector<unsigned> &idom) const
+{
+    vector<unsigned> blocks, number(_blocks.size());
+    vector<bool> done(_blocks.size(), false);
+    bool changed;
+    unsigned a, b;
+    int dom;
+
+
+    order(blocks);
+
+    for (unsigned i = 0; i < blocks.size(); i ++)
+	number[blocks[i]] = i;
+
+    idom.assign(_blocks.size(), 0);
+    done[0] = true;
+
+    do {
+	changed = false;
+
+	for (unsigned i = 1; i < blocks.size(); i ++) {
+	    dom = -1;
+
+	    for (auto pred : _blocks[blocks[i]]._preds) {
+		if (!done[pred])
+		    continue;
+
+		if (dom < 0) {
+		    dom = pred;
+		    continue;
+		}
+
+		a = dom;
+		b = pred;
+
+		while (a != b) {
+		    while (number[a] > number[b])
+			a = idom[a];
+
+		    while (number[b] > number[a])
+			b = idom[b];
+		}
+
+		dom = a;
+	    }
+
+	    if (!done[blocks[i]] || idom[blocks[i]] != (unsigned) dom) {
+		idom[blocks[i]] = dom;
+		done[blocks[i]] = true;
+		changed = true;
+	    }
+	}
+    } while (changed);
+}
+
+
+/*
+ * Function:	Procedure::takesAddress
+ *
+ * Description:	Return whether the address of anything in the frame of
+ *		this procedure is ever taken, in which case the frame may
+ *		still be in use by a procedure that it calls.
+ */
+
+bool Procedure::takesAddress() const
+{
+    for (auto &block : _blocks)
+	for (auto &quad : block._quads)
+	    if (quad._op == Q_ADDR && quad._args[0]._kind == Value::FRAME)
+		return true;
+
+    return false;
+}
+
+
+/*
+ * Function:	operator <<
+ *
+ * Description:	Write a value to a stream.
+ */
+
+ostream &operator <<(ostream &ostr, const Value &value)
+{
+    switch (value._kind) {
+    case Value::TEMP:
+	return ostr << "t" << value._temp;
+
+    case Value::CONST:
+	return ostr << value._value;
+
+    case Value::FRAME:
+	return ostr << "fp";
+
+    case Value::GLOBAL:
+	return ostr << "&" << value._symbol;
+
+    default:
+	return ostr << "-";
+    }
+}
+
+
+/*
+ * Function:	operator <<
+ *
+ * Description:	Write a quad to a stream.
+ */
+
+ostream &operator <<(ostream &ostr, const Quad &quad)
+{
+    ostr << "\t";
+
+    if (quad._dst._kind != Value::NONE)
+	ostr << quad._dst << ":" << quad._dst._size << " = ";
+
+    ostr << names[quad._op];
+
+    if (quad._op == Q_SET || quad._op == Q_BRANCH)
+	ostr << " " << conditions[quad._cond];
+
+    if (quad._op == Q_CALL)
+	ostr << " " << quad._name;
+
+    for (unsigned i = 0; i < quad._args.size(); i ++) {
+	ostr << (i == 0 ? " " : ", ") << quad._args[i];
+
+	if (quad._op == Q_PHI)
+	    ostr << " [B" << quad._sources[i] << "]";
+    }
+
+    if (quad._op == Q_LOAD || quad._op == Q_STORE || quad._op == Q_ADDR)
+	ostr << " @ " << quad._disp;
+
+    for (unsigned i = 0; i < quad.successors(); i ++)
+	ostr << (i == 0 ? " -> B" : ", B") << quad._targets[i];
+
+    return ostr << endl;
+}
+
+
+/*
+ * Function:	operator <<
+ *
+ * Description:	Write a procedure to a stream.
+ */
+
+ostream &operator <<(ostream &ostr, const Procedure &proc)
+{
+    ostr << proc._name << ":" << endl;
+
+    for (unsigned i = 0; i < proc._blocks.size(); i ++) {
+	ostr << "B" << i << ":" << endl;
+
+	for (auto &quad : proc._blocks[i]._quads)
+	    ostr << quad;
+    }
+
+    return ostr << endl;
+}
@@ -0,0 +1,131 @@
+/*
+ * File:	ir.h
+ *
+ * Description:	This file contains the class definitions for the
+ *		three-address intermediate representation for Simple C.
+ *
+ *		A procedure is a list of basic blocks, the first of which
+ *		is the entry.  Each basic block is a list of quads and
+ *		ends with exactly one jump, branch, or return.  A quad
+ *		computes at most one result into a temporary, which is an
+ *		unlimited supply of virtual registers, from at most a few
+ *		values.  Memory is only accessed by explicit loads and
+ *		stores, whose address is a base value plus a displacement.
+ *		The offset of a procedure is the lowest displacement from
+ *		the frame pointer used by its local variables.
+ *
+ *		A value is either a temporary, a constant, the frame
+ *		pointer, or the address of a global symbol.  Every value
+ *		has a size in bytes, which is that of the operation in
+ *		which it is used.
+ *
+ *		A phi quad only appears while a procedure is in static
+ *		single assignment form.  It selects the argument that
+ *		arrives from the predecessor block named by the matching
+ *		entry of its sources.
+ *
+ *		The tree is lowered into a procedure by lower.cpp, which
+ *		may then be optimized before select.cpp chooses the
+ *		instructions for it.
+ */
+
+# ifndef IR_H
+# define IR_H
+# include <string>
+# include <vector>
+# include <ostream>
+# include "Instruction.h"
+# include "Label.h"
+
+enum QuadOp {
+    Q_COPY, Q_LOAD, Q_STORE, Q_ADDR, Q_ADD, Q_SUB, Q_MUL, Q_DIV, Q_REM,
+    Q_NEG, Q_SET, Q_EXT, Q_CALL, Q_JUMP, Q_BRANCH, Q_RETURN, Q_PHI
+};
+
+
+class Value {
+    typedef std::string string;
+
+public:
+    enum Kind { NONE, TEMP, CONST, FRAME, GLOBAL };
+
+    Kind _kind;
+    unsigned _size;
+    unsigned _temp;
+    long _value;
+    string _symbol;
+
+    Value();
+
+    static Value temp(unsigned temp, unsigned size);
+    static Value constant(long value, unsigned size);
+    static Value frame();
+    static Value global(const string &symbol);
+
+    bool isTemp() const;
+    bool isConst() const;
+    bool operator ==(const Value &rhs) const;
+    bool operator !=(const Value &rhs) const;
+};
+
+
+class Quad {
+    typedef std::string string;
+
+public:
+    QuadOp _op;
+    Condition _cond;
+    Value _dst;
+    std::vector<Value> _args;
+    long _disp;
+    string _name;
+    bool _variadic;
+    unsigned _targets[2];
+    std::vector<unsigned> _sources;
+
+    Quad(QuadOp op);
+    Quad(QuadOp op, const Value &dst);
+    Quad(QuadOp op, const Value &dst, const Value &arg);
+    Quad(QuadOp op, const Value &dst, const Value &left, const Value &right);
+
+    bool isTerminator() const;
+    bool hasSideEffects() const;
+    bool isTailCall(const Quad &next) const;
+    unsigned successors() const;
+};
+
+
+class BasicBlock {
+public:
+    Label _label;
+    std::vector<Quad> _quads;
+    std::vector<unsigned> _succs, _preds;
+};
+
+
+class Procedure {
+    typedef std::string string;
+
+public:
+    string _name;
+    std::vector<BasicBlock> _blocks;
+    std::vector<unsigned> _params;
+    unsigned _temps;
+    bool _returns;
+    int _offset;
+
+    Procedure(const string &name);
+    Value newTemp(unsigned size);
+    unsigned newBlock();
+    void link();
+    void compact();
+    void order(std::vector<unsigned> &blocks) const;
+    void dominators(std::vector<unsigned> &idom) const;
+    bool takesAddress() const;
+};
+
+std::ostream &operator <<(std::ostream &ostr, const Value &value);
+std::ostream &operator <<(std::ostream &ostr, const Quad &quad);
+std::ostream &operator <<(std::ostream &ostr, const Procedure &proc);
+
+# endif /* IR_H */
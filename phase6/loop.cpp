@@ -0,0 +1,350 @@
+/*
+ * File:	loop.cpp
+ *
+ * Description:	This file contains the member, public, and private
+ *		function definitions for the loop optimizer for Simple C,
+ *		which works on a procedure in static single assignment
+ *		form.
+ *
+ *		A natural loop is found for each back edge, which is an
+ *		edge to a block that dominates its source, and loops
+ *		sharing a header are merged.  Each loop is given a
+ *		preheader, which is the only way into its header from
+ *		outside the loop.  A computation whose arguments are all
+ *		computed outside the loop produces the same value on every
+ *		iteration, and is moved into the preheader if doing so
+ *		cannot fault or see a different value of memory.  Inner
+ *		loops are handled first, so that a computation can be
+ *		moved out of several loops at once.
+ */
+
+# include <map>
+# include <algorithm>
+# include "loop.h"
+
+using namespace std;
+
+static vector<unsigned> idom;
+
+
+/*
+ * Function:	Loop::contains
+ *
+ * Description:	Return whether a block is part of this loop.
+ */
+
+bool Loop::contains(unsigned block) const
+{
+    return binary_search(_blocks.begin(), _blocks.end(), block);
+}
+
+
+/*
+ * Function:	dominates (private)
+ *
+ * Description:	Return whether one block dominates another.
+ */
+
+static bool dominates(unsigned a, unsigned b)
+{
+    while (b != a && b != 0)
+	b = idom[b];
+
+    return b == a;
+}
+
+
+/*
+ * Function:	preheader (private)
+ *
+ * Description:	Return the preheader of the loop with the given header and
+ *		back edges.  If the header is entered from a single block
+ *		that only jumps to it, then that block is already a
+ *		preheader.  Otherwise, a new block is placed in front of
+ *		the header, and the arguments of any phis along the edges
+ *		into the loop are merged by phis in the new block.
+ */
+
+static unsigned preheader(Procedure *proc, unsigned header,
+	const vector<unsigned> &latches)
+{
+    vector<unsigned> outside;
+    unsigned block;
+    Quad jump(Q_JUMP);
+
+
+    for (auto pred : proc->_blocks[header]._preds)
+	if (find(latches.begin(), latches.end(), pred) == latches.end())
+	    outside.push_back(pred);
+
+    if (outside.size() == 1
+	&& proc->_blocks[outside[0]]._quads.back()._op == Q_JUMP)
+	return outside[0];
+
+    block = proc->newBlock();
+
+    for (auto &phi : proc->_blocks[header]._quads) {
+	if (phi._op != Q_PHI)
+	    break;
+
+	Quad merge(Q_PHI, proc->newTemp(phi._dst._size));
+
+	for (unsigned i = phi._sources.size(); i -- > 0; )
+	    if (find(outside.begin(), outside.end(), phi._sources[i])
+		!= outside.end()) {
+		merge._args.insert(merge._args.begin(), phi._args[i]);
+		merge._sources.insert(merge._sources.begin(), phi._sources[i]);
+		phi._args.erase(phi._args.begin() + i);
+		phi._sources.erase(phi._sources.begin() + i);
+	    }
+
+	phi._args.push_back(merge._dst);
+	phi._sources.push_back(block);
+	proc->_blocks[block]._quads.push_back(merge);
+    }
+
+    jump._targets[0] = header;
+    proc->_blocks[block]._quads.push_back(jump);
+
+    for (auto pred : outside) {
+	Quad &last = proc->_blocks[pred]._quads.back();
+
+	for (unsigned i = 0; i < last.successors(); i ++)
+	    if (last._targets[i] == header)
+		last._targets[i] = block;
+    }
+
+    return block;
+}
+
+
+/*
+ * Function:	findLoops
+ *
+ * Description:	Find the natural loops of a procedure, giving each one a
+ *		preheader.  The loops are ordered from smallest to
+ *		largest, so an inner loop always comes before any loop
+ *		containing it.
+ */
+
+void findLoops(Procedure *proc, vector<Loop> &loops)
+{
+    map<unsigned, vector<unsigned>> latches;
+    vector<unsigned> work;
+    vector<bool> inside;
+    unsigned block;
+    Loop loop;
+
+
+    proc->dominators(idom);
+
+    for (unsigned i = 0; i < proc->_blocks.size(); i ++)
+	for (auto succ : proc->_blocks[i]._succs)
+	    if (dominates(succ, i))
+		latches[succ].push_back(i);
+
+    loops.clear();
+
+    for (auto &entry : latches) {
+	loop._header = entry.first;
+	loop._preheader = preheader(proc, entry.first, entry.second);
+	loops.push_back(loop);
+    }
+
+    proc->link();
+    proc->dominators(idom);
+
+    for (auto &loop : loops) {
+	inside.assign(proc->_blocks.size(), false);
+	inside[loop._header] = true;
+	work = latches[loop._header];
+
+	while (!work.empty()) {
+	    block = work.back();
+	    work.pop_back();
+
+	    if (!inside[block]) {
+		inside[block] = true;
+		work.insert(work.end(), proc->_blocks[block]._preds.begin(),
+		    proc->_blocks[block]._preds.end());
+	    }
+	}
+
+	for (unsigned i = 0; i < inside.size(); i ++)
+	    if (inside[i])
+		loop._blocks.push_back(i);
+    }
+
+    stable_sort(loops.begin(), loops.end(),
+	[](const Loop &a, const Loop &b) {
+	    return a._blocks.size() < b._blocks.size();
+	});
+}
+
+
+/*
+ * Function:	aliases (private)
+ *
+ * Description:	Return whether a store might change the value read by a
+ *		load.  A store of a temporary address may change anything,
+ *		and so might a load through a temporary address.
+ */
+
+static bool aliases(const Quad &store, const Quad &load)
+{
+    const Value &a = store._args[0], &b = load._args[0];
+
+    if (a.isTemp() || b.isTemp())
+	return true;
+
+    if (a._kind != b._kind || a._symbol != b._symbol)
+	return false;
+
+    return store._disp < load._disp + load._dst._size
+	&& load._disp < store._disp + store._args[1]._size;
+}
+
+
+/*
+ * Function:	movable (private)
+ *
+ * Description:	Return whether a quad may be moved out of a loop if its
+ *		arguments are invariant.  A division is only moved if it
+ *		cannot trap.  A load is only moved if nothing in the loop
+ *		may change its value, and if it either reads a variable
+ *		directly or would be executed anyway by any iteration that
+ *		leaves the loop.
+ */
+
+static bool movable(const Quad &quad, const vector<Quad> &stores,
+	bool calls, bool guaranteed)
+{
+    const Value *divisor;
+
+
+    switch (quad._op) {
+    case Q_COPY:
+    case Q_ADDR:
+    case Q_ADD:
+    case Q_SUB:
+    case Q_MUL:
+    case Q_NEG:
+    case Q_SET:
+    case Q_EXT:
+	return true;
+
+    case Q_DIV:
+    case Q_REM:
+	divisor = &quad._args[1];
+	return divisor->isConst() && divisor->_value != 0
+	    && divisor->_value != -1;
+
+    case Q_LOAD:
+	if (calls)
+	    return false;
+
+	for (auto &store : stores)
+	    if (aliases(store, quad))
+		return false;
+
+	return guaranteed || !quad._args[0].isTemp();
+
+    default:
+	return false;
+    }
+}
+
+
+/*
+ * Function:	hoist (private)
+ *
+ * Description:	Move the invariant computations of a loop into its
+ *		preheader.  The blocks are visited in reverse postorder,
+ *		so any invariant argument of a quad has already been
+ *		moved by the time we reach it.
+ */
+
+static void hoist(Procedure *proc, const Loop &loop,
+	const vector<unsigned> &order, vector<unsigned> &defs)
+{
+    vector<Quad> stores, quads;
+    vector<unsigned> exits;
+    bool calls, guaranteed, invariant;
+
+
+    calls = false;
+
+    for (auto block : loop._blocks) {
+	for (auto &quad : proc->_blocks[block]._quads)
+	    if (quad._op == Q_CALL)
+		calls = true;
+	    else if (quad._op == Q_STORE)
+		stores.push_back(quad);
+
+	for (auto succ : proc->_blocks[block]._succs)
+	    if (!loop.contains(succ))
+		exits.push_back(block);
+    }
+
+    for (auto block : order) {
+	if (!loop.contains(block))
+	    continue;
+
+	guaranteed = !exits.empty();
+
+	for (auto exit : exits)
+	    if (!dominates(block, exit))
+		guaranteed = false;
+
+	quads.clear();
+
+	for (auto &quad : proc->_blocks[block]._quads) {
+	    invariant = quad._dst.isTemp()
+		&& movable(quad, stores, calls, guaranteed);
+
+	    for (auto &arg : quad._args)
+		if (arg.isTemp() && loop.contains(defs[arg._temp]))
+		    invariant = false;
+
+	    if (invariant) {
+		vector<Quad> &pre = proc->_blocks[loop._preheader]._quads;
+		pre.insert(pre.end() - 1, quad);
+		defs[quad._dst._temp] = loop._preheader;
+	    } else
+		quads.push_back(quad);
+	}
+
+	proc->_blocks[block]._quads = quads;
+    }
+}
+
+
+/*
+ * Function:	hoistInvariants
+ *
+ * Description:	Move the loop-invariant computations of a procedure out
+ *		of their loops.
+ */
+
+void hoistInvariants(Procedure *proc)
+{
+    vector<Loop> loops;
+    vector<unsigned> order, defs;
+
+
+    findLoops(proc, loops);
+
+    if (loops.empty())
+	return;
+
+    proc->order(order);
+    defs.assign(proc->_temps, 0);
+
+    for (unsigned i = 0; i < proc->_blocks.size(); i ++)
+	for (auto &quad : proc->_blocks[i]._quads)
+	    if (quad._dst.isTemp())
+		defs[quad._dst._temp] = i;
+
+    for (auto &loop : loops)
+	hoist(proc, loop, order, defs);
+}
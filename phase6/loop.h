@@ -0,0 +1,25 @@
+/*
+ * File:	loop.h
+ *
+ * Description:	This file contains the class definition for natural loops
+ *		and the function declarations for the loop optimizer for
+ *		Simple C.
+ */
+
+# ifndef LOOP_H
+# define LOOP_H
+# include <vector>
+# include "ir.h"
+
+class Loop {
+public:
+    unsigned _header, _preheader;
+    std::vector<unsigned> _blocks;
+
+    bool contains(unsigned block) const;
+};
+
+void findLoops(Procedure *proc, std::vector<Loop> &loops);
+void hoistInvariants(Procedure *proc);
+
+# endif /* LOOP_H */
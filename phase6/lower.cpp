@@ -0,0 +1,952 @@
+/*
+ * File:	lower.cpp
+ *
+ * Description:	This file contains the member function definitions for
+ *		lowering the abstract syntax tree of a function into the
+ *		three-address intermediate representation.
+ *
+ *		Each expression computes its result into a new temporary
+ *		(or simply returns a constant), and every access to a
+ *		variable is an explicit load or store, so that later passes
+ *		can see exactly where memory is used.  Control flow is
+ *		lowered into basic blocks.  A test expression branches
+ *		directly to the blocks for its true and false outcomes.
+ */
+
+# include <cassert>
+# include "machine.h"
+# include "ir.h"
+# include "Tree.h"
+
+using namespace std;
+
+static Procedure *proc;
+static unsigned current;
+
+
+/*
+ * Function:	size (private)
+ *
+ * Description:	Return the access size of an expression.  An array is only
+ *		ever used for its address.
+ */
+
+static unsigned size(Expression *expr)
+{
+    if (expr->type().isArray())
+	return SIZEOF_PTR;
+
+    return expr->type().size();
+}
+
+
+/*
+ * Function:	emit (private)
+ *
+ * Description:	Append a quad to the current block.
+ */
+
+static void emit(const Quad &quad)
+{
+    proc->_blocks[current]._quads.push_back(quad);
+}
+
+
+/*
+ * Function:	terminated (private)
+ *
+ * Description:	Return whether the current block has already ended.
+ */
+
+static bool terminated()
+{
+    const vector<Quad> &quads = proc->_blocks[current]._quads;
+    return !quads.empty() && quads.back().isTerminator();
+}
+
+
+/*
+ * Function:	jump (private)
+ *
+ * Description:	End the current block with a jump to the given block.
+ */
+
+static void jump(unsigned block)
+{
+    Quad quad(Q_JUMP);
+
+    quad._targets[0] = block;
+    emit(quad);
+}
+
+
+/*
+ * Function:	branch (private)
+ *
+ * Description:	End the current block with a comparison that branches to
+ *		one of two blocks.
+ */
+
+static void branch(Condition cond, const Value &left, const Value &right,
+	unsigned ifTrue, unsigned ifFalse)
+{
+    Quad quad(Q_BRANCH, Value(), left, right);
+
+    quad._cond = cond;
+    quad._targets[0] = ifTrue;
+    quad._targets[1] = ifFalse;
+    emit(quad);
+}
+
+
+/*
+ * Function:	enter (private)
+ *
+ * Description:	Continue lowering into the given block, falling into it
+ *		from the current block if it has not already ended.
+ */
+
+static void enter(unsigned block)
+{
+    if (!terminated())
+	jump(block);
+
+    current = block;
+}
+
+
+/*
+ * Function:	compute (private)
+ *
+ * Description:	Append a quad computing a result of the given size into a
+ *		new temporary, and return the temporary.
+ */
+
+static Value compute(QuadOp op, unsigned bytes, const Value &left,
+	const Value &right = Value())
+{
+    Value result = proc->newTemp(bytes);
+    Quad quad(op, result, left);
+
+    if (right._kind != Value::NONE)
+	quad._args.push_back(right);
+
+    emit(quad);
+    return result;
+}
+
+
+/*
+ * Function:	reference (private)
+ *
+ * Description:	Add the base address of a variable to the arguments of a
+ *		quad and set its displacement.
+ */
+
+static void reference(const Symbol *symbol, Quad &quad)
+{
+    if (symbol->_offset == 0) {
+	quad._args.push_back(Value::global(global_prefix + symbol->name()));
+	quad._disp = 0;
+    } else {
+	quad._args.push_back(Value::frame());
+	quad._disp = symbol->_offset;
+    }
+}
+
+
+/*
+ * Function:	String::lower
+ *
+ * Description:	Lower a string literal, which is the address of its label.
+ */
+
+Value String::lower()
+{
+    return Value::global(operand()._symbol);
+}
+
+
+/*
+ * Function:	Identifier::lower
+ *
+ * Description:	Lower an identifier into a load of its value, or just its
+ *		address if it is an array.
+ */
+
+Value Identifier::lower()
+{
+    Quad quad(_type.isArray() ? Q_ADDR : Q_LOAD);
+
+    reference(_symbol, quad);
+    quad._dst = proc->newTemp(size(this));
+    emit(quad);
+    return quad._dst;
+}
+
+
+/*
+ * Function:	Number::lower
+ *
+ * Description:	Lower a number, which is just a constant.
+ */
+
+Value Number::lower()
+{
+    return Value::constant(strtoul(_value.c_str(), NULL, 0), _type.size());
+}
+
+
+/*
+ * Function:	Call::lower
+ *
+ * Description:	Lower a function call.  The arguments are evaluated from
+ *		last to first just as the code generator does.
+ */
+
+Value Call::lower()
+{
+    Quad quad(Q_CALL);
+
+
+    quad._args.resize(_args.size());
+
+    for (int i = _args.size() - 1; i >= 0; i --)
+	quad._args[i] = _args[i]->lower();
+
+    quad._name = global_prefix + _id->name();
+    quad._variadic = _id->type().parameters() == nullptr;
+
+    if (_type.size() > 0)
+	quad._dst = proc->newTemp(_type.size());
+
+    emit(quad);
+    return quad._dst;
+}
+
+
+/*
+ * Function:	Not::lower
+ *
+ * Description:	Lower a logical negation expression.
+ */
+
+Value Not::lower()
+{
+    Value value = _expr->lower();
+    Quad quad(Q_SET, proc->newTemp(SIZEOF_INT), value,
+	Value::constant(0, value._size));
+
+    quad._cond = CC_E;
+    emit(quad);
+    return quad._dst;
+}
+
+
+/*
+ * Function:	Not::branch
+ *
+ * Description:	Lower a logical negation used as a test, which is just a
+ *		test of its operand with the outcomes swapped.
+ */
+
+void Not::branch(unsigned ifTrue, unsigned ifFalse)
+{
+    _expr->branch(ifFalse, ifTrue);
+}
+
+
+/*
+ * Function:	Negate::lower
+ *
+ * Description:	Lower an arithmetic negation expression.
+ */
+
+Value Negate::lower()
+{
+    return compute(Q_NEG, size(this), _expr->lower());
+}
+
+
+/*
+ * Function:	Dereference::lower
+ *
+ * Description:	Lower a dereference expression into a load.
+ */
+
+Value Dereference::lower()
+{
+    Quad quad(Q_LOAD, Value(), _expr->lower());
+
+    quad._dst = proc->newTemp(size(this));
+    emit(quad);
+    return quad._dst;
+}
+
+
+/*
+ * Function:	Address::lower
+ *
+ * Description:	Lower an address expression.  The address of a dereference
+ *		is just the pointer itself, and a string literal is already
+ *		an address.
+ */
+
+Value Address::lower()
+{
+    Expression *pointer;
+    const Symbol *symbol;
+    Quad quad(Q_ADDR);
+
+
+    if (_expr->isDereference(pointer))
+	return pointer->lower();
+
+    if (!_expr->isIdentifier(symbol))
+	return _expr->lower();
+
+    reference(symbol, quad);
+    quad._dst = proc->newTemp(SIZEOF_PTR);
+    emit(quad);
+    return quad._dst;
+}
+
+
+/*
+ * Function:	Cast::lower
+ *
+ * Description:	Lower a cast expression, which sign extends or truncates
+ *		its operand.  A constant is simply converted.
+ */
+
+Value Cast::lower()
+{
+    Value value = _expr->lower();
+    unsigned bytes = size(this);
+
+
+    if (value._size == bytes)
+	return value;
+
+    if (value.isConst()) {
+	if (bytes == SIZEOF_CHAR)
+	    return Value::constant((signed char) value._value, bytes);
+
+	if (bytes == SIZEOF_INT)
+	    return Value::constant((int) value._value, bytes);
+
+	return Value::constant(value._value, bytes);
+    }
+
+    return compute(Q_EXT, bytes, value);
+}
+
+
+/*
+ * Function:	Multiply::lower
+ *
+ * Description:	Lower a multiplication expression.
+ */
+
+Value Multiply::lower()
+{
+    Value left = _left->lower();
+    return compute(Q_MUL, size(this), left, _right->lower());
+}
+
+
+/*
+ * Function:	Divide::lower
+ *
+ * Description:	Lower a division expression.
+ */
+
+Value Divide::lower()
+{
+    Value left = _left->lower();
+    return compute(Q_DIV, size(this), left, _right->lower());
+}
+
+
+/*
+ * Function:	Remainder::lower
+ *
+ * Description:	Lower a remainder expression.
+ */
+
+Value Remainder::lower()
+{
+    Value left = _left->lower();
+    return compute(Q_REM, size(this), left, _right->lower());
+}
+
+
+/*
+ * Function:	Add::lower
+ *
+ * Description:	Lower an addition expression.
+ */
+
+Value Add::lower()
+{
+    Value left = _left->lower();
+    return compute(Q_ADD, size(this), left, _right->lower());
+}
+
+
+/*
+ * Function:	Subtract::lower
+ *
+ * Description:	Lower a subtraction expression.
+ */
+
+Value Subtract::lower()
+{
+    Value left = _left->lower();
+    return compute(Q_SUB, size(this), left, _right->lower());
+}
+
+
+/*
+ * Function:	compare (private)
+ *
+ * Description:	Lower a relational or equality expression, which produces
+ *		either zero or one.
+ */
+
+static Value compare(Expression *left, Expression *right, Condition cond)
+{
+    Value value = left->lower();
+    Quad quad(Q_SET, proc->newTemp(SIZEOF_INT), value, right->lower());
+
+    quad._cond = cond;
+    emit(quad);
+    return quad._dst;
+}
+
+
+/*
+ * Function:	compare (private)
+ *
+ * Description:	Lower a relational or equality expression used as a test.
+ */
+
+static void compare(Expression *left, Expression *right, Condition cond,
+	unsigned ifTrue, unsigned ifFalse)
+{
+    Value value = left->lower();
+    branch(cond, value, right->lower(), ifTrue, ifFalse);
+}
+
+
+/*
+ * Function:	LessThan::lower
+ *
+ * Description:	Lower a less-than expression.
+ */
+
+Value LessThan::lower()
+{
+    return compare(_left, _right, CC_L);
+}
+
+
+/*
+ * Function:	LessThan::branch
+ *
+ * Description:	Lower a less-than expression used as a test.
+ */
+
+void LessThan::branch(unsigned ifTrue, unsigned ifFalse)
+{
+    compare(_left, _right, CC_L, ifTrue, ifFalse);
+}
+
+
+/*
+ * Function:	GreaterThan::lower
+ *
+ * Description:	Lower a greater-than expression.
+ */
+
+Value GreaterThan::lower()
+{
+    return compare(_left, _right, CC_G);
+}
+
+
+/*
+ * Function:	GreaterThan::branch
+ *
+ * Description:	Lower a greater-than expression used as a test.
+ */
+
+void GreaterThan::branch(unsigned ifTrue, unsigned ifFalse)
+{
+    compare(_left, _right, CC_G, ifTrue, ifFalse);
+}
+
+
+/*
+ * Function:	LessOrEqual::lower
+ *
+ * Description:	Lower a less-than-or-equal expression.
+ */
+
+Value LessOrEqual::lower()
+{
+    return compare(_left, _right, CC_LE);
+}
+
+
+/*
+ * Function:	LessOrEqual::branch
+ *
+ * Description:	Lower a less-than-or-equal expression used as a test.
+ */
+
+void LessOrEqual::branch(unsigned ifTrue, unsigned ifFalse)
+{
+    compare(_left, _right, CC_LE, ifTrue, ifFalse);
+}
+
+
+/*
+ * Function:	GreaterOrEqual::lower
+ *
+ * Description:	Lower a greater-than-or-equal expression.
+ */
+
+Value GreaterOrEqual::lower()
+{
+    return compare(_left, _right, CC_GE);
+}
+
+
+/*
+ * Function:	GreaterOrEqual::branch
+ *
+ * Description:	Lower a greater-than-or-equal expression used as a test.
+ */
+
+void GreaterOrEqual::branch(unsigned ifTrue, unsigned ifFalse)
+{
+    compare(_left, _right, CC_GE, ifTrue, ifFalse);
+}
+
+
+/*
+ * Function:	Equal::lower
+ *
+ * Description:	Lower an equality expression.
+ */
+
+Value Equal::lower()
+{
+    return compare(_left, _right, CC_E);
+}
+
+
+/*
+ * Function:	Equal::branch
+ *
+ * Description:	Lower an equality expression used as a test.
+ */
+
+void Equal::branch(unsigned ifTrue, unsigned ifFalse)
+{
+    compare(_left, _right, CC_E, ifTrue, ifFalse);
+}
+
+
+/*
+ * Function:	NotEqual::lower
+ *
+ * Description:	Lower an inequality expression.
+ */
+
+Value NotEqual::lower()
+{
+    return compare(_left, _right, CC_NE);
+}
+
+
+/*
+ * Function:	NotEqual::branch
+ *
+ * Description:	Lower an inequality expression used as a test.
+ */
+
+void NotEqual::branch(unsigned ifTrue, unsigned ifFalse)
+{
+    compare(_left, _right, CC_NE, ifTrue, ifFalse);
+}
+
+
+/*
+ * Function:	logical (private)
+ *
+ * Description:	Lower a logical expression whose value is needed by
+ *		branching on it and then setting a temporary to zero or one
+ *		in each outcome.
+ */
+
+static Value logical(Expression *expr)
+{
+    Value result = proc->newTemp(SIZEOF_INT);
+    unsigned ifTrue, ifFalse, exit;
+
+
+    ifTrue = proc->newBlock();
+    ifFalse = proc->newBlock();
+    exit = proc->newBlock();
+
+    expr->branch(ifTrue, ifFalse);
+
+    enter(ifTrue);
+    emit(Quad(Q_COPY, result, Value::constant(1, SIZEOF_INT)));
+    jump(exit);
+
+    enter(ifFalse);
+    emit(Quad(Q_COPY, result, Value::constant(0, SIZEOF_INT)));
+    enter(exit);
+
+    return result;
+}
+
+
+/*
+ * Function:	LogicalAnd::lower
+ *
+ * Description:	Lower a logical-and expression.
+ */
+
+Value LogicalAnd::lower()
+{
+    return logical(this);
+}
+
+
+/*
+ * Function:	LogicalAnd::branch
+ *
+ * Description:	Lower a logical-and expression used as a test.  The right
+ *		operand is only tested if the left operand is true.
+ */
+
+void LogicalAnd::branch(unsigned ifTrue, unsigned ifFalse)
+{
+    unsigned next = proc->newBlock();
+
+    _left->branch(next, ifFalse);
+    enter(next);
+    _right->branch(ifTrue, ifFalse);
+}
+
+
+/*
+ * Function:	LogicalOr::lower
+ *
+ * Description:	Lower a logical-or expression.
+ */
+
+Value LogicalOr::lower()
+{
+    return logical(this);
+}
+
+
+/*
+ * Function:	LogicalOr::branch
+ *
+ * Description:	Lower a logical-or expression used as a test.  The right
+ *		operand is only tested if the left operand is false.
+ */
+
+void LogicalOr::branch(unsigned ifTrue, unsigned ifFalse)
+{
+    unsigned next = proc->newBlock();
+
+    _left->branch(ifTrue, next);
+    enter(next);
+    _right->branch(ifTrue, ifFalse);
+}
+
+
+/*
+ * Function:	Expression::branch
+ *
+ * Description:	Lower an expression used as a test by comparing its value
+ *		against zero.
+ */
+
+void Expression::branch(unsigned ifTrue, unsigned ifFalse)
+{
+    Value value = lower();
+    ::branch(CC_NE, value, Value::constant(0, value._size), ifTrue, ifFalse);
+}
+
+
+/*
+ * Function:	Assignment::lower
+ *
+ * Description:	Lower an assignment statement into a store.
+ */
+
+void Assignment::lower()
+{
+    Expression *pointer;
+    const Symbol *symbol;
+    Value value = _right->lower();
+    Quad quad(Q_STORE);
+
+
+    if (_left->isDereference(pointer))
+	quad._args.push_back(pointer->lower());
+    else {
+	assert(_left->isIdentifier(symbol));
+	reference(symbol, quad);
+    }
+
+    value._size = size(_right);
+    quad._args.push_back(value);
+    emit(quad);
+}
+
+
+/*
+ * Function:	Return::lower
+ *
+ * Description:	Lower a return statement.  Anything following it is
+ *		unreachable, but is lowered into a new block anyway.
+ */
+
+void Return::lower()
+{
+    emit(Quad(Q_RETURN, Value(), _expr->lower()));
+    current = proc->newBlock();
+}
+
+
+/*
+ * Function:	Block::lower
+ *
+ * Description:	Lower a block, which is just lowering each statement.
+ */
+
+void Block::lower()
+{
+    for (auto stmt : _stmts)
+	stmt->lower();
+}
+
+
+/*
+ * Function:	Simple::lower
+ *
+ * Description:	Lower a simple statement, discarding its value.
+ */
+
+void Simple::lower()
+{
+    _expr->lower();
+}
+
+
+/*
+ * Function:	While::lower
+ *
+ * Description:	Lower a while statement.
+ */
+
+void While::lower()
+{
+    unsigned loop, body, exit;
+
+
+    loop = proc->newBlock();
+    body = proc->newBlock();
+    exit = proc->newBlock();
+
+    enter(loop);
+    _expr->branch(body, exit);
+
+    enter(body);
+    _stmt->lower();
+    jump(loop);
+
+    current = exit;
+}
+
+
+/*
+ * Function:	For::lower
+ *
+ * Description:	Lower a for statement.
+ */
+
+void For::lower()
+{
+    unsigned loop, body, exit;
+
+
+    _init->lower();
+
+    loop = proc->newBlock();
+    body = proc->newBlock();
+    exit = proc->newBlock();
+
+    enter(loop);
+    _expr->branch(body, exit);
+
+    enter(body);
+    _stmt->lower();
+    _incr->lower();
+    jump(loop);
+
+    current = exit;
+}
+
+
+/*
+ * Function:	If::lower
+ *
+ * Description:	Lower an if-then or if-then-else statement.
+ */
+
+void If::lower()
+{
+    unsigned thenBlock, elseBlock, exit;
+
+
+    thenBlock = proc->newBlock();
+    elseBlock = proc->newBlock();
+    exit = _elseStmt != nullptr ? proc->newBlock() : elseBlock;
+
+    _expr->branch(thenBlock, elseBlock);
+
+    enter(thenBlock);
+    _thenStmt->lower();
+
+    if (_elseStmt != nullptr) {
+	enter(exit);
+	current = elseBlock;
+	_elseStmt->lower();
+    }
+
+    enter(exit);
+}
+
+
+/*
+ * Function:	recurse (private)
+ *
+ * Description:	Replace each call of a procedure to itself whose result is
+ *		immediately returned by a jump back to the start of its
+ *		body, after storing the arguments into the parameters.  The
+ *		entry block is split after the parameters passed in
+ *		registers are stored, so that they are not stored again.
+ *		Nothing is done if a local variable may still be in use
+ *		through its address.
+ */
+
+static void recurse(const Symbols &symbols, unsigned count)
+{
+    vector<unsigned> sites;
+    unsigned body, stored;
+    Quad quad(Q_STORE);
+    Value arg;
+
+
+    if (proc->takesAddress())
+	return;
+
+    for (unsigned i = 0; i < proc->_blocks.size(); i ++) {
+	const vector<Quad> &quads = proc->_blocks[i]._quads;
+
+	if (quads.size() >= 2 && quads[quads.size() - 2].isTailCall(quads.back())
+		&& quads[quads.size() - 2]._name == proc->_name
+		&& quads[quads.size() - 2]._args.size() == count)
+	    sites.push_back(i);
+    }
+
+    if (sites.empty())
+	return;
+
+    body = proc->newBlock();
+    stored = proc->_params.size();
+
+    vector<Quad> &entry = proc->_blocks[0]._quads;
+    proc->_blocks[body]._quads.assign(entry.begin() + stored, entry.end());
+    entry.erase(entry.begin() + stored, entry.end());
+
+    current = 0;
+    jump(body);
+
+    for (auto site : sites) {
+	current = site > 0 ? site : body;
+	vector<Quad> &quads = proc->_blocks[current]._quads;
+	Quad call = quads[quads.size() - 2];
+	quads.erase(quads.end() - 2, quads.end());
+
+	for (unsigned i = 0; i < count; i ++) {
+	    arg = call._args[i];
+
+	    if (arg.isTemp() && arg._size < symbols[i]->type().size())
+		arg = compute(Q_EXT, symbols[i]->type().size(), arg);
+
+	    arg._size = symbols[i]->type().size();
+	    quad._args.clear();
+	    reference(symbols[i], quad);
+	    quad._args.push_back(arg);
+	    emit(quad);
+	}
+
+	jump(body);
+    }
+}
+
+
+/*
+ * Function:	Function::lower
+ *
+ * Description:	Lower this function into a new procedure.  The parameters
+ *		passed in registers arrive in temporaries and are stored
+ *		into their slots on entry.  Storage must already have been
+ *		allocated.  Tail recursion is turned into a loop.
+ */
+
+Procedure *Function::lower()
+{
+    Parameters *params;
+    Symbols symbols;
+    Value param;
+    Quad quad(Q_STORE);
+
+
+    proc = new Procedure(global_prefix + _id->name());
+    current = 0;
+
+    params = _id->type().parameters();
+    symbols = _body->declarations()->symbols();
+
+    for (unsigned i = 0; i < NUM_PARAM_REGS && i < params->size(); i ++) {
+	param = proc->newTemp(symbols[i]->type().size());
+	proc->_params.push_back(param._temp);
+
+	quad._args.clear();
+	reference(symbols[i], quad);
+	quad._args.push_back(param);
+	emit(quad);
+    }
+
+    _body->lower();
+
+    if (!terminated())
+	emit(Quad(Q_RETURN));
+
+    recurse(symbols, params->size());
+    proc->_returns = Type(_id->type().specifier(), _id->type().indirection()).size() > 0;
+    proc->link();
+    return proc;
+}
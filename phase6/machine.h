@@ -10,22 +10,27 @@
 # define SIZEOF_LONG 8
 # define SIZEOF_PTR  8
 # define SIZEOF_REG  8
+# define SIZEOF_VECTOR 16
 
 # define SIZEOF_PARAM 8
 # define NUM_PARAM_REGS 6
 # define STACK_ALIGNMENT 16
+# define RED_ZONE 128
+# define LOOP_ALIGNMENT 16
 
 # if defined (__linux__) && defined(__x86_64__)
 
 # define global_prefix ""
 # define global_suffix ""
 # define label_prefix ".L"
+# define init_section "\t.section\t.init_array,\"aw\""
 
 # elif defined (__APPLE__) && defined(__x86_64__)
 
 # define global_prefix "_"
 # define global_suffix "(%rip)"
 # define label_prefix "L"
+# define init_section "\t.mod_init_func"
 
 # else
 
@@ -0,0 +1,1153 @@
+/*
+ * File:	object.cpp
+ *
+ * Description:	This file contains the public and private function
+ *		definitions for encoding instructions and writing them as
+ *		a relocatable object file for Simple C.
+ *
+ *		Rather than writing assembly text to be run through the
+ *		assembler, each function can be encoded directly into the
+ *		machine code of the Intel 64-bit processor, and the code,
+ *		the string literals, and the global variables are then
+ *		written as an ELF object file for the system linker.
+ *
+ *		Each instruction is encoded into a chunk of bytes of its
+ *		own.  A jump to a label within the function is left until
+ *		the chunks are laid out, since its size depends on how far
+ *		it has to go: every such jump starts out short, and those
+ *		that cannot reach their label are made long until nothing
+ *		changes.  Anything else that refers to a symbol is given a
+ *		relocation for the linker to resolve.  A global variable or
+ *		string literal is addressed absolutely, just as in the
+ *		assembly text, so the program cannot be position
+ *		independent, and a call is made relative to the procedure
+ *		linkage table.  The string literals are placed in the data
+ *		section and are referred to relative to its start.
+ *
+ *		Instead of being written out, the same code can be loaded
+ *		into memory, relocated there, and run immediately.
+ */
+
+# include <map>
+# include <cassert>
+# include <cstring>
+# include <cstdlib>
+# include <iostream>
+# include <dlfcn.h>
+# include <sys/mman.h>
+# include <unistd.h>
+# include "object.h"
+# include "machine.h"
+
+# define ELF_HEADER_SIZE 64
+# define ELF_SECTION_SIZE 64
+# define ELF_SYMBOL_SIZE 24
+# define ELF_RELA_SIZE 24
+
+# define ET_REL 1
+# define EM_X86_64 62
+
+# define SHT_PROGBITS 1
+# define SHT_SYMTAB 2
+# define SHT_STRTAB 3
+# define SHT_RELA 4
+# define SHF_WRITE 0x1
+# define SHF_ALLOC 0x2
+# define SHF_EXECINSTR 0x4
+# define SHF_INFO_LINK 0x40
+# define SHN_COMMON 0xfff2
+
+# define STB_GLOBAL 1
+# define STT_NOTYPE 0
+# define STT_OBJECT 1
+# define STT_FUNC 2
+# define STT_SECTION 3
+
+# define R_X86_64_64 1
+# define R_X86_64_PLT32 4
+# define R_X86_64_32 10
+# define R_X86_64_32S 11
+
+# define TEXT_SECTION 1
+# define DATA_SECTION 2
+# define NOTE_SECTION 3
+# define RELA_SECTION 4
+# define SYMTAB_SECTION 5
+# define STRTAB_SECTION 6
+# define SHSTRTAB_SECTION 7
+# define NUM_SECTIONS 8
+
+# define MAX_ALIGNMENT 16
+# define STUB_SIZE 16
+
+using namespace std;
+
+struct Relocation {
+    unsigned long offset;
+    string symbol;
+    unsigned type;
+    long addend;
+};
+
+struct Chunk {
+    string bytes;
+    vector<Relocation> relocations;
+    string label, target;
+    unsigned align;
+    int cond;
+    bool wide;
+    unsigned long offset;
+
+    Chunk() : align(0), cond(-1), wide(false), offset(0) {}
+};
+
+struct Definition {
+    string name;
+    unsigned long value, size;
+};
+
+static string text, data;
+static vector<Relocation> relocations;
+static vector<Definition> functions, commons;
+static map<string, unsigned long> strings;
+
+static unsigned conditions[] = {0x4, 0x5, 0xc, 0xd, 0xe, 0xf};
+
+static const char *nops[] = {
+    "",
+    "\x90",
+    "\x66\x90",
+    "\x0f\x1f\x00",
+    "\x0f\x1f\x40\x00",
+    "\x0f\x1f\x44\x00\x00",
+    "\x66\x0f\x1f\x44\x00\x00",
+    "\x0f\x1f\x80\x00\x00\x00\x00",
+    "\x0f\x1f\x84\x00\x00\x00\x00\x00",
+    "\x66\x0f\x1f\x84\x00\x00\x00\x00\x00",
+};
+
+
+/*
+ * Function:	put (private)
+ *
+ * Description:	Append a value of the given number of bytes to a string
+ *		in little-endian order.
+ */
+
+static void put(string &s, unsigned long value, unsigned n)
+{
+    for (unsigned i = 0; i < n; i ++)
+	s += (char) (value >> 8 * i);
+}
+
+
+/*
+ * Function:	pad (private)
+ *
+ * Description:	Pad the code with no-ops up to the given offset, using as
+ *		few of the long forms as possible.
+ */
+
+static void pad(string &code, unsigned long offset)
+{
+    unsigned n;
+
+
+    while (code.size() < offset) {
+	n = min(offset - code.size(), 9UL);
+	code.append(nops[n], n);
+    }
+}
+
+
+/*
+ * Function:	number (private)
+ *
+ * Description:	Return the hardware encoding of a machine register.  An
+ *		SSE register is encoded just like a general purpose one.
+ */
+
+static unsigned number(Register *reg)
+{
+    assert(!reg->isVirtual());
+    return reg->number() % 16;
+}
+
+
+/*
+ * Function:	fits (private)
+ *
+ * Description:	Return whether an immediate operand or displacement fits
+ *		in a sign-extended byte.
+ */
+
+static bool fits(const Operand &op)
+{
+    return op._symbol.empty() && op._value == (signed char) op._value;
+}
+
+
+/*
+ * Function:	constant (private)
+ *
+ * Description:	Append the value of an immediate operand or the
+ *		displacement of a memory operand to a chunk, along with a
+ *		relocation if its value is a symbol.  A 32-bit value is
+ *		sign-extended if it is used as a 64-bit value, and
+ *		zero-extended otherwise.
+ */
+
+static void constant(Chunk &chunk, const Operand &op, unsigned n, bool sign)
+{
+    unsigned type;
+
+
+    if (!op._symbol.empty()) {
+	type = n == 8 ? R_X86_64_64 : (sign ? R_X86_64_32S : R_X86_64_32);
+	chunk.relocations.push_back(
+	    {chunk.bytes.size(), op._symbol, type, op._value});
+	put(chunk.bytes, 0, n);
+    } else
+	put(chunk.bytes, op._value, n);
+}
+
+
+/*
+ * Function:	opcode (private)
+ *
+ * Description:	Append an opcode of one, two, or three bytes to a chunk,
+ *		preceded by any mandatory prefix and REX prefix.
+ */
+
+static void opcode(Chunk &chunk, unsigned prefix, unsigned rex, unsigned code)
+{
+    if (prefix != 0)
+	put(chunk.bytes, prefix, 1);
+
+    if (rex != 0)
+	put(chunk.bytes, rex, 1);
+
+    if (code > 0xffff)
+	put(chunk.bytes, code >> 16, 1);
+
+    if (code > 0xff)
+	put(chunk.bytes, code >> 8, 1);
+
+    put(chunk.bytes, code, 1);
+}
+
+
+/*
+ * Function:	encode (private)
+ *
+ * Description:	Append an instruction with a ModR/M byte to a chunk.  The
+ *		reg field holds either a register or an extension of the
+ *		opcode, and the r/m field a register or memory operand.  A
+ *		memory operand without a base register is addressed
+ *		absolutely using a SIB byte, which is the only form that
+ *		works without a RIP-relative displacement.  The byte
+ *		registers above %bl can only be named with a REX prefix.
+ */
+
+static void encode(Chunk &chunk, unsigned prefix, unsigned code, unsigned size,
+	unsigned reg, bool byte, const Operand &rm)
+{
+    unsigned rex, base, index, scale, mod;
+
+
+    rex = size == 8 ? 0x48 : 0;
+
+    if (reg & 8)
+	rex |= 0x44;
+
+    if (byte && reg >= 4)
+	rex |= 0x40;
+
+    if (rm._kind == Operand::REG) {
+	base = number(rm._base);
+
+	if (base & 8)
+	    rex |= 0x41;
+
+	if (rm._size == 1 && base >= 4)
+	    rex |= 0x40;
+
+	opcode(chunk, prefix, rex, code);
+	put(chunk.bytes, 0xc0 | (reg & 7) << 3 | (base & 7), 1);
+	return;
+    }
+
+    assert(rm._kind == Operand::MEM);
+    index = rm._index != nullptr ? number(rm._index) : 4;
+    base = rm._base != nullptr ? number(rm._base) : 5;
+
+    if (index & 8)
+	rex |= 0x42;
+
+    if (base & 8)
+	rex |= 0x41;
+
+    for (scale = 0; (1u << scale) < rm._scale; scale ++)
+	continue;
+
+    opcode(chunk, prefix, rex, code);
+
+    if (rm._base == nullptr) {
+	put(chunk.bytes, (reg & 7) << 3 | 4, 1);
+	put(chunk.bytes, scale << 6 | (index & 7) << 3 | 5, 1);
+	constant(chunk, rm, 4, true);
+	return;
+    }
+
+    if (rm._value == 0 && rm._symbol.empty() && (base & 7) != 5)
+	mod = 0;
+    else if (fits(rm))
+	mod = 1;
+    else
+	mod = 2;
+
+    if (rm._index != nullptr || (base & 7) == 4) {
+	put(chunk.bytes, mod << 6 | (reg & 7) << 3 | 4, 1);
+	put(chunk.bytes, scale << 6 | (index & 7) << 3 | (base & 7), 1);
+    } else
+	put(chunk.bytes, mod << 6 | (reg & 7) << 3 | (base & 7), 1);
+
+    if (mod == 1)
+	constant(chunk, rm, 1, true);
+    else if (mod == 2)
+	constant(chunk, rm, 4, true);
+}
+
+
+/*
+ * Function:	encode (private)
+ *
+ * Description:	Append an instruction whose reg field holds a register.
+ */
+
+static void encode(Chunk &chunk, unsigned prefix, unsigned code, unsigned size,
+	const Operand &reg, const Operand &rm)
+{
+    assert(reg._kind == Operand::REG);
+    encode(chunk, prefix, code, size, number(reg._base), reg._size == 1, rm);
+}
+
+
+/*
+ * Function:	encode (private)
+ *
+ * Description:	Append an instruction whose reg field extends the opcode.
+ */
+
+static void encode(Chunk &chunk, unsigned code, unsigned size, unsigned ext,
+	const Operand &rm)
+{
+    encode(chunk, 0, code, size, ext, false, rm);
+}
+
+
+/*
+ * Function:	arithmetic (private)
+ *
+ * Description:	Append one of the classic arithmetic instructions, which
+ *		share a common pattern of opcodes given by the extension
+ *		used with an immediate operand.  There is a shorter form
+ *		for a large immediate operand with %rax.
+ */
+
+static void arithmetic(Chunk &chunk, unsigned ext, unsigned size,
+	const Operand &src, const Operand &dst)
+{
+    unsigned code = ext << 3 | (size == 1 ? 0 : 1);
+
+
+    if (src.isImm()) {
+	if (size == 1) {
+	    encode(chunk, 0x80, size, ext, dst);
+	    constant(chunk, src, 1, true);
+	} else if (fits(src)) {
+	    encode(chunk, 0x83, size, ext, dst);
+	    constant(chunk, src, 1, true);
+	} else if (dst.isReg(rax)) {
+	    opcode(chunk, 0, size == 8 ? 0x48 : 0, ext << 3 | 5);
+	    constant(chunk, src, 4, true);
+	} else {
+	    encode(chunk, 0x81, size, ext, dst);
+	    constant(chunk, src, 4, true);
+	}
+
+    } else if (src.isReg())
+	encode(chunk, 0, code, size, src, dst);
+    else
+	encode(chunk, 0, code | 2, size, dst, src);
+}
+
+
+/*
+ * Function:	shift (private)
+ *
+ * Description:	Append a shift by an immediate amount or by %cl.
+ */
+
+static void shift(Chunk &chunk, unsigned ext, unsigned size,
+	const Operand &src, const Operand &dst)
+{
+    unsigned code = size == 1 ? 0 : 1;
+
+
+    if (!src.isImm())
+	encode(chunk, 0xd2 | code, size, ext, dst);
+    else if (src._value == 1)
+	encode(chunk, 0xd0 | code, size, ext, dst);
+    else {
+	encode(chunk, 0xc0 | code, size, ext, dst);
+	constant(chunk, src, 1, false);
+    }
+}
+
+
+/*
+ * Function:	move (private)
+ *
+ * Description:	Append a move of an immediate value.  A 64-bit register
+ *		can only be given a value that does not fit in 32 bits
+ *		using the one instruction with a 64-bit immediate.
+ */
+
+static void move(Chunk &chunk, unsigned size, const Operand &src,
+	const Operand &dst)
+{
+    unsigned reg, rex;
+
+
+    if (dst.isMem() || (size == 8 && src.isSmall())) {
+	encode(chunk, size == 1 ? 0xc6 : 0xc7, size, 0, dst);
+	constant(chunk, src, min(size, 4u), size == 8);
+	return;
+    }
+
+    reg = number(dst._base);
+    rex = size == 8 ? 0x48 : 0;
+
+    if (reg & 8)
+	rex |= 0x41;
+
+    if (size == 1 && reg >= 4)
+	rex |= 0x40;
+
+    opcode(chunk, 0, rex, (size == 1 ? 0xb0 : 0xb8) | (reg & 7));
+    constant(chunk, src, size, false);
+}
+
+
+/*
+ * Function:	stack (private)
+ *
+ * Description:	Append a push or pop of a register, which is encoded in
+ *		the opcode itself.
+ */
+
+static void stack(Chunk &chunk, unsigned code, const Operand &op)
+{
+    unsigned reg = number(op._base);
+
+    opcode(chunk, 0, reg & 8 ? 0x41 : 0, code | (reg & 7));
+}
+
+
+/*
+ * Function:	jump (private)
+ *
+ * Description:	Append a jump or call to the given target.  A jump to a
+ *		label within the function is resolved once the function
+ *		is laid out, while anything else is relocated.
+ */
+
+static void jump(Chunk &chunk, unsigned code, int cond, const string &target,
+	const map<string, unsigned long> &labels)
+{
+    if (code != 0xe8 && labels.count(target) > 0) {
+	chunk.target = target;
+	chunk.cond = cond;
+	return;
+    }
+
+    opcode(chunk, 0, 0, cond < 0 ? code : 0x0f80 | conditions[cond]);
+    chunk.relocations.push_back(
+	{chunk.bytes.size(), target, R_X86_64_PLT32, -4});
+    put(chunk.bytes, 0, 4);
+}
+
+
+/*
+ * Function:	encode (private)
+ *
+ * Description:	Encode an instruction into a chunk.  The operands are in
+ *		AT&T order, so the destination is the last one.
+ */
+
+static void encode(const Instruction &inst, Chunk &chunk,
+	const map<string, unsigned long> &labels)
+{
+    const vector<Operand> &ops = inst._operands;
+    unsigned size = inst._size, byte = size == 1 ? 0 : 1;
+    unsigned prefix;
+
+
+    switch (inst._opcode) {
+    case LABEL:
+	chunk.label = ops[0]._symbol;
+	chunk.align = size;
+	break;
+
+    case MOV:
+	if (ops[0].isImm())
+	    move(chunk, size, ops[0], ops[1]);
+	else if (ops[0].isReg())
+	    encode(chunk, 0, 0x88 | byte, size, ops[0], ops[1]);
+	else
+	    encode(chunk, 0, 0x8a | byte, size, ops[1], ops[0]);
+	break;
+
+    case MOVS:
+	if (ops[0]._size == 4)
+	    encode(chunk, 0, 0x63, ops[1]._size, ops[1], ops[0]);
+	else
+	    encode(chunk, 0, 0x0fbe, ops[1]._size, ops[1], ops[0]);
+	break;
+
+    case MOVZ:
+	assert(ops[0]._size == 1);
+	encode(chunk, 0, 0x0fb6, ops[1]._size, ops[1], ops[0]);
+	break;
+
+    case LEA:
+	encode(chunk, 0, 0x8d, size, ops[1], ops[0]);
+	break;
+
+    case ADD:
+	arithmetic(chunk, 0, size, ops[0], ops[1]);
+	break;
+
+    case AND:
+	arithmetic(chunk, 4, size, ops[0], ops[1]);
+	break;
+
+    case SUB:
+	arithmetic(chunk, 5, size, ops[0], ops[1]);
+	break;
+
+    case CMP:
+	arithmetic(chunk, 7, size, ops[0], ops[1]);
+	break;
+
+    case IMUL:
+	if (ops.size() == 1)
+	    encode(chunk, 0xf6 | byte, size, 5, ops[0]);
+	else if (!ops[0].isImm())
+	    encode(chunk, 0, 0x0faf, size, ops[1], ops[0]);
+	else if (fits(ops[0])) {
+	    encode(chunk, 0, 0x6b, size, ops.back(), ops[1]);
+	    constant(chunk, ops[0], 1, true);
+	} else {
+	    encode(chunk, 0, 0x69, size, ops.back(), ops[1]);
+	    constant(chunk, ops[0], 4, true);
+	}
+	break;
+
+    case IDIV:
+	encode(chunk, 0xf6 | byte, size, 7, ops[0]);
+	break;
+
+    case NEG:
+	encode(chunk, 0xf6 | byte, size, 3, ops[0]);
+	break;
+
+    case SHL:
+	shift(chunk, 4, size, ops[0], ops[1]);
+	break;
+
+    case SHR:
+	shift(chunk, 5, size, ops[0], ops[1]);
+	break;
+
+    case SAR:
+	shift(chunk, 7, size, ops[0], ops[1]);
+	break;
+
+    case TEST:
+	if (ops[0].isImm() && size > 1 && ops[1].isReg(rax)) {
+	    opcode(chunk, 0, size == 8 ? 0x48 : 0, 0xa9);
+	    constant(chunk, ops[0], 4, true);
+	} else if (ops[0].isImm()) {
+	    encode(chunk, 0xf6 | byte, size, 0, ops[1]);
+	    constant(chunk, ops[0], min(size, 4u), true);
+	} else if (ops[0].isReg())
+	    encode(chunk, 0, 0x84 | byte, size, ops[0], ops[1]);
+	else
+	    encode(chunk, 0, 0x84 | byte, size, ops[1], ops[0]);
+	break;
+
+    case SET:
+	encode(chunk, 0x0f90 | conditions[inst._cond], 0, 0, ops[0]);
+	break;
+
+    case CMOV:
+	encode(chunk, 0, 0x0f40 | conditions[inst._cond], size, ops[1], ops[0]);
+	break;
+
+    case CVT:
+	opcode(chunk, 0, size == 8 ? 0x48 : 0, 0x99);
+	break;
+
+    case PUSH:
+	if (ops[0].isReg())
+	    stack(chunk, 0x50, ops[0]);
+	else if (ops[0].isMem())
+	    encode(chunk, 0xff, 0, 6, ops[0]);
+	else if (fits(ops[0])) {
+	    opcode(chunk, 0, 0, 0x6a);
+	    constant(chunk, ops[0], 1, true);
+	} else {
+	    opcode(chunk, 0, 0, 0x68);
+	    constant(chunk, ops[0], 4, true);
+	}
+	break;
+
+    case POP:
+	if (ops[0].isReg())
+	    stack(chunk, 0x58, ops[0]);
+	else
+	    encode(chunk, 0x8f, 0, 0, ops[0]);
+	break;
+
+    case JMP:
+	jump(chunk, 0xe9, -1, ops[0]._symbol, labels);
+	break;
+
+    case JCC:
+	jump(chunk, 0, inst._cond, ops[0]._symbol, labels);
+	break;
+
+    case CALL:
+	jump(chunk, 0xe8, -1, ops[0]._symbol, labels);
+	break;
+
+    case RET:
+	if (ops.empty())
+	    opcode(chunk, 0, 0, 0xc3);
+	else
+	    jump(chunk, 0xe9, -1, ops[0]._symbol, labels);
+	break;
+
+    case MOVDQU:
+    case MOVDQA:
+	prefix = inst._opcode == MOVDQU ? 0xf3 : 0x66;
+
+	if (ops[1].isMem())
+	    encode(chunk, prefix, 0x0f7f, 0, ops[0], ops[1]);
+	else
+	    encode(chunk, prefix, 0x0f6f, 0, ops[1], ops[0]);
+	break;
+
+    case PADD:
+	encode(chunk, 0x66, size == 4 ? 0x0ffe : 0x0fd4, 0, ops[1], ops[0]);
+	break;
+
+    case PSUB:
+	encode(chunk, 0x66, size == 4 ? 0x0ffa : 0x0ffb, 0, ops[1], ops[0]);
+	break;
+
+    case PMULUDQ:
+	encode(chunk, 0x66, 0x0ff4, 0, ops[1], ops[0]);
+	break;
+
+    case PCMPGT:
+	encode(chunk, 0x66, size == 4 ? 0x0f66 : 0x0f3837, 0, ops[1], ops[0]);
+	break;
+
+    case PXOR:
+	encode(chunk, 0x66, 0x0fef, 0, ops[1], ops[0]);
+	break;
+
+    case PUNPCKL:
+	encode(chunk, 0x66, size == 4 ? 0x0f62 : 0x0f6c, 0, ops[1], ops[0]);
+	break;
+
+    case PSRL:
+	encode(chunk, 0x66, size == 4 ? 0x0f72 : 0x0f73, 0, 2, false, ops[1]);
+	constant(chunk, ops[0], 1, false);
+	break;
+
+    case PSHUFD:
+	encode(chunk, 0x66, 0x0f70, 0, ops[2], ops[1]);
+	constant(chunk, ops[0], 1, false);
+	break;
+    }
+}
+
+
+/*
+ * Function:	length (private)
+ *
+ * Description:	Return the length of a chunk, including its jump.
+ */
+
+static unsigned long length(const Chunk &chunk)
+{
+    if (chunk.target.empty())
+	return chunk.bytes.size();
+
+    if (!chunk.wide)
+	return 2;
+
+    return chunk.cond < 0 ? 5 : 6;
+}
+
+
+/*
+ * Function:	layout (private)
+ *
+ * Description:	Assign offsets to the chunks of a function placed at the
+ *		end of the code, and to its labels, and return whether
+ *		every jump can reach its label.  Those that cannot are
+ *		made long for the next attempt.
+ */
+
+static bool layout(vector<Chunk> &chunks, map<string, unsigned long> &labels)
+{
+    unsigned long offset = text.size();
+    bool reached = true;
+    long disp;
+
+
+    for (auto &chunk : chunks) {
+	if (chunk.align > 1)
+	    offset = (offset + chunk.align - 1) & ~(chunk.align - 1UL);
+
+	chunk.offset = offset;
+	offset += length(chunk);
+
+	if (!chunk.label.empty())
+	    labels[chunk.label] = chunk.offset;
+    }
+
+    for (auto &chunk : chunks)
+	if (!chunk.target.empty() && !chunk.wide) {
+	    disp = labels[chunk.target] - (chunk.offset + length(chunk));
+
+	    if (disp != (signed char) disp) {
+		chunk.wide = true;
+		reached = false;
+	    }
+	}
+
+    return reached;
+}
+
+
+/*
+ * Function:	assemble
+ *
+ * Description:	Encode the instructions of a function and append them to
+ *		the code, defining the function itself as a global symbol.
+ */
+
+void assemble(const string &name, const Instructions &code)
+{
+    map<string, unsigned long> labels;
+    vector<Chunk> chunks(code.size());
+    unsigned long start;
+    long disp;
+
+
+    for (auto &inst : code)
+	if (inst._opcode == LABEL)
+	    labels[inst._operands[0]._symbol] = 0;
+
+    for (unsigned i = 0; i < code.size(); i ++)
+	encode(code[i], chunks[i], labels);
+
+    while (!layout(chunks, labels))
+	continue;
+
+    start = text.size();
+
+    for (auto &chunk : chunks) {
+	pad(text, chunk.offset);
+
+	for (auto reloc : chunk.relocations) {
+	    reloc.offset += chunk.offset;
+	    relocations.push_back(reloc);
+	}
+
+	text += chunk.bytes;
+
+	if (!chunk.target.empty()) {
+	    disp = labels[chunk.target] - (chunk.offset + length(chunk));
+
+	    if (!chunk.wide) {
+		if (chunk.cond < 0)
+		    put(text, 0xeb, 1);
+		else
+		    put(text, 0x70 | conditions[chunk.cond], 1);
+
+		put(text, disp, 1);
+	    } else {
+		if (chunk.cond < 0)
+		    put(text, 0xe9, 1);
+		else {
+		    put(text, 0x0f, 1);
+		    put(text, 0x80 | conditions[chunk.cond], 1);
+		}
+
+		put(text, disp, 4);
+	    }
+	}
+    }
+
+    functions.push_back({name, start, text.size() - start});
+}
+
+
+/*
+ * Function:	defineCommon
+ *
+ * Description:	Define a global variable of the given size, to be
+ *		allocated by the linker as a common symbol.  Like the
+ *		assembler, we align it on the largest power of two not
+ *		exceeding its size, up to a limit.
+ */
+
+void defineCommon(const string &name, unsigned long size)
+{
+    unsigned long align = 1;
+
+    while (align * 2 <= size && align < MAX_ALIGNMENT)
+	align *= 2;
+
+    commons.push_back({name, align, size});
+}
+
+
+/*
+ * Function:	defineString
+ *
+ * Description:	Define a string literal with the given label by placing
+ *		it in the data section.
+ */
+
+void defineString(const string &name, const string &value)
+{
+    strings[name] = data.size();
+    data += value;
+    data += '\0';
+}
+
+
+/*
+ * Function:	symbol (private)
+ *
+ * Description:	Append an entry to the symbol table, adding its name to
+ *		the string table.
+ */
+
+static void symbol(string &symtab, string &strtab, const string &name,
+	unsigned info, unsigned section, unsigned long value,
+	unsigned long size)
+{
+    put(symtab, name.empty() ? 0 : strtab.size(), 4);
+    put(symtab, info, 1);
+    put(symtab, 0, 1);
+    put(symtab, section, 2);
+    put(symtab, value, 8);
+    put(symtab, size, 8);
+
+    if (!name.empty())
+	strtab += name + '\0';
+}
+
+
+/*
+ * Function:	section (private)
+ *
+ * Description:	Append an entry to the section header table for the
+ *		given contents, which are placed at the end of the file.
+ *		Every section is aligned on a generous boundary within the
+ *		file, regardless of the alignment it asks for.
+ */
+
+static void section(string &headers, string &file, const string &contents,
+	unsigned name, unsigned type, unsigned long flags, unsigned link,
+	unsigned info, unsigned long align, unsigned long entsize)
+{
+    file.resize((file.size() + MAX_ALIGNMENT - 1) & ~(MAX_ALIGNMENT - 1UL));
+
+    put(headers, name, 4);
+    put(headers, type, 4);
+    put(headers, flags, 8);
+    put(headers, 0, 8);
+    put(headers, type != 0 ? file.size() : 0, 8);
+    put(headers, contents.size(), 8);
+    put(headers, link, 4);
+    put(headers, info, 4);
+    put(headers, align, 8);
+    put(headers, entsize, 8);
+
+    file += contents;
+}
+
+
+/*
+ * Function:	writeObject
+ *
+ * Description:	Write the code, data, and symbols as an ELF relocatable
+ *		object file.  The local symbols must come first in the
+ *		symbol table, and these are just the symbols for the code
+ *		and data sections.  The functions and global variables
+ *		follow, and then any symbols we referred to but did not
+ *		define.  An empty stack note keeps the linker from making
+ *		the stack executable.
+ */
+
+void writeObject(ostream &ostr)
+{
+    string symtab, strtab(1, '\0'), shstrtab(1, '\0'), rela, headers;
+    string file, header;
+    const char *names[NUM_SECTIONS];
+    unsigned offsets[NUM_SECTIONS];
+    map<string, unsigned> indices;
+    unsigned long addend;
+    unsigned index, symbols;
+
+
+    symbol(symtab, strtab, "", 0, 0, 0, 0);
+    symbol(symtab, strtab, "", STT_SECTION, TEXT_SECTION, 0, 0);
+    symbol(symtab, strtab, "", STT_SECTION, DATA_SECTION, 0, 0);
+    symbols = 3;
+
+    for (auto &def : functions) {
+	indices[def.name] = symbols ++;
+	symbol(symtab, strtab, def.name, STB_GLOBAL << 4 | STT_FUNC,
+	    TEXT_SECTION, def.value, def.size);
+    }
+
+    for (auto &def : commons) {
+	indices[def.name] = symbols ++;
+	symbol(symtab, strtab, def.name, STB_GLOBAL << 4 | STT_OBJECT,
+	    SHN_COMMON, def.value, def.size);
+    }
+
+    for (auto &reloc : relocations) {
+	if (strings.count(reloc.symbol) > 0) {
+	    index = DATA_SECTION;
+	    addend = reloc.addend + strings[reloc.symbol];
+
+	} else {
+	    if (indices.count(reloc.symbol) == 0) {
+		indices[reloc.symbol] = symbols ++;
+		symbol(symtab, strtab, reloc.symbol,
+		    STB_GLOBAL << 4 | STT_NOTYPE, 0, 0, 0);
+	    }
+
+	    index = indices[reloc.symbol];
+	    addend = reloc.addend;
+	}
+
+	put(rela, reloc.offset, 8);
+	put(rela, (unsigned long) index << 32 | reloc.type, 8);
+	put(rela, addend, 8);
+    }
+
+
+    /* Name the sections and write them after the file header, followed
+       by the section header table itself. */
+
+    names[0] = "";
+    names[TEXT_SECTION] = ".text";
+    names[DATA_SECTION] = ".data";
+    names[NOTE_SECTION] = ".note.GNU-stack";
+    names[RELA_SECTION] = ".rela.text";
+    names[SYMTAB_SECTION] = ".symtab";
+    names[STRTAB_SECTION] = ".strtab";
+    names[SHSTRTAB_SECTION] = ".shstrtab";
+
+    for (unsigned i = 0; i < NUM_SECTIONS; i ++) {
+	offsets[i] = i > 0 ? shstrtab.size() : 0;
+
+	if (i > 0)
+	    shstrtab += string(names[i]) + '\0';
+    }
+
+    file.assign(ELF_HEADER_SIZE, '\0');
+    section(headers, file, "", 0, 0, 0, 0, 0, 0, 0);
+    section(headers, file, text, offsets[TEXT_SECTION], SHT_PROGBITS,
+	SHF_ALLOC | SHF_EXECINSTR, 0, 0, MAX_ALIGNMENT, 0);
+    section(headers, file, data, offsets[DATA_SECTION], SHT_PROGBITS,
+	SHF_WRITE | SHF_ALLOC, 0, 0, 1, 0);
+    section(headers, file, "", offsets[NOTE_SECTION], SHT_PROGBITS, 0, 0,
+	0, 1, 0);
+    section(headers, file, rela, offsets[RELA_SECTION], SHT_RELA,
+	SHF_INFO_LINK, SYMTAB_SECTION, TEXT_SECTION, 8, ELF_RELA_SIZE);
+    section(headers, file, symtab, offsets[SYMTAB_SECTION], SHT_SYMTAB, 0,
+	STRTAB_SECTION, 3, 8, ELF_SYMBOL_SIZE);
+    section(headers, file, strtab, offsets[STRTAB_SECTION], SHT_STRTAB, 0,
+	0, 0, 1, 0);
+    section(headers, file, shstrtab, offsets[SHSTRTAB_SECTION], SHT_STRTAB,
+	0, 0, 0, 1, 0);
+
+    file.resize((file.size() + MAX_ALIGNMENT - 1) & ~(MAX_ALIGNMENT - 1UL));
+    header.assign("\x7f" "ELF\x02\x01\x01", 7);
+    header.resize(16, '\0');
+    put(header, ET_REL, 2);
+    put(header, EM_X86_64, 2);
+    put(header, 1, 4);
+    put(header, 0, 8);
+    put(header, 0, 8);
+    put(header, file.size(), 8);
+    put(header, 0, 4);
+    put(header, ELF_HEADER_SIZE, 2);
+    put(header, 0, 2);
+    put(header, 0, 2);
+    put(header, ELF_SECTION_SIZE, 2);
+    put(header, NUM_SECTIONS, 2);
+    put(header, SHSTRTAB_SECTION, 2);
+
+    file.replace(0, header.size(), header);
+    file += headers;
+    ostr.write(file.data(), file.size());
+}
+
+
+/*
+ * Function:	patch (private)
+ *
+ * Description:	Write a relocated value of the given number of bytes into
+ *		memory, and return whether it fits.
+ */
+
+static bool patch(char *location, long value, unsigned n, bool sign)
+{
+    memcpy(location, &value, n);
+
+    if (n == 8)
+	return true;
+
+    return sign ? value == (int) value : value == (unsigned) value;
+}
+
+
+/*
+ * Function:	runObject
+ *
+ * Description:	Load the code, data, and global variables into memory,
+ *		relocate them there, and call main, returning its result.
+ *		Everything is placed in the low two gigabytes so that the
+ *		absolute addresses fit in 32 bits.  A function in a shared
+ *		library is likely to be much further away than a call can
+ *		reach, so each one is called through a stub following the
+ *		code, which jumps indirectly to the address given by the
+ *		dynamic linker.
+ */
+
+int runObject()
+{
+    map<string, unsigned long> addresses;
+    vector<string> externals;
+    unsigned long page, stubs, globals, size, address;
+    char *base;
+    void *value;
+    long target;
+
+
+    /* Lay out the code and stubs, then the data and global variables,
+       each on their own pages. */
+
+    page = sysconf(_SC_PAGESIZE);
+    stubs = (text.size() + STUB_SIZE - 1) & ~(STUB_SIZE - 1UL);
+
+    for (auto &def : functions)
+	addresses[def.name] = def.value;
+
+    if (addresses.count(global_prefix "main") == 0) {
+	cerr << "scc: no main function to run" << endl;
+	return EXIT_FAILURE;
+    }
+
+    for (auto &def : commons)
+	addresses[def.name] = 0;
+
+    for (auto &reloc : relocations)
+	if (strings.count(reloc.symbol) == 0
+		&& addresses.count(reloc.symbol) == 0) {
+	    addresses[reloc.symbol] = stubs + externals.size() * STUB_SIZE;
+	    externals.push_back(reloc.symbol);
+	}
+
+    globals = stubs + externals.size() * STUB_SIZE;
+    globals = (globals + page - 1) & ~(page - 1);
+    size = globals + data.size();
+
+    for (auto &def : commons) {
+	size = (size + def.value - 1) & ~(def.value - 1);
+	addresses[def.name] = size;
+	size += def.size;
+    }
+
+    base = (char *) mmap(nullptr, size, PROT_READ | PROT_WRITE,
+	MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+
+    if (base == MAP_FAILED) {
+	cerr << "scc: cannot allocate memory for the program" << endl;
+	return EXIT_FAILURE;
+    }
+
+    memcpy(base, text.data(), text.size());
+    memcpy(base + globals, data.data(), data.size());
+
+
+    /* Fill in the stubs, each of which is jmp *0(%rip) followed by the
+       address of its function. */
+
+    for (unsigned i = 0; i < externals.size(); i ++) {
+	value = dlsym(RTLD_DEFAULT, externals[i].c_str());
+
+	if (value == nullptr) {
+	    cerr << "scc: undefined symbol '" << externals[i] << "'" << endl;
+	    return EXIT_FAILURE;
+	}
+
+	address = stubs + i * STUB_SIZE;
+	memcpy(base + address, "\xff\x25\x00\x00\x00\x00", 6);
+	memcpy(base + address + 6, &value, sizeof(value));
+    }
+
+
+    /* Apply the relocations, now that everything has an address. */
+
+    for (auto &reloc : relocations) {
+	if (strings.count(reloc.symbol) > 0)
+	    target = (long) base + globals + strings[reloc.symbol];
+	else
+	    target = (long) base + addresses[reloc.symbol];
+
+	target += reloc.addend;
+
+	if (reloc.type == R_X86_64_PLT32)
+	    target -= (long) base + reloc.offset;
+
+	if (!patch(base + reloc.offset, target,
+		reloc.type == R_X86_64_64 ? 8 : 4,
+		reloc.type != R_X86_64_32)) {
+	    cerr << "scc: cannot relocate '" << reloc.symbol << "'" << endl;
+	    return EXIT_FAILURE;
+	}
+    }
+
+    if (mprotect(base, globals, PROT_READ | PROT_EXEC) != 0) {
+	cerr << "scc: cannot make the program executable" << endl;
+	return EXIT_FAILURE;
+    }
+
+    return ((int (*)()) (base + addresses[global_prefix "main"]))();
+}
@@ -0,0 +1,21 @@
+/*
+ * File:	object.h
+ *
+ * Description:	This file contains the function declarations for encoding
+ *		instructions and writing them as a relocatable object file,
+ *		or running them directly, for Simple C.
+ */
+
+# ifndef OBJECT_H
+# define OBJECT_H
+# include <string>
+# include <ostream>
+# include "Instruction.h"
+
+void assemble(const std::string &name, const Instructions &code);
+void defineCommon(const std::string &name, unsigned long size);
+void defineString(const std::string &name, const std::string &value);
+void writeObject(std::ostream &ostr);
+int runObject();
+
+# endif /* OBJECT_H */
@@ -0,0 +1,751 @@
+/*
+ * File:	optimize.cpp
+ *
+ * Description:	This file contains the public and private function
+ *		definitions for the optimizer for Simple C, which works on
+ *		a procedure in static single assignment form.
+ *
+ *		Sparse conditional constant propagation (Wegman and Zadeck)
+ *		finds the temporaries that are always constant and the
+ *		branches that always go the same way, and the blocks that
+ *		are then unreachable are removed.  Global value numbering
+ *		walks the dominator tree, replacing any computation already
+ *		made in a dominating block with the earlier result.  A load
+ *		is only reused if there is no store or call in between,
+ *		which we only know within an extended basic block, and a
+ *		store makes its value available to a later load.  The
+ *		loop-invariant computations are then moved out of their
+ *		loops by loop.cpp.  Finally, dead code elimination removes
+ *		any quad whose result is never used and that has no other
+ *		effect.
+ */
+
+# include <set>
+# include <map>
+# include <sstream>
+# include <algorithm>
+# include "optimize.h"
+# include "ssa.h"
+# include "loop.h"
+
+using namespace std;
+
+enum State { TOP, CONSTANT, BOTTOM };
+
+struct Lattice {
+    State state;
+    long value;
+};
+
+typedef pair<unsigned, unsigned> Edge;
+
+static Procedure *proc;
+
+static vector<Lattice> lattice;
+static vector<vector<Edge>> uses;
+static set<Edge> edges;
+static vector<bool> reached;
+static vector<Edge> flow;
+static vector<unsigned> changed;
+
+static vector<Value> replacement;
+static vector<unsigned> sizes, idom;
+static vector<vector<unsigned>> children;
+static map<string, Value> table;
+static unsigned generation;
+
+
+/*
+ * Function:	normalize (private)
+ *
+ * Description:	Return a constant truncated to the given size and then
+ *		sign extended, which is how the machine would hold it.
+ */
+
+static long normalize(long value, unsigned size)
+{
+    if (size == 1)
+	return (signed char) value;
+
+    if (size == 4)
+	return (int) value;
+
+    return value;
+}
+
+
+/*
+ * Function:	holds (private)
+ *
+ * Description:	Return whether a condition holds for two values.
+ */
+
+static bool holds(Condition cond, long left, long right)
+{
+    switch (cond) {
+    case CC_E:
+	return left == right;
+
+    case CC_NE:
+	return left != right;
+
+    case CC_L:
+	return left < right;
+
+    case CC_GE:
+	return left >= right;
+
+    case CC_LE:
+	return left <= right;
+
+    default:
+	return left > right;
+    }
+}
+
+
+/*
+ * Function:	foldable (private)
+ *
+ * Description:	Return whether the result of a quad is known if all of its
+ *		arguments are constants.
+ */
+
+static bool foldable(const Quad &quad)
+{
+    switch (quad._op) {
+    case Q_COPY:
+    case Q_EXT:
+    case Q_ADD:
+    case Q_SUB:
+    case Q_MUL:
+    case Q_DIV:
+    case Q_REM:
+    case Q_NEG:
+    case Q_SET:
+	return true;
+
+    default:
+	return false;
+    }
+}
+
+
+/*
+ * Function:	fold (private)
+ *
+ * Description:	Compute the result of a quad given the constant values of
+ *		its arguments, returning false if it cannot be done.  A
+ *		division that would trap is left alone.
+ */
+
+static bool fold(const Quad &quad, const vector<long> &x, long &result)
+{
+    switch (quad._op) {
+    case Q_COPY:
+    case Q_EXT:
+	result = x[0];
+	break;
+
+    case Q_ADD:
+	result = (unsigned long) x[0] + x[1];
+	break;
+
+    case Q_SUB:
+	result = (unsigned long) x[0] - x[1];
+	break;
+
+    case Q_MUL:
+	result = (unsigned long) x[0] * x[1];
+	break;
+
+    case Q_DIV:
+    case Q_REM:
+	if (x[1] == 0 || x[1] == -1)
+	    return false;
+
+	result = quad._op == Q_DIV ? x[0] / x[1] : x[0] % x[1];
+	break;
+
+    case Q_NEG:
+	result = -(unsigned long) x[0];
+	break;
+
+    case Q_SET:
+	result = holds(quad._cond, x[0], x[1]);
+	break;
+
+    default:
+	return false;
+    }
+
+    result = normalize(result, quad._dst._size);
+    return true;
+}
+
+
+/*
+ * Function:	evaluate (private)
+ *
+ * Description:	Return the lattice value of a value used by a quad.
+ */
+
+static Lattice evaluate(const Value &value)
+{
+    Lattice result = {BOTTOM, 0};
+
+
+    if (value.isConst()) {
+	result.state = CONSTANT;
+	result.value = normalize(value._value, value._size);
+    } else if (value.isTemp())
+	result = lattice[value._temp];
+
+    return result;
+}
+
+
+/*
+ * Function:	update (private)
+ *
+ * Description:	Lower the lattice value of a temporary, and revisit its
+ *		uses if it changed.
+ */
+
+static void update(const Value &dst, const Lattice &value)
+{
+    Lattice &old = lattice[dst._temp];
+
+    if (old.state == value.state
+	&& (value.state != CONSTANT || old.value == value.value))
+	return;
+
+    old = value;
+    changed.push_back(dst._temp);
+}
+
+
+/*
+ * Function:	visit (private)
+ *
+ * Description:	Evaluate a quad in a block reached by constant propagation.
+ *		A phi only considers the edges known to be executable, and
+ *		a branch only makes an edge executable if its comparison
+ *		could go that way.
+ */
+
+static void visit(unsigned block, const Quad &quad)
+{
+    Lattice value = {TOP, 0}, arg;
+    bool top = false, bottom = false;
+    vector<long> x;
+    long result;
+
+
+    if (quad._op == Q_PHI) {
+	for (unsigned i = 0; i < quad._args.size(); i ++) {
+	    if (edges.count(Edge(quad._sources[i], block)) == 0)
+		continue;
+
+	    arg = evaluate(quad._args[i]);
+
+	    if (value.state == TOP)
+		value = arg;
+	    else if (arg.state == BOTTOM || (arg.state == CONSTANT
+		&& arg.value != value.value))
+		value.state = BOTTOM;
+	}
+
+	if (value.state != TOP)
+	    update(quad._dst, value);
+
+	return;
+    }
+
+    for (auto &a : quad._args) {
+	arg = evaluate(a);
+
+	if (arg.state == TOP)
+	    top = true;
+	else if (arg.state == BOTTOM)
+	    bottom = true;
+	else
+	    x.push_back(arg.value);
+    }
+
+    if (quad._op == Q_JUMP)
+	flow.push_back(Edge(block, quad._targets[0]));
+
+    else if (quad._op == Q_BRANCH) {
+	if (bottom || !top) {
+	    for (unsigned i = 0; i < 2; i ++)
+		if (bottom || holds(quad._cond, x[0], x[1]) == (i == 0))
+		    flow.push_back(Edge(block, quad._targets[i]));
+	}
+
+    } else if (quad._dst.isTemp()) {
+	value.state = BOTTOM;
+
+	if (foldable(quad) && !bottom) {
+	    if (top)
+		return;
+
+	    if (fold(quad, x, result)) {
+		value.state = CONSTANT;
+		value.value = result;
+	    }
+	}
+
+	update(quad._dst, value);
+    }
+}
+
+
+/*
+ * Function:	propagate (private)
+ *
+ * Description:	Perform sparse conditional constant propagation.  Each time
+ *		an edge first becomes executable, the phis of its target
+ *		are reevaluated, along with the rest of the block if it has
+ *		not yet been reached.  Each time a temporary changes, its
+ *		uses in reached blocks are reevaluated.
+ */
+
+static void propagate()
+{
+    Lattice top = {TOP, 0}, bottom = {BOTTOM, 0};
+    unsigned block, temp;
+    Edge edge;
+
+
+    lattice.assign(proc->_temps, top);
+    uses.assign(proc->_temps, vector<Edge>());
+    reached.assign(proc->_blocks.size(), false);
+    edges.clear();
+
+    for (auto param : proc->_params)
+	lattice[param] = bottom;
+
+    for (unsigned i = 0; i < proc->_blocks.size(); i ++)
+	for (unsigned j = 0; j < proc->_blocks[i]._quads.size(); j ++)
+	    for (auto &arg : proc->_blocks[i]._quads[j]._args)
+		if (arg.isTemp())
+		    uses[arg._temp].push_back(Edge(i, j));
+
+    reached[0] = true;
+
+    for (auto &quad : proc->_blocks[0]._quads)
+	visit(0, quad);
+
+    while (!flow.empty() || !changed.empty()) {
+	if (!flow.empty()) {
+	    edge = flow.back();
+	    flow.pop_back();
+
+	    if (edges.count(edge) > 0)
+		continue;
+
+	    edges.insert(edge);
+	    block = edge.second;
+
+	    for (auto &quad : proc->_blocks[block]._quads)
+		if (!reached[block] || quad._op == Q_PHI)
+		    visit(block, quad);
+
+	    reached[block] = true;
+
+	} else {
+	    temp = changed.back();
+	    changed.pop_back();
+
+	    for (auto &use : uses[temp])
+		if (reached[use.first])
+		    visit(use.first, proc->_blocks[use.first]._quads[use.second]);
+	}
+    }
+}
+
+
+/*
+ * Function:	substitute (private)
+ *
+ * Description:	Replace each use of a constant temporary with the
+ *		constant, and each branch that always goes the same way
+ *		with a jump, and then remove the unreachable blocks.
+ */
+
+static void substitute()
+{
+    Lattice value;
+    Quad jump(Q_JUMP);
+
+
+    for (auto &block : proc->_blocks)
+	for (auto &quad : block._quads) {
+	    for (auto &arg : quad._args) {
+		value = evaluate(arg);
+
+		if (arg.isTemp() && value.state == CONSTANT)
+		    arg = Value::constant(normalize(value.value, arg._size),
+			arg._size);
+	    }
+
+	    if (quad._op == Q_BRANCH && quad._args[0].isConst()
+		&& quad._args[1].isConst()) {
+		value = evaluate(quad._args[0]);
+		jump._targets[0] = quad._targets[holds(quad._cond,
+		    value.value, evaluate(quad._args[1]).value) ? 0 : 1];
+		quad = jump;
+	    }
+	}
+
+    proc->compact();
+}
+
+
+/*
+ * Function:	resolve (private)
+ *
+ * Description:	Return the value that replaces the given value, used with
+ *		the same size.
+ */
+
+static Value resolve(const Value &value)
+{
+    Value result = value;
+
+    while (result.isTemp() && replacement[result._temp]._kind != Value::NONE)
+	result = replacement[result._temp];
+
+    result._size = value._size;
+    return result;
+}
+
+
+/*
+ * Function:	before (private)
+ *
+ * Description:	Return whether one value is ordered before another, which
+ *		is used to put the operands of a commutative operator in a
+ *		standard order.
+ */
+
+static bool before(const Value &a, const Value &b)
+{
+    if (a._kind != b._kind)
+	return a._kind < b._kind;
+
+    if (a._temp != b._temp)
+	return a._temp < b._temp;
+
+    if (a._value != b._value)
+	return a._value < b._value;
+
+    return a._symbol < b._symbol;
+}
+
+
+/*
+ * Function:	key (private)
+ *
+ * Description:	Return the key under which the result of a quad is
+ *		recorded.  Two quads with the same key compute the same
+ *		value.  The key of a load includes the state of memory and
+ *		the key of a phi includes its block.
+ */
+
+static string key(const Quad &quad, unsigned block, unsigned memory)
+{
+    stringstream ss;
+    vector<Value> args = quad._args;
+
+
+    if ((quad._op == Q_ADD || quad._op == Q_MUL) && before(args[1], args[0]))
+	swap(args[0], args[1]);
+
+    ss << quad._op << " " << quad._cond << " " << quad._dst._size << " ";
+    ss << quad._disp;
+
+    for (unsigned i = 0; i < args.size(); i ++) {
+	ss << " " << args[i] << ":" << args[i]._size;
+
+	if (quad._op == Q_PHI)
+	    ss << "/" << quad._sources[i];
+    }
+
+    if (quad._op == Q_LOAD)
+	ss << " @" << memory;
+
+    if (quad._op == Q_PHI)
+	ss << " B" << block;
+
+    return ss.str();
+}
+
+
+/*
+ * Function:	redundant (private)
+ *
+ * Description:	Return whether a phi has the same argument along every
+ *		edge, ignoring its own result, and if so return the
+ *		argument.
+ */
+
+static bool redundant(const Quad &phi, Value &value)
+{
+    value = Value();
+
+    for (auto &arg : phi._args) {
+	if (arg == phi._dst)
+	    continue;
+
+	if (value._kind != Value::NONE && arg != value)
+	    return false;
+
+	value = arg;
+    }
+
+    return value._kind != Value::NONE;
+}
+
+
+/*
+ * Function:	forward (private)
+ *
+ * Description:	Make the value stored by a quad available to a later load
+ *		of the same location.  The value must already have the size
+ *		of the store, since the load would not see any extra bits.
+ */
+
+static void forward(const Quad &store, unsigned block, unsigned memory,
+	vector<string> &added)
+{
+    const Value &value = store._args[1];
+    Quad load(Q_LOAD, Value::temp(0, value._size), store._args[0]);
+    string k;
+
+
+    if (value.isTemp() && sizes[value._temp] != value._size)
+	return;
+
+    if (value._kind == Value::GLOBAL && value._size != 8)
+	return;
+
+    load._disp = store._disp;
+    k = key(load, block, memory);
+
+    if (table.count(k) == 0)
+	added.push_back(k);
+
+    table[k] = value;
+}
+
+
+/*
+ * Function:	number (private)
+ *
+ * Description:	Number the values computed in a block and the blocks it
+ *		dominates.  A block continues the state of memory of its
+ *		dominator only if that is its only predecessor.
+ */
+
+static void number(unsigned block, unsigned memory)
+{
+    BasicBlock &bb = proc->_blocks[block];
+    vector<string> added;
+    vector<Quad> quads;
+    map<string, Value>::iterator it;
+    Value value;
+    string k;
+
+
+    if (bb._preds.size() != 1 || bb._preds[0] != idom[block])
+	memory = ++ generation;
+
+    for (auto quad : bb._quads) {
+	for (auto &arg : quad._args)
+	    arg = resolve(arg);
+
+	if (quad._op == Q_COPY) {
+	    replacement[quad._dst._temp] = quad._args[0];
+	    continue;
+	}
+
+	if (quad._op == Q_PHI && redundant(quad, value)) {
+	    replacement[quad._dst._temp] = value;
+	    continue;
+	}
+
+	if (quad._op == Q_STORE) {
+	    memory = ++ generation;
+	    forward(quad, block, memory, added);
+
+	} else if (quad._op == Q_CALL)
+	    memory = ++ generation;
+
+	else if (quad._dst.isTemp()) {
+	    k = key(quad, block, memory);
+	    it = table.find(k);
+
+	    if (it != table.end()) {
+		replacement[quad._dst._temp] = it->second;
+		continue;
+	    }
+
+	    table[k] = quad._dst;
+	    added.push_back(k);
+	}
+
+	quads.push_back(quad);
+    }
+
+    bb._quads = quads;
+
+    for (auto child : children[block])
+	number(child, memory);
+
+    for (auto &k : added)
+	table.erase(k);
+}
+
+
+/*
+ * Function:	numberValues (private)
+ *
+ * Description:	Perform global value numbering over the dominator tree,
+ *		and then replace any remaining uses of removed results,
+ *		which may only be reached along back edges.
+ */
+
+static void numberValues()
+{
+    proc->dominators(idom);
+    children.assign(proc->_blocks.size(), vector<unsigned>());
+    replacement.assign(proc->_temps, Value());
+    sizes.assign(proc->_temps, 0);
+    table.clear();
+
+    for (unsigned i = 1; i < proc->_blocks.size(); i ++)
+	children[idom[i]].push_back(i);
+
+    for (auto &block : proc->_blocks)
+	for (auto &quad : block._quads)
+	    if (quad._dst.isTemp())
+		sizes[quad._dst._temp] = quad._dst._size;
+
+    number(0, 0);
+
+    for (auto &block : proc->_blocks)
+	for (auto &quad : block._quads)
+	    for (auto &arg : quad._args)
+		arg = resolve(arg);
+}
+
+
+/*
+ * Function:	essential (private)
+ *
+ * Description:	Return whether a quad must be kept even if its result is
+ *		never used.  A division by a constant other than zero or
+ *		minus one cannot trap.
+ */
+
+static bool essential(const Quad &quad)
+{
+    const Value *divisor;
+
+    if (quad._op == Q_DIV || quad._op == Q_REM) {
+	divisor = &quad._args[1];
+	return !divisor->isConst() || divisor->_value == 0
+	    || divisor->_value == -1;
+    }
+
+    return quad.hasSideEffects();
+}
+
+
+/*
+ * Function:	eliminate (private)
+ *
+ * Description:	Remove any quads that do not contribute to an essential
+ *		quad, by marking the essential quads and then the
+ *		definitions of whatever they use.
+ */
+
+static void eliminate()
+{
+    vector<Edge> defs(proc->_temps, Edge(-1, -1));
+    vector<vector<bool>> marked;
+    vector<unsigned> work;
+    vector<Quad> quads;
+    Edge def;
+
+
+    for (unsigned i = 0; i < proc->_blocks.size(); i ++) {
+	const vector<Quad> &code = proc->_blocks[i]._quads;
+	marked.push_back(vector<bool>(code.size(), false));
+
+	for (unsigned j = 0; j < code.size(); j ++) {
+	    if (code[j]._dst.isTemp())
+		defs[code[j]._dst._temp] = Edge(i, j);
+
+	    if (essential(code[j])) {
+		marked[i][j] = true;
+
+		for (auto &arg : code[j]._args)
+		    if (arg.isTemp())
+			work.push_back(arg._temp);
+	    }
+	}
+    }
+
+    while (!work.empty()) {
+	def = defs[work.back()];
+	work.pop_back();
+
+	if (def.first == (unsigned) -1 || marked[def.first][def.second])
+	    continue;
+
+	marked[def.first][def.second] = true;
+
+	for (auto &arg : proc->_blocks[def.first]._quads[def.second]._args)
+	    if (arg.isTemp())
+		work.push_back(arg._temp);
+    }
+
+    for (unsigned i = 0; i < proc->_blocks.size(); i ++) {
+	quads.clear();
+
+	for (unsigned j = 0; j < proc->_blocks[i]._quads.size(); j ++)
+	    if (marked[i][j])
+		quads.push_back(proc->_blocks[i]._quads[j]);
+
+	proc->_blocks[i]._quads = quads;
+    }
+}
+
+
+/*
+ * Function:	optimize
+ *
+ * Description:	Optimize a procedure by converting it into static single
+ *		assignment form, propagating constants, numbering values,
+ *		hoisting loop invariants, and eliminating dead code, and
+ *		then converting it back.  Values are numbered again after
+ *		hoisting, since computations moved into the same preheader
+ *		may then be found to be redundant.
+ */
+
+void optimize(Procedure *p)
+{
+    proc = p;
+
+    buildSSA(proc);
+    propagate();
+    substitute();
+    numberValues();
+    hoistInvariants(proc);
+    numberValues();
+    eliminate();
+    destroySSA(proc);
+}
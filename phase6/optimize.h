@@ -0,0 +1,14 @@
+/*
+ * File:	optimize.h
+ *
+ * Description:	This file contains the function declarations for the
+ *		optimizer for Simple C.
+ */
+
+# ifndef OPTIMIZE_H
+# define OPTIMIZE_H
+# include "ir.h"
+
+void optimize(Procedure *proc);
+
+# endif /* OPTIMIZE_H */
@@ -957,11 +957,18 @@ static void globalOrFunction()
 /*
  * Function:	main
  *
- * Description:	Analyze the standard input stream.
+ * Description:	Analyze the standard input stream after processing any
+ *		code generation options given on the command line.
  */
 
-int main()
+int main(int argc, char *argv[])
 {
+    for (int i = 1; i < argc; i ++)
+	if (!setOption(argv[i])) {
+	    cerr << "scc: unrecognized option '" << argv[i] << "'" << endl;
+	    exit(EXIT_FAILURE);
+	}
+
     openScope();
     lookahead = yylex();
     lexbuf = yytext;
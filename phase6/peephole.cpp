@@ -0,0 +1,323 @@
+/*
+ * File:	peephole.cpp
+ *
+ * Description:	This file contains the public and private function
+ *		definitions for the peephole optimizer for Simple C.
+ *
+ *		The code generator produces each expression in isolation,
+ *		which leaves behind short sequences of instructions that
+ *		are easily improved by looking at only a few neighboring
+ *		instructions at a time.  Each pattern is tried at every
+ *		position until no more changes can be made.
+ *
+ *		The optimizer is run both before and after register
+ *		allocation.  Beforehand, a virtual register read in only
+ *		one place is known to be dead afterwards, which allows a
+ *		comparison result to be branched on directly.  Afterwards,
+ *		copies between registers that were allocated the same
+ *		machine register and values stored and immediately
+ *		reloaded can be removed.
+ */
+
+# include <map>
+# include "peephole.h"
+
+using namespace std;
+
+# define WINDOW 4
+
+static map<Register *, unsigned> reads;
+
+
+/*
+ * Function:	isStore (private)
+ *
+ * Description:	Return whether an instruction stores a register to memory.
+ */
+
+static bool isStore(const Instruction &inst)
+{
+    return inst._opcode == MOV && inst._operands[0].isReg()
+	&& inst._operands[1].isMem();
+}
+
+
+/*
+ * Function:	isLoad (private)
+ *
+ * Description:	Return whether an instruction loads a register from memory
+ *		without using the register to address the memory.
+ */
+
+static bool isLoad(const Instruction &inst)
+{
+    const Operand &src = inst._operands[0], &dst = inst._operands[1];
+
+    return inst._opcode == MOV && src.isMem() && dst.isReg()
+	&& src._base != dst._base && src._index != dst._base;
+}
+
+
+/*
+ * Function:	tally (private)
+ *
+ * Description:	Add the given amount to the number of instructions reading
+ *		each register read by the given instruction.
+ */
+
+static void tally(const Instruction &inst, int amount)
+{
+    vector<Register *> uses, defs;
+
+
+    inst.registers(uses, defs);
+
+    for (auto reg : uses)
+	reads[reg] += amount;
+}
+
+
+/*
+ * Function:	remove (private)
+ *
+ * Description:	Remove the given number of instructions starting at the
+ *		given position, keeping the counts of reads up to date.
+ */
+
+static void remove(Instructions &code, unsigned i, unsigned n)
+{
+    for (unsigned j = i; j < i + n; j ++)
+	tally(code[j], -1);
+
+    code.erase(code.begin() + i, code.begin() + i + n);
+}
+
+
+/*
+ * Function:	redundant (private)
+ *
+ * Description:	Remove a copy of a register to itself.  Since the upper
+ *		half of a register holding a 32-bit value is never used, we
+ *		do not need to preserve the zero extension of movl.
+ */
+
+static bool redundant(Instructions &code, unsigned i)
+{
+    const Instruction &inst = code[i];
+
+    if (inst.isCopy() && inst._operands[0].isReg(inst._operands[1]._base)) {
+	remove(code, i, 1);
+	return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Function:	reload (private)
+ *
+ * Description:	Replace the reload of a value just stored to memory with a
+ *		register copy, and remove the store of a value just loaded
+ *		from the same location.
+ */
+
+static bool reload(Instructions &code, unsigned i)
+{
+    if (i + 1 >= code.size())
+	return false;
+
+    Instruction &first = code[i], &second = code[i + 1];
+
+    if (isStore(first) && isLoad(second)
+	    && first._operands[1] == second._operands[0]) {
+	tally(second, -1);
+	second._operands[0] = first._operands[0];
+	tally(second, 1);
+	return true;
+    }
+
+    if (isLoad(first) && isStore(second)
+	    && first._operands[0] == second._operands[1]
+	    && first._operands[1] == second._operands[0]) {
+	remove(code, i + 1, 1);
+	return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Function:	unreachable (private)
+ *
+ * Description:	Remove an instruction following an unconditional jump,
+ *		since it can only be reached through a label.
+ */
+
+static bool unreachable(Instructions &code, unsigned i)
+{
+    if (i + 1 >= code.size())
+	return false;
+
+    if ((code[i]._opcode == JMP || code[i]._opcode == RET)
+	    && code[i + 1]._opcode != LABEL) {
+	remove(code, i + 1, 1);
+	return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Function:	follows (private)
+ *
+ * Description:	Return whether the given label is among the labels
+ *		immediately following the given position.
+ */
+
+static bool follows(const Instructions &code, unsigned i, const string &label)
+{
+    for (unsigned j = i; j < code.size() && code[j]._opcode == LABEL; j ++)
+	if (code[j]._operands[0]._symbol == label)
+	    return true;
+
+    return false;
+}
+
+
+/*
+ * Function:	fallthrough (private)
+ *
+ * Description:	Remove a jump to the next instruction.  A conditional jump
+ *		over an unconditional jump is replaced by a single jump with
+ *		the opposite condition.
+ */
+
+static bool fallthrough(Instructions &code, unsigned i)
+{
+    string target;
+
+
+    if (code[i]._opcode != JMP && code[i]._opcode != JCC)
+	return false;
+
+    target = code[i]._operands[0]._symbol;
+
+    if (code[i]._opcode == JMP && follows(code, i + 1, target)) {
+	code.erase(code.begin() + i);
+	return true;
+    }
+
+    if (i + 1 < code.size() && code[i]._opcode == JCC
+	    && code[i + 1]._opcode == JMP
+	    && follows(code, i + 2, target)) {
+	code[i]._cond = invert(code[i]._cond);
+	code[i]._operands = code[i + 1]._operands;
+	code.erase(code.begin() + i + 1);
+	return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Function:	condition (private)
+ *
+ * Description:	Replace the sequence that materializes a comparison result
+ *		as zero or one and then tests it with a single conditional
+ *		jump, provided the result is needed nowhere else.
+ *
+ *		    setl  %v1b			jge  .L1
+ *		    movzbl %v1b, %v1d
+ *		    cmpl  $0, %v1d
+ *		    je    .L1
+ */
+
+static bool condition(Instructions &code, unsigned i)
+{
+    Register *v, *w;
+
+
+    if (i + 3 >= code.size())
+	return false;
+
+    Instruction &set = code[i], &movz = code[i + 1];
+    Instruction &cmp = code[i + 2], &jcc = code[i + 3];
+
+    if (set._opcode != SET || movz._opcode != MOVZ || cmp._opcode != CMP)
+	return false;
+
+    if (jcc._opcode != JCC || (jcc._cond != CC_E && jcc._cond != CC_NE))
+	return false;
+
+    v = set._operands[0]._base;
+    w = movz._operands[1]._base;
+
+    if (!set._operands[0].isReg() || !v->isVirtual())
+	return false;
+
+    if (!movz._operands[0].isReg(v) || !movz._operands[1].isReg())
+	return false;
+
+    if (!cmp._operands[0].isImm() || cmp._operands[0]._value != 0)
+	return false;
+
+    if (!cmp._operands[1].isReg(w) || !cmp._operands[0]._symbol.empty())
+	return false;
+
+    if (v == w ? reads[v] != 2 : reads[v] != 1 || reads[w] != 1)
+	return false;
+
+    jcc._cond = jcc._cond == CC_E ? invert(set._cond) : set._cond;
+    remove(code, i, 3);
+    return true;
+}
+
+
+/*
+ * Function:	peephole
+ *
+ * Description:	Apply the peephole optimizations to the given instructions
+ *		until no more can be applied.  After a change, we back up
+ *		far enough to catch any new pattern that it completes.
+ *
+ *		Removing an instruction from the middle of a long function
+ *		is expensive, so the instructions are moved from the input
+ *		only as they are needed.  A pattern examines at most a
+ *		window of instructions and the labels that follow them, so
+ *		the instructions after the current position are always
+ *		few.
+ */
+
+void peephole(Instructions &code)
+{
+    Instructions input;
+    unsigned i, next;
+
+
+    reads.clear();
+
+    for (auto &inst : code)
+	tally(inst, 1);
+
+    input.swap(code);
+    i = next = 0;
+
+    while (true) {
+	while (next < input.size() && (code.size() < i + WINDOW
+		|| code.back()._opcode == LABEL))
+	    code.push_back(move(input[next ++]));
+
+	if (i >= code.size())
+	    break;
+
+	if (redundant(code, i) || reload(code, i) || unreachable(code, i)
+		|| fallthrough(code, i) || condition(code, i))
+	    i = i > WINDOW ? i - WINDOW : 0;
+	else
+	    i ++;
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ * File:	profile.cpp
+ *
+ * Description:	This file contains the public function definitions for the
+ *		execution profile of a Simple C program.
+ *
+ *		The statements whose execution is counted are given their
+ *		counters as they are parsed, so that the same program
+ *		always has the same counters no matter how it is compiled.
+ *		An instrumented program writes its counters when it exits
+ *		to a profile, which is just the number of counters
+ *		followed by the value of each one.  A later compilation of
+ *		the same program can then read the profile back to learn
+ *		how often each statement was executed.
+ */
+
+# include <vector>
+# include <fstream>
+# include <iostream>
+# include "profile.h"
+
+using namespace std;
+
+static unsigned counters;
+static vector<unsigned long> profile;
+static bool profiled = false;
+
+
+/*
+ * Function:	newCounters
+ *
+ * Description:	Return the first of the given number of new counters.
+ */
+
+unsigned newCounters(unsigned count)
+{
+    counters += count;
+    return counters - count;
+}
+
+
+/*
+ * Function:	numCounters
+ *
+ * Description:	Return the number of counters given out so far.
+ */
+
+unsigned numCounters()
+{
+    return counters;
+}
+
+
+/*
+ * Function:	readProfile
+ *
+ * Description:	Read the profile from the given file, and return whether
+ *		it could be read.  The program is compiled as if it had no
+ *		profile if the file is missing or malformed.
+ */
+
+bool readProfile(const string &filename)
+{
+    ifstream file(filename.c_str());
+    unsigned long count, value;
+
+
+    profile.clear();
+    profiled = false;
+
+    if (!(file >> count)) {
+	cerr << "scc: cannot read profile '" << filename << "'" << endl;
+	return false;
+    }
+
+    while (profile.size() < count && file >> value)
+	profile.push_back(value);
+
+    if (profile.size() < count) {
+	cerr << "scc: profile '" << filename << "' is truncated" << endl;
+	profile.clear();
+	return false;
+    }
+
+    profiled = true;
+    return true;
+}
+
+
+/*
+ * Function:	isProfiled
+ *
+ * Description:	Return whether a profile is being used.
+ */
+
+bool isProfiled()
+{
+    return profiled;
+}
+
+
+/*
+ * Function:	frequency
+ *
+ * Description:	Return the value of a counter in the profile.  A counter
+ *		that the profile does not have was never executed.
+ */
+
+unsigned long frequency(unsigned counter)
+{
+    return counter < profile.size() ? profile[counter] : 0;
+}
+
+
+/*
+ * Function:	checkProfile
+ *
+ * Description:	Warn if the profile being used does not have the same
+ *		number of counters as the program, in which case it was
+ *		most likely made from a different version of the program.
+ */
+
+void checkProfile()
+{
+    if (profiled && profile.size() != counters)
+	cerr << "scc: profile does not match the program" << endl;
+}
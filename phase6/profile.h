@@ -0,0 +1,20 @@
+/*
+ * File:	profile.h
+ *
+ * Description:	This file contains the function declarations for the
+ *		execution profile of a Simple C program.
+ */
+
+# ifndef PROFILE_H
+# define PROFILE_H
+# include <string>
+
+unsigned newCounters(unsigned count);
+unsigned numCounters();
+
+bool readProfile(const std::string &filename);
+bool isProfiled();
+unsigned long frequency(unsigned counter);
+void checkProfile();
+
+# endif /* PROFILE_H */
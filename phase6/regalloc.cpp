@@ -0,0 +1,827 @@
+/*
+ * File:	regalloc.cpp
+ *
+ * Description:	This file contains the public and private function
+ *		definitions for the register allocator for Simple C.
+ *
+ *		The code generator emits the instructions for a function
+ *		using an unlimited supply of virtual registers, and using
+ *		machine registers only where the instruction set or the
+ *		calling convention demands it.  We then replace the virtual
+ *		registers with machine registers using linear scan
+ *		allocation over live intervals.
+ *
+ *		The instructions are first divided into basic blocks and
+ *		the registers live into and out of each block are computed.
+ *		The live interval of a virtual register is the smallest
+ *		range of instruction positions covering every point at
+ *		which the register is live.  Each instruction has two
+ *		positions: the even one is where its operands are read and
+ *		the odd one is where its results are written.  Two virtual
+ *		registers can share a machine register if their intervals
+ *		do not overlap.  Machine registers are handled precisely
+ *		rather than with intervals: a virtual register may not be
+ *		given a machine register that is written while the virtual
+ *		register is live, or vice versa.
+ *
+ *		A virtual register copied to or from a machine register,
+ *		such as an argument or a return value, is given that
+ *		register if it is free, so that the copy disappears.
+ *
+ *		If we run out of registers, the interval that ends last is
+ *		spilled to a stack slot.  Registers spilled together whose
+ *		intervals do not overlap share a slot, so that the frame
+ *		only grows by as many slots as are needed at once, and a
+ *		slot is only as wide as the values that it holds.
+ *		Wherever the instruction allows it, the slot is used
+ *		directly as an operand.  Otherwise, a new virtual register
+ *		with a very short interval is loaded from or stored to the
+ *		slot around the instruction.  Since spilling changes the
+ *		code, we just start over, and repeat until everything fits.
+ *
+ *		A register only ever set to a constant or to the address of
+ *		a global is spilled in preference to any other, since it
+ *		needs no slot at all.  Its value is simply recomputed into
+ *		a new virtual register before each use.  This matters most
+ *		for values live across calls, which cannot stay in the
+ *		caller-saved registers.
+ *
+ *		In naive mode, every virtual register is spilled up front,
+ *		so that every value lives in memory between instructions.
+ *		This is mainly useful for comparison and debugging.
+ */
+
+# include <map>
+# include <set>
+# include <cassert>
+# include <algorithm>
+# include "machine.h"
+# include "regalloc.h"
+
+using namespace std;
+
+typedef vector<unsigned long> Bits;
+
+class Region {
+public:
+    unsigned _first, _last;
+    vector<unsigned> _successors;
+    Bits _in, _out, _use, _def;
+};
+
+class Interval {
+public:
+    Register *_reg;
+    int _start, _end;
+    unsigned _forbidden;
+    bool _spillable, _constant;
+    Register *_assigned, *_hint;
+};
+
+
+/*
+ * Function:	bit (private)
+ *
+ * Description:	Return whether the given bit is set.
+ */
+
+static bool bit(const Bits &bits, unsigned n)
+{
+    return bits[n / 64] & (1UL << (n % 64));
+}
+
+
+/*
+ * Function:	include (private)
+ *
+ * Description:	Set the given bit.
+ */
+
+static void include(Bits &bits, unsigned n)
+{
+    bits[n / 64] |= (1UL << (n % 64));
+}
+
+
+/*
+ * Function:	exclude (private)
+ *
+ * Description:	Clear the given bit.
+ */
+
+static void exclude(Bits &bits, unsigned n)
+{
+    bits[n / 64] &= ~(1UL << (n % 64));
+}
+
+
+/*
+ * Function:	members (private)
+ *
+ * Description:	Return the numbers of all bits that are set.
+ */
+
+static vector<unsigned> members(const Bits &bits)
+{
+    vector<unsigned> result;
+
+    for (unsigned i = 0; i < bits.size(); i ++)
+	if (bits[i] != 0)
+	    for (unsigned j = 0; j < 64; j ++)
+		if (bits[i] & (1UL << j))
+		    result.push_back(i * 64 + j);
+
+    return result;
+}
+
+
+/*
+ * Function:	tracked (private)
+ *
+ * Description:	Return whether we care about the liveness of a register.
+ *		The stack and frame pointers are never allocated.
+ */
+
+static bool tracked(const Register *reg)
+{
+    return reg != rsp && reg != rbp;
+}
+
+
+/*
+ * Function:	partition (private)
+ *
+ * Description:	Divide the instructions into basic blocks and determine
+ *		the successors of each block.  A label starts a new block
+ *		and a branch ends one.  A jump to a label outside of the
+ *		function has no successor within it.
+ */
+
+static vector<Region> partition(const Instructions &code)
+{
+    vector<Region> blocks;
+    map<string, unsigned> labels;
+    Region block;
+
+
+    for (unsigned i = 0; i < code.size(); i ++) {
+	if (i == 0 || code[i]._opcode == LABEL || code[i - 1].isBranch()) {
+	    block._first = i;
+	    blocks.push_back(block);
+	}
+
+	blocks.back()._last = i;
+
+	if (code[i]._opcode == LABEL)
+	    labels[code[i]._operands[0]._symbol] = blocks.size() - 1;
+    }
+
+    for (unsigned i = 0; i < blocks.size(); i ++) {
+	const Instruction &last = code[blocks[i]._last];
+
+	if (last._opcode == JMP || last._opcode == JCC) {
+	    const string &name = last._operands[0]._symbol;
+
+	    if (labels.count(name) > 0)
+		blocks[i]._successors.push_back(labels[name]);
+	}
+
+	if (last._opcode != JMP && last._opcode != RET && i + 1 < blocks.size())
+	    blocks[i]._successors.push_back(i + 1);
+    }
+
+    return blocks;
+}
+
+
+/*
+ * Function:	liveness (private)
+ *
+ * Description:	Compute the registers live into and out of each block
+ *		using the usual iterative backwards dataflow analysis.
+ */
+
+static void liveness(const Instructions &code, vector<Region> &blocks,
+	unsigned words)
+{
+    vector<Register *> uses, defs;
+    bool changed;
+    Bits out;
+
+
+    for (auto &block : blocks) {
+	block._in = block._out = block._use = block._def = Bits(words, 0);
+
+	for (unsigned i = block._first; i <= block._last; i ++) {
+	    code[i].registers(uses, defs);
+
+	    for (auto reg : uses)
+		if (tracked(reg) && !bit(block._def, reg->number()))
+		    include(block._use, reg->number());
+
+	    for (auto reg : defs)
+		if (tracked(reg))
+		    include(block._def, reg->number());
+	}
+    }
+
+    do {
+	changed = false;
+
+	for (int i = blocks.size() - 1; i >= 0; i --) {
+	    Region &block = blocks[i];
+	    out = Bits(words, 0);
+
+	    for (auto succ : block._successors)
+		for (unsigned j = 0; j < words; j ++)
+		    out[j] |= blocks[succ]._in[j];
+
+	    for (unsigned j = 0; j < words; j ++) {
+		unsigned long in = block._use[j] | (out[j] & ~block._def[j]);
+
+		if (in != block._in[j] || out[j] != block._out[j]) {
+		    block._in[j] = in;
+		    block._out[j] = out[j];
+		    changed = true;
+		}
+	    }
+	}
+    } while (changed);
+}
+
+
+/*
+ * Function:	extend (private)
+ *
+ * Description:	Extend the interval of a virtual register to include the
+ *		given position.
+ */
+
+static void extend(map<Register *, Interval> &intervals, Register *reg,
+	int position)
+{
+    if (!reg->isVirtual())
+	return;
+
+    Interval &interval = intervals[reg];
+
+    if (interval._reg == nullptr) {
+	interval._reg = reg;
+	interval._start = interval._end = position;
+	interval._forbidden = 0;
+	interval._spillable = true;
+	interval._constant = false;
+	interval._assigned = interval._hint = nullptr;
+    }
+
+    interval._start = min(interval._start, position);
+    interval._end = max(interval._end, position);
+}
+
+
+/*
+ * Function:	interfere (private)
+ *
+ * Description:	Record that two registers are simultaneously live.  Only
+ *		the interference between a machine register and a virtual
+ *		register needs to be recorded, since interference between
+ *		virtual registers is implied by their intervals.
+ */
+
+static void interfere(map<Register *, Interval> &intervals, Register *a,
+	Register *b)
+{
+    if (a->isVirtual() && !b->isVirtual())
+	intervals[a]._forbidden |= 1u << b->number();
+    else if (!a->isVirtual() && b->isVirtual())
+	intervals[b]._forbidden |= 1u << a->number();
+}
+
+
+/*
+ * Function:	build (private)
+ *
+ * Description:	Build the live intervals of the virtual registers by
+ *		walking each block backwards from the registers live out
+ *		of it, applying the definitions and uses of each
+ *		instruction to the set of live registers.
+ *
+ *		Since an interval is just the range covering every point at
+ *		which its register is live, it suffices to extend it to the
+ *		end of each block that it is live out of, the start of each
+ *		block that it is live into, and each definition and use.
+ *		Interference only matters between a virtual and a machine
+ *		register, so the complete set of live registers is only
+ *		needed where a machine register is written.
+ */
+
+static void build(const Instructions &code, const vector<Region> &blocks,
+	map<Register *, Interval> &intervals,
+	const vector<Register *> &numbered)
+{
+    vector<Register *> uses, defs;
+    vector<unsigned> after;
+    Register *source;
+    Bits live;
+
+
+    for (auto &block : blocks) {
+	live = block._out;
+
+	for (auto n : members(live))
+	    extend(intervals, numbered[n], 2 * block._last + 2);
+
+	for (int i = block._last; i >= (int) block._first; i --) {
+	    code[i].registers(uses, defs);
+	    source = code[i].isCopy() ? code[i]._operands[0]._base : nullptr;
+	    after.clear();
+
+	    for (auto reg : defs)
+		if (tracked(reg) && !reg->isVirtual()) {
+		    after = members(live);
+		    break;
+		}
+
+	    for (auto reg : defs)
+		if (tracked(reg)) {
+		    extend(intervals, reg, 2 * i + 1);
+
+		    if (reg->isVirtual()) {
+			for (unsigned n = 0; n < NUM_MACHINE_REGS; n ++)
+			    if (bit(live, n) && numbered[n] != source)
+				interfere(intervals, reg, numbered[n]);
+		    } else {
+			for (auto n : after)
+			    if (numbered[n] != source)
+				interfere(intervals, reg, numbered[n]);
+		    }
+		}
+
+	    for (auto reg : defs)
+		if (tracked(reg))
+		    exclude(live, reg->number());
+
+	    for (auto reg : uses)
+		if (tracked(reg)) {
+		    extend(intervals, reg, 2 * i);
+		    include(live, reg->number());
+		}
+	}
+
+	for (auto n : members(live))
+	    extend(intervals, numbered[n], 2 * block._first);
+    }
+}
+
+
+/*
+ * Function:	constants (private)
+ *
+ * Description:	Find the virtual registers written only by a single move of
+ *		an immediate value or load of the address of a global.
+ *		Such a register can be recomputed by repeating the
+ *		instruction wherever its value is needed.
+ */
+
+static void constants(const Instructions &code,
+	map<Register *, const Instruction *> &defining)
+{
+    map<Register *, unsigned> writes;
+    vector<Register *> uses, defs;
+    const Operand *src, *dst;
+
+
+    defining.clear();
+
+    for (auto &inst : code) {
+	inst.registers(uses, defs);
+
+	for (auto reg : defs)
+	    if (reg->isVirtual() && writes[reg] ++ == 0 && defs.size() == 1) {
+		src = &inst._operands[0];
+		dst = &inst._operands.back();
+
+		if (!dst->isReg(reg) || inst._operands.size() != 2)
+		    continue;
+
+		if ((inst._opcode == MOV && src->isImm())
+			|| (inst._opcode == LEA && src->_base == nullptr
+			    && src->_index == nullptr))
+		    defining[reg] = &inst;
+	    }
+    }
+
+    for (auto &entry : writes)
+	if (entry.second > 1)
+	    defining.erase(entry.first);
+}
+
+
+/*
+ * Function:	hint (private)
+ *
+ * Description:	Suggest that each virtual register copied to or from a
+ *		machine register be given that register.
+ */
+
+static void hint(const Instructions &code, map<Register *, Interval> &intervals)
+{
+    Register *src, *dst;
+
+
+    for (auto &inst : code)
+	if (inst.isCopy()) {
+	    src = inst._operands[0]._base;
+	    dst = inst._operands[1]._base;
+
+	    if (src->isVirtual() && !dst->isVirtual() && tracked(dst))
+		intervals[src]._hint = dst;
+	    else if (!src->isVirtual() && dst->isVirtual() && tracked(src))
+		intervals[dst]._hint = src;
+	}
+}
+
+
+/*
+ * Function:	cheaper (private)
+ *
+ * Description:	Return whether it is cheaper to spill the first interval
+ *		than the second.  A constant costs nothing to spill, and
+ *		otherwise spilling the interval that ends later frees its
+ *		register for longer.
+ */
+
+static bool cheaper(const Interval *a, const Interval *b)
+{
+    if (a->_constant != b->_constant)
+	return a->_constant;
+
+    return a->_end > b->_end;
+}
+
+
+/*
+ * Function:	scan (private)
+ *
+ * Description:	Assign machine registers to the intervals, in order of
+ *		increasing start position, and return the registers that
+ *		must be spilled.  The suggested register for an interval is
+ *		tried before the others in the pool.
+ */
+
+static vector<Register *> scan(map<Register *, Interval> &intervals,
+	const vector<Register *> &pool)
+{
+    vector<Interval *> sorted, active;
+    vector<Register *> spilled, order;
+    Interval *victim;
+    unsigned used;
+    bool found;
+
+
+    for (auto &entry : intervals)
+	sorted.push_back(&entry.second);
+
+    stable_sort(sorted.begin(), sorted.end(), [](Interval *a, Interval *b) {
+	return a->_start < b->_start;
+    });
+
+    for (auto cur : sorted) {
+	used = 0;
+
+	for (unsigned i = 0; i < active.size(); )
+	    if (active[i]->_end < cur->_start)
+		active.erase(active.begin() + i);
+	    else
+		used |= 1u << active[i ++]->_assigned->number();
+
+	found = false;
+	order = pool;
+
+	if (find(order.begin(), order.end(), cur->_hint) != order.end()) {
+	    order.erase(find(order.begin(), order.end(), cur->_hint));
+	    order.insert(order.begin(), cur->_hint);
+	}
+
+	for (auto reg : order) {
+	    unsigned mask = 1u << reg->number();
+
+	    if (!(used & mask) && !(cur->_forbidden & mask)) {
+		cur->_assigned = reg;
+		active.push_back(cur);
+		found = true;
+		break;
+	    }
+	}
+
+	if (found)
+	    continue;
+
+	victim = cur->_spillable ? cur : nullptr;
+
+	for (auto interval : active)
+	    if (interval->_spillable) {
+		unsigned mask = 1u << interval->_assigned->number();
+
+		if (!(cur->_forbidden & mask))
+		    if (victim == nullptr || cheaper(interval, victim))
+			victim = interval;
+	    }
+
+	assert(victim != nullptr);
+	spilled.push_back(victim->_reg);
+
+	if (victim != cur) {
+	    cur->_assigned = victim->_assigned;
+	    victim->_assigned = nullptr;
+	    active.erase(find(active.begin(), active.end(), victim));
+	    active.push_back(cur);
+	}
+    }
+
+    return spilled;
+}
+
+
+/*
+ * Function:	direct (private)
+ *
+ * Description:	Return whether the given register operand of an
+ *		instruction may be replaced with a memory operand.  At most
+ *		one operand of an instruction can refer to memory, and
+ *		only a 32-bit immediate can be stored to memory.
+ */
+
+static bool direct(const Instruction &inst, unsigned i)
+{
+    for (unsigned j = 0; j < inst._operands.size(); j ++)
+	if (j != i && (inst._operands[j].isMem()
+		    || (inst._operands[j].isImm() && !inst._operands[j].isSmall())))
+	    return false;
+
+    switch (inst._opcode) {
+    case MOV:
+    case ADD:
+    case SUB:
+    case CMP:
+    case TEST:
+    case NEG:
+    case AND:
+    case SHL:
+    case SAR:
+    case SHR:
+    case IDIV:
+    case SET:
+    case PUSH:
+    case POP:
+	return true;
+
+    case MOVS:
+    case MOVZ:
+    case CMOV:
+	return i == 0;
+
+    case IMUL:
+	return i == inst._operands.size() - 2 || inst._operands.size() == 1;
+
+    default:
+	return false;
+    }
+}
+
+
+/*
+ * Function:	assign (private)
+ *
+ * Description:	Assign stack slots to the given registers, allocating new
+ *		ones below the given offset only as needed.  The registers
+ *		are taken in order of increasing start position, and each
+ *		is given the first slot wide enough to hold it whose
+ *		previous registers are all dead by the time it starts.
+ */
+
+static void assign(const vector<Register *> &spilled,
+	map<Register *, Interval> &intervals,
+	const map<Register *, int> &widths, int &offset,
+	map<Register *, int> &slots)
+{
+    vector<Register *> sorted(spilled);
+    vector<int> offsets, ends, sizes;
+    unsigned i;
+    int size;
+
+
+    stable_sort(sorted.begin(), sorted.end(), [&](Register *a, Register *b) {
+	return intervals[a]._start < intervals[b]._start;
+    });
+
+    for (auto reg : sorted) {
+	Interval &interval = intervals[reg];
+	size = widths.at(reg);
+
+	for (i = 0; i < offsets.size(); i ++)
+	    if (ends[i] < interval._start && sizes[i] >= size)
+		break;
+
+	if (i == offsets.size()) {
+	    offset = (offset - size) & ~(size - 1);
+	    offsets.push_back(offset);
+	    ends.push_back(interval._end);
+	    sizes.push_back(size);
+	}
+
+	slots[reg] = offsets[i];
+	ends[i] = interval._end;
+    }
+}
+
+
+/*
+ * Function:	rewrite (private)
+ *
+ * Description:	Rewrite the instructions so that the given registers live
+ *		in stack slots, or are recomputed before each use if they
+ *		hold constants.  New virtual registers introduced to hold
+ *		values only for the duration of an instruction are added to
+ *		the list of temporaries.  The width of a register is the
+ *		size of its widest use as an operand.  Its uses in memory
+ *		references do not count, since a pointer is always written
+ *		as an eight-byte operand somewhere.
+ */
+
+static void rewrite(Instructions &code, const vector<Register *> &spilled,
+	const map<Register *, const Instruction *> &defining,
+	map<Register *, Interval> &intervals, int &offset, unsigned &next,
+	set<Register *> &temporaries)
+{
+    map<Register *, const Instruction *> recomputed;
+    vector<Register *> stored, uses, defs;
+    map<Register *, int> slots, widths;
+    Instructions result;
+
+
+    for (auto reg : spilled)
+	if (defining.count(reg) > 0)
+	    recomputed[reg] = defining.at(reg);
+	else
+	    stored.push_back(reg);
+
+    for (auto &inst : code)
+	for (auto &op : inst._operands)
+	    if (op.isReg() && op._base->isVirtual())
+		widths[op._base] = max(widths[op._base], (int) op._size);
+
+    for (auto reg : stored)
+	if (widths[reg] == 0)
+	    widths[reg] = SIZEOF_REG;
+
+    assign(stored, intervals, widths, offset, slots);
+
+    for (auto inst : code) {
+	vector<Instruction> after;
+	map<Register *, Register *> replaced;
+
+	inst.registers(uses, defs);
+
+	if (defs.size() == 1 && recomputed.count(defs[0]) > 0)
+	    continue;
+
+	for (unsigned i = 0; i < inst._operands.size(); i ++) {
+	    Operand &op = inst._operands[i];
+
+	    if (op.isReg() && slots.count(op._base) > 0 && direct(inst, i))
+		op = Operand::memory(rbp, slots[op._base], op._size);
+	}
+
+	for (unsigned i = 0; i < inst._operands.size(); i ++) {
+	    Operand &op = inst._operands[i];
+	    Register **regs[] = {&op._base, &op._index};
+
+	    if (op._kind != Operand::REG && op._kind != Operand::MEM)
+		continue;
+
+	    for (auto ptr : regs) {
+		Register *reg = *ptr;
+
+		if (reg == nullptr)
+		    continue;
+
+		if (slots.count(reg) == 0 && recomputed.count(reg) == 0)
+		    continue;
+
+		if (replaced.count(reg) == 0) {
+		    Register *temp = new Register(next ++);
+
+		    temporaries.insert(temp);
+		    replaced[reg] = temp;
+
+		    if (recomputed.count(reg) > 0) {
+			Instruction copy = *recomputed[reg];
+			Operand &dst = copy._operands.back();
+
+			dst = Operand(temp, dst._size);
+			result.push_back(copy);
+
+		    } else if (find(uses.begin(), uses.end(), reg) != uses.end())
+			result.push_back(Instruction(MOV, widths[reg],
+			    Operand::memory(rbp, slots[reg], widths[reg]),
+			    Operand(temp, widths[reg])));
+
+		    if (find(defs.begin(), defs.end(), reg) != defs.end())
+			after.push_back(Instruction(MOV, widths[reg],
+			    Operand(temp, widths[reg]),
+			    Operand::memory(rbp, slots[reg], widths[reg])));
+		}
+
+		*ptr = replaced[reg];
+	    }
+	}
+
+	result.push_back(inst);
+	result.insert(result.end(), after.begin(), after.end());
+    }
+
+    code = result;
+}
+
+
+/*
+ * Function:	allocateRegisters
+ *
+ * Description:	Replace the virtual registers in the given instructions
+ *		with registers from the given pool, spilling to stack slots
+ *		allocated below the given offset as necessary.
+ */
+
+void allocateRegisters(Instructions &code, const vector<Register *> &pool,
+	int &offset, bool naive)
+{
+    set<Register *> temporaries;
+    map<Register *, const Instruction *> defining;
+    vector<Register *> numbered, uses, defs;
+    map<Register *, Interval> intervals;
+    vector<Register *> spilled;
+    vector<Region> blocks;
+    unsigned next;
+
+
+    while (true) {
+	numbered.assign(machine_registers, machine_registers + NUM_MACHINE_REGS);
+
+	for (auto &inst : code) {
+	    inst.registers(uses, defs);
+	    uses.insert(uses.end(), defs.begin(), defs.end());
+
+	    for (auto reg : uses) {
+		if (reg->number() >= numbered.size())
+		    numbered.resize(reg->number() + 1, nullptr);
+
+		numbered[reg->number()] = reg;
+	    }
+	}
+
+	next = numbered.size();
+
+	blocks = partition(code);
+	liveness(code, blocks, (numbered.size() + 63) / 64);
+
+	intervals.clear();
+	build(code, blocks, intervals, numbered);
+	constants(code, defining);
+
+	if (naive) {
+	    naive = false;
+	    spilled.assign(numbered.begin() + NUM_MACHINE_REGS, numbered.end());
+	    spilled.erase(remove(spilled.begin(), spilled.end(), nullptr),
+		    spilled.end());
+	    rewrite(code, spilled, defining, intervals, offset, next,
+		temporaries);
+	    continue;
+	}
+
+	for (auto &entry : intervals) {
+	    entry.second._spillable = temporaries.count(entry.first) == 0;
+	    entry.second._constant = defining.count(entry.first) > 0;
+	}
+
+	hint(code, intervals);
+	spilled = scan(intervals, pool);
+
+	if (spilled.empty())
+	    break;
+
+	rewrite(code, spilled, defining, intervals, offset, next, temporaries);
+    }
+
+    for (auto &inst : code)
+	for (auto &op : inst._operands) {
+	    if (op._base != nullptr && op._base->isVirtual())
+		op._base = intervals[op._base]._assigned;
+
+	    if (op._index != nullptr && op._index->isVirtual())
+		op._index = intervals[op._index]._assigned;
+	}
+
+    for (auto reg : temporaries)
+	delete reg;
+}
@@ -0,0 +1,16 @@
+/*
+ * File:	regalloc.h
+ *
+ * Description:	This file contains the function declarations for the
+ *		register allocator for Simple C.
+ */
+
+# ifndef REGALLOC_H
+# define REGALLOC_H
+# include <vector>
+# include "Instruction.h"
+
+void allocateRegisters(Instructions &code, const std::vector<Register *> &pool,
+	int &offset, bool naive);
+
+# endif /* REGALLOC_H */
@@ -0,0 +1,564 @@
+/*
+ * File:	select.cpp
+ *
+ * Description:	This file contains the public and private function
+ *		definitions for the instruction selector for Simple C.
+ *
+ *		Each temporary of a procedure becomes a virtual register,
+ *		and each quad is replaced by a short sequence of
+ *		instructions in the same form that the tree-based code
+ *		generator produces, so that the peephole optimizer and
+ *		register allocator work on either one.  Machine registers
+ *		are only used where the instruction set or the calling
+ *		convention requires them.
+ *
+ *		Multiplication and division by constants are strength
+ *		reduced by the code generator, which appends to the same
+ *		list of instructions as we do.
+ */
+
+# include <sstream>
+# include "select.h"
+# include "generator.h"
+# include "machine.h"
+
+using namespace std;
+
+static Instructions *code;
+static vector<Register *> temps;
+static vector<Register *> parameters = {rdi, rsi, rdx, rcx, r8, r9};
+
+
+/*
+ * Function:	emit (private)
+ *
+ * Description:	Append an instruction to the current function.
+ */
+
+static void emit(const Instruction &inst)
+{
+    code->push_back(inst);
+}
+
+static void emit(Opcode opcode, unsigned size)
+{
+    code->push_back(Instruction(opcode, size));
+}
+
+static void emit(Opcode opcode, unsigned size, const Operand &op)
+{
+    code->push_back(Instruction(opcode, size, op));
+}
+
+static void emit(Opcode opcode, unsigned size, const Operand &src,
+	const Operand &dst)
+{
+    code->push_back(Instruction(opcode, size, src, dst));
+}
+
+
+/*
+ * Function:	emit (private)
+ *
+ * Description:	Append a conditional instruction to the current function.
+ */
+
+static void emit(Opcode opcode, Condition cond, const Operand &op)
+{
+    Instruction inst(opcode, 1, op);
+
+    inst._cond = cond;
+    code->push_back(inst);
+}
+
+
+/*
+ * Function:	target (private)
+ *
+ * Description:	Return the operand naming the label of a block.
+ */
+
+static Operand target(const Procedure *proc, unsigned block)
+{
+    stringstream ss;
+
+    ss << proc->_blocks[block]._label;
+    return Operand::target(ss.str());
+}
+
+
+/*
+ * Function:	swap (private)
+ *
+ * Description:	Return the condition that holds when the operands of a
+ *		comparison are exchanged.
+ */
+
+static Condition swap(Condition cond)
+{
+    switch (cond) {
+    case CC_L:
+	return CC_G;
+
+    case CC_G:
+	return CC_L;
+
+    case CC_LE:
+	return CC_GE;
+
+    case CC_GE:
+	return CC_LE;
+
+    default:
+	return cond;
+    }
+}
+
+
+/*
+ * Function:	reg (private)
+ *
+ * Description:	Return the register holding a value, first loading the
+ *		value into a new register if it is not a temporary.
+ */
+
+static Register *reg(const Value &value, unsigned size)
+{
+    Register *result;
+
+
+    if (value.isTemp())
+	return temps[value._temp];
+
+    result = getreg();
+
+    if (value.isConst())
+	emit(MOV, size, Operand::immediate(value._value, size),
+	    Operand(result, size));
+    else if (value._kind == Value::GLOBAL)
+	emit(LEA, SIZEOF_PTR, Operand::global(value._symbol, SIZEOF_PTR),
+	    Operand(result, SIZEOF_PTR));
+    else
+	emit(MOV, SIZEOF_PTR, Operand(rbp, SIZEOF_PTR),
+	    Operand(result, SIZEOF_PTR));
+
+    return result;
+}
+
+
+/*
+ * Function:	source (private)
+ *
+ * Description:	Return the operand for a value used as a source operand.
+ *		Only 32-bit immediates may be used, so any larger constants
+ *		are first loaded into a register.
+ */
+
+static Operand source(const Value &value, unsigned size)
+{
+    Operand op;
+
+    if (value.isConst()) {
+	op = Operand::immediate(value._value, size);
+
+	if (op.isSmall())
+	    return op;
+    }
+
+    return Operand(reg(value, size), size);
+}
+
+
+/*
+ * Function:	address (private)
+ *
+ * Description:	Return the memory operand at the given displacement from a
+ *		base value.
+ */
+
+static Operand address(const Value &base, long disp, unsigned size)
+{
+    Operand op;
+
+
+    if (base._kind == Value::FRAME)
+	return Operand::memory(rbp, disp, size);
+
+    if (base._kind == Value::GLOBAL) {
+	op = Operand::global(base._symbol, size);
+	op._value = disp;
+	return op;
+    }
+
+    return Operand::memory(reg(base, SIZEOF_PTR), disp, size);
+}
+
+
+/*
+ * Function:	arithmetic (private)
+ *
+ * Description:	Select a two-address arithmetic instruction.  The left
+ *		operand is copied into the result, unless the result is
+ *		also the right operand, in which case the operands of a
+ *		commutative operator are exchanged and otherwise the result
+ *		is computed elsewhere first.
+ */
+
+static void arithmetic(const Quad &quad, Opcode opcode)
+{
+    unsigned size = quad._dst._size;
+    Value left = quad._args[0], right = quad._args[1];
+    Register *result = temps[quad._dst._temp];
+
+
+    if (right == quad._dst && left != quad._dst) {
+	if (opcode == SUB) {
+	    result = getreg();
+	} else {
+	    left = quad._args[1];
+	    right = quad._args[0];
+	}
+    }
+
+    if (left != quad._dst || result != temps[quad._dst._temp])
+	emit(MOV, size, source(left, size), Operand(result, size));
+
+    emit(opcode, size, source(right, size), Operand(result, size));
+
+    if (result != temps[quad._dst._temp])
+	emit(MOV, size, Operand(result, size),
+	    Operand(temps[quad._dst._temp], size));
+}
+
+
+/*
+ * Function:	multiply (private)
+ *
+ * Description:	Select a multiplication, using lea and shl instead of imul
+ *		if either operand is a suitable constant.
+ */
+
+static void multiply(const Quad &quad)
+{
+    unsigned size = quad._dst._size;
+    Register *dst = temps[quad._dst._temp];
+
+
+    for (unsigned i = 0; i < 2; i ++) {
+	const Value &left = quad._args[1 - i], &right = quad._args[i];
+
+	if (right.isConst() && scalable(right._value)) {
+	    if (left != quad._dst)
+		emit(MOV, size, source(left, size), Operand(dst, size));
+
+	    scale(dst, right._value, size);
+	    return;
+	}
+    }
+
+    arithmetic(quad, IMUL);
+}
+
+
+/*
+ * Function:	divide (private)
+ *
+ * Description:	Select a division or remainder.  The dividend must be in
+ *		%rax and is sign extended into %rdx, and the quotient and
+ *		remainder are left in %rax and %rdx.  The divisor cannot be
+ *		an immediate, but a constant divisor never needs idiv at
+ *		all.
+ */
+
+static void divide(const Quad &quad, Register *result)
+{
+    unsigned size = quad._dst._size;
+    Register *dst = temps[quad._dst._temp];
+    const Value &left = quad._args[0], &right = quad._args[1];
+
+
+    if (right.isConst() && right._value != 0 && right._value != (long) (1UL << 63)) {
+	if (left != quad._dst)
+	    emit(MOV, size, source(left, size), Operand(dst, size));
+
+	result = reciprocal(dst, right._value, size, result == rdx);
+
+	if (result != dst)
+	    emit(MOV, size, Operand(result, size), Operand(dst, size));
+
+	return;
+    }
+
+    emit(MOV, size, source(left, size), Operand(rax, size));
+    emit(CVT, size);
+    emit(IDIV, size, Operand(reg(right, size), size));
+    emit(MOV, size, Operand(result, size), Operand(dst, size));
+}
+
+
+/*
+ * Function:	compare (private)
+ *
+ * Description:	Select a comparison of two values, setting the condition
+ *		codes, and return the condition to test afterwards.  The
+ *		operands are exchanged if the left one is a constant.
+ */
+
+static Condition compare(const Quad &quad)
+{
+    Value left = quad._args[0], right = quad._args[1];
+    Condition cond = quad._cond;
+    unsigned size = left._size;
+
+
+    if (left.isConst() && !right.isConst()) {
+	swap(left, right);
+	cond = swap(cond);
+    }
+
+    emit(CMP, size, source(right, size), Operand(reg(left, size), size));
+    return cond;
+}
+
+
+/*
+ * Function:	call (private)
+ *
+ * Description:	Select a function call, which is much like generating one
+ *		from the tree.  Any arguments beyond the first six are
+ *		pushed, after adjusting the stack so that it is aligned on
+ *		a 16-byte boundary at the call.  A character argument
+ *		passed in a register is sign extended.
+ *
+ *		A tail call instead becomes a return that jumps to the
+ *		function after the frame is torn down, so that it returns
+ *		directly to our caller.
+ */
+
+static void call(const Quad &quad, const vector<Register *> &clobbered,
+	bool tail = false)
+{
+    unsigned numBytes, size;
+    Instruction inst(tail ? RET : CALL, 0, Operand::target(quad._name));
+
+
+    numBytes = 0;
+
+    if (quad._args.size() > NUM_PARAM_REGS) {
+	size = (quad._args.size() - NUM_PARAM_REGS) * SIZEOF_PARAM;
+	numBytes = (STACK_ALIGNMENT - size % STACK_ALIGNMENT) % STACK_ALIGNMENT;
+
+	if (numBytes > 0)
+	    emit(SUB, SIZEOF_REG, Operand::immediate(numBytes, SIZEOF_REG),
+		Operand(rsp, SIZEOF_REG));
+    }
+
+    for (int i = quad._args.size() - 1; i >= 0; i --) {
+	const Value &arg = quad._args[i];
+
+	if (i >= NUM_PARAM_REGS) {
+	    numBytes += SIZEOF_PARAM;
+	    emit(PUSH, SIZEOF_PARAM, source(arg, SIZEOF_PARAM));
+
+	} else {
+	    size = arg._size;
+
+	    if (size == SIZEOF_CHAR && arg.isTemp())
+		emit(MOVS, SIZEOF_INT, Operand(temps[arg._temp], size),
+		    Operand(parameters[i], SIZEOF_INT));
+	    else if (size == SIZEOF_CHAR)
+		emit(MOV, SIZEOF_INT, source(arg, SIZEOF_INT),
+		    Operand(parameters[i], SIZEOF_INT));
+	    else if (arg._kind == Value::GLOBAL)
+		emit(LEA, SIZEOF_PTR, Operand::global(arg._symbol, SIZEOF_PTR),
+		    Operand(parameters[i], SIZEOF_PTR));
+	    else
+		emit(MOV, size, source(arg, size), Operand(parameters[i], size));
+
+	    inst._uses.push_back(parameters[i]);
+	}
+    }
+
+    if (quad._variadic) {
+	emit(MOV, SIZEOF_INT, Operand::immediate(0, SIZEOF_INT),
+	    Operand(rax, SIZEOF_INT));
+	inst._uses.push_back(rax);
+    }
+
+    if (tail) {
+	emit(inst);
+	return;
+    }
+
+    inst._defs = clobbered;
+    emit(inst);
+
+    if (numBytes > 0)
+	emit(ADD, SIZEOF_REG, Operand::immediate(numBytes, SIZEOF_REG),
+	    Operand(rsp, SIZEOF_REG));
+
+    if (quad._dst.isTemp())
+	emit(MOV, quad._dst._size, Operand(rax, quad._dst._size),
+	    Operand(temps[quad._dst._temp], quad._dst._size));
+}
+
+
+/*
+ * Function:	select (private)
+ *
+ * Description:	Select the instructions for a single quad.
+ */
+
+static void select(const Procedure *proc, const Quad &quad,
+	const vector<Register *> &clobbered)
+{
+    unsigned size = quad._dst._size;
+    Register *dst = quad._dst.isTemp() ? temps[quad._dst._temp] : nullptr;
+    Instruction ret(RET, 0);
+    Condition cond;
+    Value arg;
+
+
+    switch (quad._op) {
+    case Q_COPY:
+	emit(MOV, size, source(quad._args[0], size), Operand(dst, size));
+	break;
+
+    case Q_LOAD:
+	emit(MOV, size, address(quad._args[0], quad._disp, size),
+	    Operand(dst, size));
+	break;
+
+    case Q_STORE:
+	arg = quad._args[1];
+	emit(MOV, arg._size, source(arg, arg._size),
+	    address(quad._args[0], quad._disp, arg._size));
+	break;
+
+    case Q_ADDR:
+	emit(LEA, SIZEOF_PTR, address(quad._args[0], quad._disp, SIZEOF_PTR),
+	    Operand(dst, SIZEOF_PTR));
+	break;
+
+    case Q_ADD:
+	arithmetic(quad, ADD);
+	break;
+
+    case Q_SUB:
+	arithmetic(quad, SUB);
+	break;
+
+    case Q_MUL:
+	multiply(quad);
+	break;
+
+    case Q_DIV:
+	divide(quad, rax);
+	break;
+
+    case Q_REM:
+	divide(quad, rdx);
+	break;
+
+    case Q_NEG:
+	if (quad._args[0] != quad._dst)
+	    emit(MOV, size, source(quad._args[0], size), Operand(dst, size));
+
+	emit(NEG, size, Operand(dst, size));
+	break;
+
+    case Q_SET:
+	cond = compare(quad);
+	emit(SET, cond, Operand(dst, 1));
+	emit(MOVZ, SIZEOF_INT, Operand(dst, 1), Operand(dst, SIZEOF_INT));
+	break;
+
+    case Q_EXT:
+	arg = quad._args[0];
+
+	if (arg.isConst())
+	    emit(MOV, size, source(arg, size), Operand(dst, size));
+	else if (arg._size < size)
+	    emit(MOVS, size, Operand(reg(arg, arg._size), arg._size),
+		Operand(dst, size));
+	else
+	    emit(MOV, size, Operand(reg(arg, arg._size), size),
+		Operand(dst, size));
+	break;
+
+    case Q_CALL:
+	call(quad, clobbered);
+	break;
+
+    case Q_JUMP:
+	emit(JMP, 0, target(proc, quad._targets[0]));
+	break;
+
+    case Q_BRANCH:
+	cond = compare(quad);
+	emit(JCC, cond, target(proc, quad._targets[0]));
+	emit(JMP, 0, target(proc, quad._targets[1]));
+	break;
+
+    case Q_RETURN:
+	if (!quad._args.empty()) {
+	    arg = quad._args[0];
+	    emit(MOV, arg._size, source(arg, arg._size),
+		Operand(rax, arg._size));
+	}
+
+	if (proc->_returns)
+	    ret._uses.push_back(rax);
+
+	emit(ret);
+	break;
+
+    case Q_PHI:
+	/* A procedure is always taken out of SSA form first. */
+	break;
+    }
+}
+
+
+/*
+ * Function:	select
+ *
+ * Description:	Select the instructions for a procedure, appending them to
+ *		the given list.  The call instruction destroys the given
+ *		caller-saved registers.  The parameters passed in registers
+ *		are first copied into their temporaries.  A call whose
+ *		result is immediately returned is made as a tail call if
+ *		its arguments all fit in registers and nothing in our
+ *		frame can be reached by the callee.
+ */
+
+void select(const Procedure *proc, Instructions &code,
+	const vector<Register *> &clobbered)
+{
+    bool tail;
+
+
+    ::code = &code;
+    temps.clear();
+
+    for (unsigned i = 0; i < proc->_temps; i ++)
+	temps.push_back(getreg());
+
+    for (unsigned i = 0; i < proc->_params.size(); i ++)
+	emit(MOV, SIZEOF_REG, Operand(parameters[i], SIZEOF_REG),
+	    Operand(temps[proc->_params[i]], SIZEOF_REG));
+
+    tail = !proc->takesAddress();
+
+    for (unsigned i = 0; i < proc->_blocks.size(); i ++) {
+	const vector<Quad> &quads = proc->_blocks[i]._quads;
+	emit(Instruction(LABEL, 0, target(proc, i)));
+
+	for (unsigned j = 0; j < quads.size(); j ++)
+	    if (tail && j + 1 < quads.size() && quads[j].isTailCall(quads[j + 1])
+		    && quads[j]._args.size() <= NUM_PARAM_REGS)
+		call(quads[j ++], clobbered, true);
+	    else
+		select(proc, quads[j], clobbered);
+    }
+}
@@ -0,0 +1,17 @@
+/*
+ * File:	select.h
+ *
+ * Description:	This file contains the function declarations for the
+ *		instruction selector for Simple C.
+ */
+
+# ifndef SELECT_H
+# define SELECT_H
+# include <vector>
+# include "Instruction.h"
+# include "ir.h"
+
+void select(const Procedure *proc, Instructions &code,
+	const std::vector<Register *> &clobbered);
+
+# endif /* SELECT_H */
@@ -0,0 +1,582 @@
+/*
+ * File:	ssa.cpp
+ *
+ * Description:	This file contains the public and private function
+ *		definitions for converting a procedure into and out of
+ *		static single assignment form.
+ *
+ *		A local variable whose address is never taken (its slot
+ *		never appears in an addr quad) can only be reached by loads
+ *		and stores of its slot, so it is replaced by temporaries.
+ *		The few temporaries assigned in more than one place, such
+ *		as the result of a logical expression, are renamed as well.
+ *		Phi quads are placed at the dominance frontiers of the
+ *		definitions, but only for names that are live on entry to
+ *		some block, and the renaming is a walk of the dominator
+ *		tree, as described by Cytron et al.
+ *
+ *		To leave static single assignment form, each phi becomes a
+ *		copy at the end of each of its predecessors, after first
+ *		splitting any critical edges so that the copies are only
+ *		executed along their own edge.  The copies at the end of a
+ *		block happen in parallel, so they are ordered such that no
+ *		value is overwritten before it is read, using an extra
+ *		temporary to break any cycle.
+ */
+
+# include <map>
+# include <algorithm>
+# include "ssa.h"
+
+using namespace std;
+
+struct Variable {
+    unsigned size;
+    bool global;
+    vector<unsigned> blocks;
+};
+
+static Procedure *proc;
+static vector<Variable> variables;
+static map<long, unsigned> slots;
+static vector<int> names;
+static vector<Value> replaced;
+static vector<vector<unsigned>> children, phis;
+static vector<vector<Value>> stacks;
+
+
+/*
+ * Function:	variable (private)
+ *
+ * Description:	Return the variable loaded or stored by a quad, or -1 if
+ *		the quad does not access the slot of a variable.
+ */
+
+static int variable(const Quad &quad)
+{
+    map<long, unsigned>::iterator it;
+
+
+    if (quad._op != Q_LOAD && quad._op != Q_STORE)
+	return -1;
+
+    if (quad._args[0]._kind != Value::FRAME)
+	return -1;
+
+    it = slots.find(quad._disp);
+    return it != slots.end() ? (int) it->second : -1;
+}
+
+
+/*
+ * Function:	declare (private)
+ *
+ * Description:	Add a new variable of the given size and return its index.
+ */
+
+static unsigned declare(unsigned size)
+{
+    Variable var;
+
+    var.size = size;
+    var.global = false;
+    variables.push_back(var);
+    return variables.size() - 1;
+}
+
+
+/*
+ * Function:	findVariables (private)
+ *
+ * Description:	Find the slots and temporaries to be renamed.  A slot is
+ *		only renamed if it is always loaded and stored with the
+ *		same size and its address is never taken.
+ */
+
+static void findVariables()
+{
+    map<long, unsigned> sizes;
+    vector<unsigned> defs(proc->_temps, 0), bytes(proc->_temps, 0);
+    unsigned size;
+
+
+    for (auto &block : proc->_blocks)
+	for (auto &quad : block._quads) {
+	    if (!quad._args.empty() && quad._args[0]._kind == Value::FRAME) {
+		if (quad._op == Q_LOAD)
+		    size = quad._dst._size;
+		else if (quad._op == Q_STORE)
+		    size = quad._args[1]._size;
+		else
+		    size = 0;
+
+		if (sizes.count(quad._disp) == 0)
+		    sizes[quad._disp] = size;
+		else if (sizes[quad._disp] != size)
+		    sizes[quad._disp] = 0;
+	    }
+
+	    if (quad._dst.isTemp()) {
+		defs[quad._dst._temp] ++;
+		bytes[quad._dst._temp] = quad._dst._size;
+	    }
+	}
+
+    for (auto &entry : sizes)
+	if (entry.second > 0)
+	    slots[entry.first] = declare(entry.second);
+
+    for (unsigned i = 0; i < proc->_temps; i ++)
+	if (defs[i] > 1)
+	    names[i] = declare(bytes[i]);
+}
+
+
+/*
+ * Function:	define (private)
+ *
+ * Description:	Record that a variable is assigned in the given block.
+ */
+
+static void define(int var, unsigned block)
+{
+    vector<unsigned> &blocks = variables[var].blocks;
+
+    if (blocks.empty() || blocks.back() != block)
+	blocks.push_back(block);
+}
+
+
+/*
+ * Function:	findGlobals (private)
+ *
+ * Description:	Find the blocks that assign each variable and whether the
+ *		variable is ever used in a block before being assigned
+ *		there.  Only a variable that is used that way needs a phi.
+ */
+
+static void findGlobals()
+{
+    vector<bool> defined;
+    int var;
+
+
+    for (unsigned i = 0; i < proc->_blocks.size(); i ++) {
+	defined.assign(variables.size(), false);
+
+	for (auto &quad : proc->_blocks[i]._quads) {
+	    var = variable(quad);
+
+	    if (var >= 0 && quad._op == Q_LOAD && !defined[var])
+		variables[var].global = true;
+
+	    for (auto &arg : quad._args)
+		if (arg.isTemp() && names[arg._temp] >= 0
+		    && !defined[names[arg._temp]])
+		    variables[names[arg._temp]].global = true;
+
+	    if (var >= 0 && quad._op == Q_STORE) {
+		defined[var] = true;
+		define(var, i);
+	    }
+
+	    if (quad._dst.isTemp() && names[quad._dst._temp] >= 0) {
+		defined[names[quad._dst._temp]] = true;
+		define(names[quad._dst._temp], i);
+	    }
+	}
+    }
+}
+
+
+/*
+ * Function:	placePhis (private)
+ *
+ * Description:	Place a phi for each global variable at the iterated
+ *		dominance frontier of the blocks that assign it.  The phis
+ *		of a block come first, in the same order as the variables
+ *		recorded for it.
+ */
+
+static void placePhis(const vector<vector<unsigned>> &frontiers)
+{
+    vector<unsigned> work;
+    vector<bool> placed, queued;
+
+
+    for (unsigned var = 0; var < variables.size(); var ++) {
+	if (!variables[var].global)
+	    continue;
+
+	placed.assign(proc->_blocks.size(), false);
+	queued.assign(proc->_blocks.size(), false);
+	work = variables[var].blocks;
+
+	for (auto block : work)
+	    queued[block] = true;
+
+	while (!work.empty()) {
+	    unsigned block = work.back();
+	    work.pop_back();
+
+	    for (auto target : frontiers[block]) {
+		if (placed[target])
+		    continue;
+
+		BasicBlock &bb = proc->_blocks[target];
+		Quad phi(Q_PHI);
+
+		phi._args.resize(bb._preds.size());
+		phi._sources = bb._preds;
+		bb._quads.insert(bb._quads.begin() + phis[target].size(), phi);
+		phis[target].push_back(var);
+		placed[target] = true;
+
+		if (!queued[target]) {
+		    queued[target] = true;
+		    work.push_back(target);
+		}
+	    }
+	}
+    }
+}
+
+
+/*
+ * Function:	current (private)
+ *
+ * Description:	Return the current value of a variable, used with the
+ *		given size.  A variable used before it is ever assigned is
+ *		simply zero.
+ */
+
+static Value current(unsigned var, unsigned size)
+{
+    Value value;
+
+    if (stacks[var].empty())
+	return Value::constant(0, size);
+
+    value = stacks[var].back();
+    value._size = size;
+    return value;
+}
+
+
+/*
+ * Function:	rename (private)
+ *
+ * Description:	Return the new name for a value used by a quad.
+ */
+
+static Value rename(const Value &value)
+{
+    Value result;
+
+
+    if (!value.isTemp() || value._temp >= names.size())
+	return value;
+
+    if (names[value._temp] >= 0)
+	return current(names[value._temp], value._size);
+
+    if (replaced[value._temp]._kind == Value::NONE)
+	return value;
+
+    result = replaced[value._temp];
+    result._size = value._size;
+    return result;
+}
+
+
+/*
+ * Function:	rename (private)
+ *
+ * Description:	Rename the variables in a block and the blocks it
+ *		dominates.  A load of a variable is removed and its result
+ *		replaced by the current value of the variable, while a
+ *		store is removed and makes its value the current one.  The
+ *		arguments of the phis in each successor are then filled in
+ *		with the values reaching them along our edge.
+ */
+
+static void rename(unsigned block)
+{
+    BasicBlock &bb = proc->_blocks[block];
+    vector<Quad> quads;
+    vector<unsigned> pushed;
+    int var;
+
+
+    for (unsigned i = 0; i < bb._quads.size(); i ++) {
+	Quad quad = bb._quads[i];
+
+	if (quad._op == Q_PHI) {
+	    var = phis[block][i];
+	    quad._dst = proc->newTemp(variables[var].size);
+	    stacks[var].push_back(quad._dst);
+	    pushed.push_back(var);
+	    quads.push_back(quad);
+	    continue;
+	}
+
+	for (auto &arg : quad._args)
+	    arg = rename(arg);
+
+	var = variable(quad);
+
+	if (var >= 0 && quad._op == Q_LOAD) {
+	    replaced[quad._dst._temp] = current(var, quad._dst._size);
+	    continue;
+	}
+
+	if (var >= 0) {
+	    stacks[var].push_back(quad._args[1]);
+	    pushed.push_back(var);
+	    continue;
+	}
+
+	if (quad._dst.isTemp() && names[quad._dst._temp] >= 0) {
+	    var = names[quad._dst._temp];
+	    quad._dst = proc->newTemp(quad._dst._size);
+	    stacks[var].push_back(quad._dst);
+	    pushed.push_back(var);
+	}
+
+	quads.push_back(quad);
+    }
+
+    bb._quads = quads;
+
+    for (auto succ : bb._succs)
+	for (unsigned i = 0; i < phis[succ].size(); i ++) {
+	    Quad &phi = proc->_blocks[succ]._quads[i];
+
+	    for (unsigned j = 0; j < phi._sources.size(); j ++)
+		if (phi._sources[j] == block)
+		    phi._args[j] = current(phis[succ][i],
+			variables[phis[succ][i]].size);
+	}
+
+    for (auto child : children[block])
+	rename(child);
+
+    for (auto var : pushed)
+	stacks[var].pop_back();
+}
+
+
+/*
+ * Function:	buildSSA
+ *
+ * Description:	Convert a procedure into static single assignment form.
+ *		Any unreachable blocks are removed first.  A parameter
+ *		passed on the stack already has a value on entry, which is
+ *		loaded at the start of the procedure.
+ */
+
+void buildSSA(Procedure *p)
+{
+    vector<unsigned> idom;
+    vector<vector<unsigned>> frontiers;
+    vector<Quad> loads, entry;
+    unsigned runner, n;
+
+
+    proc = p;
+    proc->compact();
+    n = proc->_blocks.size();
+
+    variables.clear();
+    slots.clear();
+    names.assign(proc->_temps, -1);
+    replaced.assign(proc->_temps, Value());
+    findVariables();
+
+    if (variables.empty())
+	return;
+
+
+    /* Compute the dominator tree and the dominance frontiers. */
+
+    proc->dominators(idom);
+    children.assign(n, vector<unsigned>());
+    frontiers.assign(n, vector<unsigned>());
+
+    for (unsigned i = 1; i < n; i ++)
+	children[idom[i]].push_back(i);
+
+    for (unsigned i = 0; i < n; i ++) {
+	if (proc->_blocks[i]._preds.size() < 2)
+	    continue;
+
+	for (auto pred : proc->_blocks[i]._preds)
+	    for (runner = pred; runner != idom[i]; runner = idom[runner])
+		if (frontiers[runner].empty() || frontiers[runner].back() != i)
+		    frontiers[runner].push_back(i);
+    }
+
+
+    /* Place the phis and rename everything, starting with the values of
+       any parameters passed on the stack. */
+
+    phis.assign(n, vector<unsigned>());
+    findGlobals();
+    placePhis(frontiers);
+
+    stacks.assign(variables.size(), vector<Value>());
+
+    for (auto &entry : slots)
+	if (entry.first > 0) {
+	    Quad load(Q_LOAD, proc->newTemp(variables[entry.second].size),
+		Value::frame());
+
+	    load._disp = entry.first;
+	    stacks[entry.second].push_back(load._dst);
+	    loads.push_back(load);
+	}
+
+    rename(0);
+
+    entry = proc->_blocks[0]._quads;
+    entry.insert(entry.begin(), loads.begin(), loads.end());
+    proc->_blocks[0]._quads = entry;
+}
+
+
+/*
+ * Function:	sequentialize (private)
+ *
+ * Description:	Append copies to the given quads that have the same effect
+ *		as performing all the given copies at once.  A copy is
+ *		ready once no other copy still needs its old value.  If no
+ *		copy is ready, the remaining ones form a cycle, which we
+ *		break by saving one of the old values in a new temporary.
+ */
+
+static void sequentialize(vector<pair<Value, Value>> copies,
+	vector<Quad> &quads)
+{
+    Value temp;
+    unsigned i, j;
+
+
+    for (i = copies.size(); i -- > 0; )
+	if (copies[i].first == copies[i].second)
+	    copies.erase(copies.begin() + i);
+
+    while (!copies.empty()) {
+	for (i = 0; i < copies.size(); i ++) {
+	    for (j = 0; j < copies.size(); j ++)
+		if (j != i && copies[j].second == copies[i].first)
+		    break;
+
+	    if (j == copies.size())
+		break;
+	}
+
+	if (i < copies.size()) {
+	    quads.push_back(Quad(Q_COPY, copies[i].first, copies[i].second));
+	    copies.erase(copies.begin() + i);
+	    continue;
+	}
+
+	temp = proc->newTemp(copies[0].first._size);
+	quads.push_back(Quad(Q_COPY, temp, copies[0].first));
+
+	for (j = 0; j < copies.size(); j ++)
+	    if (copies[j].second == copies[0].first) {
+		temp._size = copies[j].second._size;
+		copies[j].second = temp;
+	    }
+    }
+}
+
+
+/*
+ * Function:	destroySSA
+ *
+ * Description:	Convert a procedure out of static single assignment form
+ *		by replacing its phis with copies.
+ */
+
+void destroySSA(Procedure *p)
+{
+    vector<unsigned> preds;
+    vector<pair<Value, Value>> copies;
+    vector<Quad> quads;
+    unsigned split, n;
+
+
+    proc = p;
+    n = proc->_blocks.size();
+
+
+    /* Split each critical edge leading to a block with phis. */
+
+    for (unsigned i = 0; i < n; i ++) {
+	if (proc->_blocks[i]._quads[0]._op != Q_PHI)
+	    continue;
+
+	preds = proc->_blocks[i]._preds;
+	sort(preds.begin(), preds.end());
+	preds.erase(unique(preds.begin(), preds.end()), preds.end());
+
+	for (auto pred : preds) {
+	    if (proc->_blocks[pred]._quads.back().successors() < 2)
+		continue;
+
+	    split = proc->newBlock();
+	    proc->_blocks[split]._quads.push_back(Quad(Q_JUMP));
+	    proc->_blocks[split]._quads[0]._targets[0] = i;
+
+	    Quad &last = proc->_blocks[pred]._quads.back();
+
+	    for (unsigned j = 0; j < last.successors(); j ++)
+		if (last._targets[j] == i)
+		    last._targets[j] = split;
+
+	    for (auto &quad : proc->_blocks[i]._quads)
+		for (auto &source : quad._sources)
+		    if (source == pred)
+			source = split;
+	}
+    }
+
+    proc->link();
+
+
+    /* Replace the phis with copies at the end of each predecessor. */
+
+    for (unsigned i = 0; i < proc->_blocks.size(); i ++) {
+	vector<Quad> &head = proc->_blocks[i]._quads;
+
+	if (head[0]._op != Q_PHI)
+	    continue;
+
+	preds = proc->_blocks[i]._preds;
+	sort(preds.begin(), preds.end());
+	preds.erase(unique(preds.begin(), preds.end()), preds.end());
+
+	for (auto pred : preds) {
+	    copies.clear();
+
+	    for (unsigned j = 0; head[j]._op == Q_PHI; j ++) {
+		const Quad &phi = head[j];
+		unsigned k = find(phi._sources.begin(), phi._sources.end(),
+		    pred) - phi._sources.begin();
+
+		copies.push_back(make_pair(phi._dst, phi._args[k]));
+	    }
+
+	    quads.clear();
+	    sequentialize(copies, quads);
+
+	    vector<Quad> &code = proc->_blocks[pred]._quads;
+	    code.insert(code.end() - 1, quads.begin(), quads.end());
+	}
+
+	while (head[0]._op == Q_PHI)
+	    head.erase(head.begin());
+    }
+}
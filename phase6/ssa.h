@@ -0,0 +1,16 @@
+/*
+ * File:	ssa.h
+ *
+ * Description:	This file contains the function declarations for
+ *		converting a procedure into and out of static single
+ *		assignment form.
+ */
+
+# ifndef SSA_H
+# define SSA_H
+# include "ir.h"
+
+void buildSSA(Procedure *proc);
+void destroySSA(Procedure *proc);
+
+# endif /* SSA_H */
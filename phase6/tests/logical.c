@@ -0,0 +1,61 @@
+/*
+ * File:	logical.c
+ *
+ * Description:	Regression program for logical expressions and if
+ *		statements whose operands or conditions call functions with
+ *		side effects.  The left operand of && and || must be
+ *		evaluated first, and the condition of an if statement
+ *		before either of its arms.  The program prints each result
+ *		that is wrong and exits with the number of them.
+ */
+
+int printf();
+int g, h, x, y, t, failures;
+
+int setg(int v) { g = v; return v; }
+int seth(int v) { h = v; return v; }
+
+int check(int n, int value, int expected)
+{
+    if (value != expected) {
+	printf("case %d: got %d, expected %d\n", n, value, expected);
+	failures = failures + 1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    g = 1;
+    t = setg(0) && g;
+    check(1, t, 0);
+
+    g = 1;
+    t = setg(0) || g;
+    check(2, t, 0);
+
+    h = 0; x = 1; y = 1;
+    t = seth(7) && (x && y);
+    check(3, t, 1);
+    check(4, h, 7);
+
+    g = 5;
+    t = setg(2) > 1 || g == 5;
+    check(5, t, 1);
+
+    g = 1;
+    if (setg(0) == 0) x = g + 1; else x = g - 1;
+    check(6, x, 1);
+
+    g = 0;
+    if (setg(3) > 2) x = g * 2; else x = g;
+    check(7, x, 6);
+
+    x = 3; y = 0;
+    check(8, x > 2 && y < 1, 1);
+    check(9, x < 2 || y > 1, 0);
+    check(10, (x > 2 || y) && (y == 0 || x == 7), 1);
+
+    return failures;
+}
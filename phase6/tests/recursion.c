@@ -0,0 +1,35 @@
+/*
+ * File:	recursion.c
+ *
+ * Description:	Regression program for the size of stack frames.  The
+ *		function recurses 100001 times with several values live at
+ *		each call, which fits in the usual eight-megabyte stack only
+ *		if no frame is much larger than the variables and
+ *		temporaries need, including with -fregalloc=naive.  The
+ *		program prints 1009 and exits with zero if it does not
+ *		overflow the stack.
+ */
+
+int printf();
+
+int depth(int n, int a, int b)
+{
+    int x, y, z;
+
+    if (n == 0)
+	return a + b;
+
+    x = a + n;
+    y = b * 2 - x;
+    z = x + y + n % 7;
+    return depth(n - 1, z % 1000, (x + y) % 1000) + 1 - 1;
+}
+
+int main(void)
+{
+    int n;
+
+    n = depth(100001, 1, 2);
+    printf("%d\n", n);
+    return n != 1009;
+}